@@ -0,0 +1,589 @@
+/**
+ * @file   bench.cpp
+ * @brief  Transfer benchmark. Generates a synthetic catalogue, moves it with
+ *         every strategy the daemon has, the mv shell-out the daemon used to
+ *         run included, and prints one JSON document with files/s, MB/s,
+ *         system calls per file and per-file latency percentiles.
+ *
+ *         DaemonBench [--files=N] [--size=SIZE] [--depth=D] [--fanout=F]
+ *                     [--src-dir=DIR] [--dst-dir=DIR] [--strategies=shell,sync,uring]
+ *                     [--durability=none|batch|file] [--verify=none|checksum|readback]
+ *                     [--queue-depth=N] [--seed=N] [--syscalls=0|1]
+ *                     [--log=none|sync|async] [--log-file=PATH]
+ *
+ *         SIZE is a byte count (K, M and G suffixes), MIN-MAX for a uniform
+ *         distribution or lognormal:MEDIAN:SIGMA. Point --dst-dir to another
+ *         file system, /dev/shm for instance, to measure cross-device copies.
+ *         --log logs every moved file to --log-file (/dev/null by default)
+ *         through the daemon's logger, written at once or by its flusher.
+ */
+#include <ftw.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/ptrace.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <utility>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "logging/logger.h"
+#include "transfer/mover.h"
+#include "transfer/uringmover.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Config
+{
+    size_t m_files = 10000;
+    std::string m_size = "4K";
+    unsigned m_depth = 0;
+    unsigned m_fanout = 4;
+    std::string m_srcDir = "/tmp";
+    std::string m_dstDir;
+    std::vector<std::string> m_strategies = { "shell", "sync", "uring" };
+    transfer::Durability m_durability = transfer::Durability::None;
+    transfer::Verify m_verify = transfer::Verify::None;
+    unsigned m_queueDepth = 256;
+    uint64_t m_seed = 1;
+    bool m_syscalls = true;
+    std::string m_log = "none";
+    std::string m_logFile = "/dev/null";
+};
+
+struct Workload
+{
+    std::string m_source;
+    std::string m_destination;
+    size_t m_files = 0;
+    uint64_t m_bytes = 0;
+    bool m_crossDevice = false;
+};
+
+struct Measurement
+{
+    std::string m_strategy;
+    double m_seconds = 0;
+    size_t m_moved = 0;
+    uint64_t m_bytesMoved = 0;
+    size_t m_left = 0;
+    ///@brief -1 if the system calls could not be counted
+    double m_syscallsPerFile = -1;
+    ///@brief Log messages the logger dropped because its buffer was full
+    uint64_t m_logDropped = 0;
+    ///@brief Gaps between two results in microseconds, empty for the shell
+    std::vector<double> m_latencies;
+};
+
+uint64_t parseBytes(const std::string& value)
+{
+    size_t end = 0;
+    uint64_t result = std::stoull(value, &end);
+    if (end < value.size()) {
+        switch (value[end]) {
+        case 'K': case 'k':
+            return result << 10;
+        case 'M': case 'm':
+            return result << 20;
+        case 'G': case 'g':
+            return result << 30;
+        default:
+            throw std::invalid_argument("bad size: " + value);
+        }
+    }
+    return result;
+}
+
+///@brief Draws file sizes from the --size distribution
+class SizeDistribution
+{
+public:
+    SizeDistribution(const std::string& spec, uint64_t seed)
+        : m_random(seed)
+    {
+        if (spec.compare(0, 10, "lognormal:") == 0) {
+            auto colon = spec.find(':', 10);
+            if (colon == std::string::npos) {
+                throw std::invalid_argument("bad size: " + spec);
+            }
+            double median = static_cast<double>(parseBytes(spec.substr(10, colon - 10)));
+            m_lognormal = std::lognormal_distribution<double>(std::log(std::max(median, 1.0)),
+                                                              std::stod(spec.substr(colon + 1)));
+            m_kind = Kind::Lognormal;
+            return;
+        }
+        auto dash = spec.find('-');
+        if (dash != std::string::npos) {
+            m_uniform = std::uniform_int_distribution<uint64_t>(parseBytes(spec.substr(0, dash)),
+                                                                parseBytes(spec.substr(dash + 1)));
+            m_kind = Kind::Uniform;
+            return;
+        }
+        m_fixed = parseBytes(spec);
+    }
+
+    uint64_t next()
+    {
+        switch (m_kind) {
+        case Kind::Uniform:
+            return m_uniform(m_random);
+        case Kind::Lognormal:
+            return static_cast<uint64_t>(m_lognormal(m_random));
+        case Kind::Fixed:
+            break;
+        }
+        return m_fixed;
+    }
+
+private:
+    enum class Kind { Fixed, Uniform, Lognormal };
+
+    Kind m_kind = Kind::Fixed;
+    uint64_t m_fixed = 0;
+    std::mt19937_64 m_random;
+    std::uniform_int_distribution<uint64_t> m_uniform;
+    std::lognormal_distribution<double> m_lognormal;
+};
+
+int removeEntry(const char* path, const struct stat*, int, struct FTW*)
+{
+    return remove(path);
+}
+
+void removeTree(const std::string& path)
+{
+    nftw(path.c_str(), removeEntry, 64, FTW_DEPTH | FTW_PHYS);
+}
+
+///@brief Regular files below path and their total size
+std::pair<size_t, uint64_t> countFiles(const std::string& path)
+{
+    static std::pair<size_t, uint64_t> s_count;
+    s_count = std::make_pair(0, 0);
+    nftw(path.c_str(), [] (const char*, const struct stat* st, int type, struct FTW*) {
+        if (type == FTW_F) {
+            ++s_count.first;
+            s_count.second += static_cast<uint64_t>(st->st_size);
+        }
+        return 0;
+    }, 64, FTW_PHYS);
+    return s_count;
+}
+
+void makeDirectory(const std::string& path)
+{
+    if (mkdir(path.c_str(), 0755) == -1 && errno != EEXIST) {
+        throw std::runtime_error("mkdir " + path + ": " + strerror(errno));
+    }
+}
+
+///@brief Leaf directories of a tree of the given depth and fanout below root
+void makeTree(const std::string& root, unsigned depth, unsigned fanout, std::vector<std::string>& leaves)
+{
+    if (depth == 0) {
+        leaves.push_back(root);
+        return;
+    }
+    for (unsigned i = 0; i < fanout; ++i) {
+        auto dir = root + "/d" + std::to_string(i);
+        makeDirectory(dir);
+        makeTree(dir, depth - 1, fanout, leaves);
+    }
+}
+
+Workload generate(const Config& config, const std::string& strategy)
+{
+    Workload workload;
+    auto suffix = "." + strategy + "." + std::to_string(getpid());
+    workload.m_source = config.m_srcDir + "/bench.src" + suffix;
+    workload.m_destination = config.m_dstDir + "/bench.dst" + suffix;
+    removeTree(workload.m_source);
+    removeTree(workload.m_destination);
+    makeDirectory(workload.m_source);
+    makeDirectory(workload.m_destination);
+    struct stat src;
+    struct stat dst;
+    if (stat(workload.m_source.c_str(), &src) == 0 && stat(workload.m_destination.c_str(), &dst) == 0) {
+        workload.m_crossDevice = src.st_dev != dst.st_dev;
+    }
+
+    std::vector<std::string> leaves;
+    makeTree(workload.m_source, config.m_depth, std::max(config.m_fanout, 1u), leaves);
+    SizeDistribution sizes(config.m_size, config.m_seed);
+    std::mt19937_64 random(config.m_seed);
+    std::vector<char> pattern(1 << 20);
+    for (auto& byte : pattern) {
+        byte = static_cast<char>(random());
+    }
+    for (size_t i = 0; i < config.m_files; ++i) {
+        auto path = leaves[i % leaves.size()] + "/f" + std::to_string(i);
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd == -1) {
+            throw std::runtime_error("create " + path + ": " + strerror(errno));
+        }
+        auto size = sizes.next();
+        for (uint64_t done = 0; done < size; ) {
+            auto ret = write(fd, pattern.data(), std::min<uint64_t>(size - done, pattern.size()));
+            if (ret <= 0) {
+                close(fd);
+                throw std::runtime_error("write " + path + ": " + strerror(errno));
+            }
+            done += static_cast<uint64_t>(ret);
+        }
+        close(fd);
+        workload.m_bytes += size;
+        ++workload.m_files;
+    }
+    ///@brief Measure the transfer, not the writeback of what was just generated
+    sync();
+    return workload;
+}
+
+///@brief Move the workload once with strategy, report receives every result of the native movers
+void transferOnce(const Config& config, const std::string& strategy, const Workload& workload,
+                  const transfer::Report& report)
+{
+    transfer::Options options;
+    options.m_durability = config.m_durability;
+    options.m_verify = config.m_verify;
+    if (strategy == "shell") {
+        ///@brief What Daemon::doAction ran before the native movers
+        auto command = "mv " + workload.m_source + "/* " + workload.m_destination + " > /dev/null 2>&1";
+        if (system(command.c_str()) == -1) {
+            throw std::runtime_error("system: " + std::string(strerror(errno)));
+        }
+    } else if (strategy == "sync") {
+        transfer::Mover mover(workload.m_source, workload.m_destination, options);
+        mover.moveAll(report);
+    } else if (strategy == "uring") {
+        transfer::UringMover mover(workload.m_source, workload.m_destination, config.m_queueDepth, options);
+        mover.moveAll(report);
+    } else {
+        throw std::invalid_argument("unknown strategy: " + strategy);
+    }
+}
+
+/**
+ * @brief Run the transfer in a traced child and count the system calls of all its
+ * threads and processes. io_uring operations are not system calls and are not counted.
+ * @return -1 if the child could not be traced
+ */
+long countSyscalls(const Config& config, const std::string& strategy, const Workload& workload)
+{
+    pid_t child = fork();
+    if (child == -1) {
+        return -1;
+    }
+    if (child == 0) {
+        if (ptrace(PTRACE_TRACEME, 0, nullptr, nullptr) == -1) {
+            _exit(2);
+        }
+        raise(SIGSTOP);
+        try {
+            transferOnce(config, strategy, workload, [] (const transfer::Result&) {});
+        } catch (const std::exception&) {
+            _exit(1);
+        }
+        _exit(0);
+    }
+    int status = 0;
+    if (waitpid(child, &status, 0) == -1 || !WIFSTOPPED(status)) {
+        return -1;
+    }
+    long options = PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_TRACEFORK |
+        PTRACE_O_TRACEVFORK | PTRACE_O_TRACEEXEC | PTRACE_O_EXITKILL;
+    if (ptrace(PTRACE_SETOPTIONS, child, nullptr, reinterpret_cast<void*>(options)) == -1) {
+        kill(child, SIGKILL);
+        waitpid(child, nullptr, 0);
+        return -1;
+    }
+    long syscalls = 0;
+    ///@brief Syscall stops alternate between entry and exit per task
+    std::map<pid_t, bool> inSyscall;
+    ptrace(PTRACE_SYSCALL, child, nullptr, nullptr);
+    while (true) {
+        pid_t pid = waitpid(-1, &status, __WALL);
+        if (pid == -1) {
+            break;
+        }
+        if (WIFEXITED(status) || WIFSIGNALED(status)) {
+            inSyscall.erase(pid);
+            if (pid == child) {
+                break;
+            }
+            continue;
+        }
+        if (!WIFSTOPPED(status)) {
+            continue;
+        }
+        int signal = 0;
+        int stop = WSTOPSIG(status);
+        if (stop == (SIGTRAP | 0x80)) {
+            bool& entering = inSyscall[pid];
+            entering = !entering;
+            if (entering) {
+                ++syscalls;
+            }
+        } else if (status >> 16 != 0) {
+            ///@brief clone, fork or exec event, the new task is attached already
+            if ((status >> 16) == PTRACE_EVENT_EXEC) {
+                inSyscall[pid] = false;
+                ++syscalls; // execve itself, its exit stop does not follow the exec event
+            }
+        } else if (stop != SIGSTOP) {
+            signal = stop;
+        }
+        ptrace(PTRACE_SYSCALL, pid, nullptr, reinterpret_cast<void*>(static_cast<long>(signal)));
+    }
+    return syscalls;
+}
+
+Measurement measure(const Config& config, const std::string& strategy, Workload& workload)
+{
+    Measurement measurement;
+    measurement.m_strategy = strategy;
+    workload = generate(config, strategy);
+    bool log = config.m_log != "none";
+    auto dropped = logging::Logger::instance().dropped();
+    auto last = Clock::now();
+    auto start = last;
+    transferOnce(config, strategy, workload, [&measurement, &last, &strategy, log] (const transfer::Result& result) {
+        if (log) {
+            DAEMON_LOG(LOG_INFO, "%s: %s %s", strategy.c_str(), transfer::statusName(result.m_status),
+                       result.m_name.c_str());
+        }
+        auto now = Clock::now();
+        measurement.m_latencies.push_back(std::chrono::duration<double, std::micro>(now - last).count());
+        last = now;
+    });
+    measurement.m_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    measurement.m_logDropped = logging::Logger::instance().dropped() - dropped;
+    auto moved = countFiles(workload.m_destination);
+    measurement.m_moved = moved.first;
+    measurement.m_bytesMoved = moved.second;
+    measurement.m_left = countFiles(workload.m_source).first;
+    removeTree(workload.m_source);
+    removeTree(workload.m_destination);
+
+    if (config.m_syscalls) {
+        workload = generate(config, strategy);
+        long syscalls = countSyscalls(config, strategy, workload);
+        if (syscalls >= 0 && workload.m_files > 0) {
+            measurement.m_syscallsPerFile = static_cast<double>(syscalls) / static_cast<double>(workload.m_files);
+        }
+        removeTree(workload.m_source);
+        removeTree(workload.m_destination);
+    }
+    return measurement;
+}
+
+double percentile(std::vector<double> values, double fraction)
+{
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    auto index = static_cast<size_t>(std::ceil(fraction * static_cast<double>(values.size()))) - 1;
+    return values[std::min(index, values.size() - 1)];
+}
+
+std::string jsonString(const std::string& value)
+{
+    std::string out = "\"";
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+const char* durabilityName(transfer::Durability durability)
+{
+    switch (durability) {
+    case transfer::Durability::None:
+        return "none";
+    case transfer::Durability::Batch:
+        return "batch";
+    case transfer::Durability::File:
+        return "file";
+    }
+    return "unknown";
+}
+
+const char* verifyName(transfer::Verify verify)
+{
+    switch (verify) {
+    case transfer::Verify::None:
+        return "none";
+    case transfer::Verify::Checksum:
+        return "checksum";
+    case transfer::Verify::ReadBack:
+        return "readback";
+    }
+    return "unknown";
+}
+
+void printJson(const Config& config, const Workload& workload, const std::vector<Measurement>& measurements)
+{
+    std::ostringstream out;
+    out << "{\n  \"workload\": {\n"
+        << "    \"files\": " << workload.m_files << ",\n"
+        << "    \"bytes\": " << workload.m_bytes << ",\n"
+        << "    \"size\": " << jsonString(config.m_size) << ",\n"
+        << "    \"depth\": " << config.m_depth << ",\n"
+        << "    \"fanout\": " << config.m_fanout << ",\n"
+        << "    \"source_dir\": " << jsonString(config.m_srcDir) << ",\n"
+        << "    \"destination_dir\": " << jsonString(config.m_dstDir) << ",\n"
+        << "    \"cross_device\": " << (workload.m_crossDevice ? "true" : "false") << ",\n"
+        << "    \"durability\": \"" << durabilityName(config.m_durability) << "\",\n"
+        << "    \"verify\": \"" << verifyName(config.m_verify) << "\",\n"
+        << "    \"log\": " << jsonString(config.m_log) << "\n"
+        << "  },\n  \"results\": [";
+    for (size_t i = 0; i < measurements.size(); ++i) {
+        const auto& m = measurements[i];
+        double seconds = std::max(m.m_seconds, 1e-9);
+        out << (i == 0 ? "\n" : ",\n") << "    {\n"
+            << "      \"strategy\": " << jsonString(m.m_strategy) << ",\n"
+            << "      \"seconds\": " << m.m_seconds << ",\n"
+            << "      \"files_moved\": " << m.m_moved << ",\n"
+            << "      \"files_left\": " << m.m_left << ",\n"
+            << "      \"files_per_second\": " << static_cast<double>(m.m_moved) / seconds << ",\n"
+            << "      \"mb_per_second\": " << static_cast<double>(m.m_bytesMoved) / seconds / 1e6 << ",\n"
+            << "      \"syscalls_per_file\": ";
+        if (m.m_syscallsPerFile < 0) {
+            out << "null";
+        } else {
+            out << m.m_syscallsPerFile;
+        }
+        out << ",\n      \"log_dropped\": " << m.m_logDropped;
+        out << ",\n      \"latency_p50_us\": ";
+        if (m.m_latencies.empty()) {
+            out << "null,\n      \"latency_p99_us\": null\n";
+        } else {
+            out << percentile(m.m_latencies, 0.5) << ",\n"
+                << "      \"latency_p99_us\": " << percentile(m.m_latencies, 0.99) << "\n";
+        }
+        out << "    }";
+    }
+    out << "\n  ]\n}\n";
+    std::cout << out.str();
+}
+
+std::vector<std::string> split(const std::string& value, char separator)
+{
+    std::vector<std::string> parts;
+    std::istringstream in(value);
+    std::string part;
+    while (std::getline(in, part, separator)) {
+        if (!part.empty()) {
+            parts.push_back(part);
+        }
+    }
+    return parts;
+}
+
+Config parseArguments(int argc, char** argv)
+{
+    Config config;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto eq = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos) {
+            throw std::invalid_argument("expected --key=value: " + arg);
+        }
+        auto key = arg.substr(2, eq - 2);
+        auto value = arg.substr(eq + 1);
+        if (key == "files") {
+            config.m_files = std::stoull(value);
+        } else if (key == "size") {
+            config.m_size = value;
+        } else if (key == "depth") {
+            config.m_depth = static_cast<unsigned>(std::stoul(value));
+        } else if (key == "fanout") {
+            config.m_fanout = static_cast<unsigned>(std::stoul(value));
+        } else if (key == "src-dir") {
+            config.m_srcDir = value;
+        } else if (key == "dst-dir") {
+            config.m_dstDir = value;
+        } else if (key == "strategies") {
+            config.m_strategies = split(value, ',');
+        } else if (key == "durability") {
+            config.m_durability = value == "batch" ? transfer::Durability::Batch :
+                value == "file" ? transfer::Durability::File : transfer::Durability::None;
+        } else if (key == "verify") {
+            config.m_verify = value == "checksum" ? transfer::Verify::Checksum :
+                value == "readback" ? transfer::Verify::ReadBack : transfer::Verify::None;
+        } else if (key == "queue-depth") {
+            config.m_queueDepth = static_cast<unsigned>(std::stoul(value));
+        } else if (key == "seed") {
+            config.m_seed = std::stoull(value);
+        } else if (key == "syscalls") {
+            config.m_syscalls = value != "0";
+        } else if (key == "log") {
+            if (value != "none" && value != "sync" && value != "async") {
+                throw std::invalid_argument("unknown log mode: " + value);
+            }
+            config.m_log = value;
+        } else if (key == "log-file") {
+            config.m_logFile = value;
+        } else {
+            throw std::invalid_argument("unknown option --" + key);
+        }
+    }
+    if (config.m_dstDir.empty()) {
+        config.m_dstDir = config.m_srcDir;
+    }
+    return config;
+}
+
+} // unnamed namespace
+
+int main(int argc, char** argv)
+{
+    try {
+        auto config = parseArguments(argc, argv);
+        if (config.m_log != "none") {
+            auto settings = logging::makeSettings(config.m_logFile, "info", "drop");
+            if (logging::Logger::instance().configure(settings) != 0) {
+                throw std::runtime_error("could not open " + config.m_logFile);
+            }
+            if (config.m_log == "async") {
+                logging::Logger::instance().start();
+            }
+        }
+        ///@brief Every strategy moves a fresh copy of the same workload
+        Workload workload;
+        std::vector<Measurement> measurements;
+        for (const auto& strategy : config.m_strategies) {
+            measurements.push_back(measure(config, strategy, workload));
+        }
+        printJson(config, workload, measurements);
+    } catch (const std::exception& e) {
+        std::cerr << "DaemonBench: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,112 @@
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "configuration.h"
+
+namespace {
+
+///@brief Keys which are not defaults of the jobs
+bool daemonKey(const std::string& key)
+{
+    return key == "threads" || key == "log" || key == "log_level" || key == "log_overflow" ||
+           key == "control_port" || key == "control_address";
+}
+
+std::string value(const Configuration::Values& values, const std::string& key)
+{
+    auto it = values.find(key);
+    return it != values.end() ? it->second : std::string();
+}
+
+} // unnamed namespace
+
+Configuration::Configuration() = default;
+
+std::shared_ptr<const Configuration> Configuration::parse(std::istream& in)
+{
+    std::shared_ptr<Configuration> configuration = std::make_shared<Configuration>();
+    std::string line;
+    for (unsigned number = 1; std::getline(in, line); ++number) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        auto pos = line.find('=');
+        if (pos == std::string::npos || pos == 0) {
+            throw std::invalid_argument("line " + std::to_string(number) + ": expected key=value");
+        }
+        configuration->m_values[line.substr(0, pos)] = line.substr(pos + 1);
+    }
+    configuration->m_jobs = parseJobs(configuration->m_values);
+    const auto& values = configuration->m_values;
+    configuration->m_logging = logging::makeSettings(value(values, "log"), value(values, "log_level"),
+                                                     value(values, "log_overflow"));
+    auto threads = value(values, "threads");
+    if (!threads.empty()) {
+        try {
+            configuration->m_threads = static_cast<unsigned>(std::max(std::stoi(threads), 1));
+        } catch (const std::exception&) {
+            throw std::invalid_argument("threads: " + threads);
+        }
+    }
+    auto port = value(values, "control_port");
+    if (!port.empty()) {
+        size_t end = 0;
+        unsigned long number = 0;
+        try {
+            number = std::stoul(port, &end);
+        } catch (const std::exception&) {
+            end = 0;
+        }
+        if (end != port.size() || number > 65535) {
+            throw std::invalid_argument("control_port: " + port);
+        }
+        configuration->m_controlPort = static_cast<unsigned short>(number);
+    }
+    auto address = value(values, "control_address");
+    if (!address.empty()) {
+        configuration->m_controlAddress = address;
+    }
+    return configuration;
+}
+
+std::shared_ptr<const Configuration> Configuration::load(const std::string& path)
+{
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("could not read " + path + ": " + strerror(errno));
+    }
+    return parse(in);
+}
+
+bool Configuration::partitioned() const noexcept
+{
+    for (const auto& job : m_jobs) {
+        if (job.m_partitions != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Configuration::sameJob(const Configuration& other, const std::string& name) const
+{
+    return jobKeys(name) == other.jobKeys(name);
+}
+
+Configuration::Values Configuration::jobKeys(const std::string& name) const
+{
+    Values keys;
+    auto prefix = "job." + name + ".";
+    for (const auto& item : m_values) {
+        bool job = item.first.compare(0, 4, "job.") == 0;
+        if ((!job && !daemonKey(item.first)) || item.first.compare(0, prefix.size(), prefix) == 0) {
+            keys.insert(item);
+        }
+    }
+    return keys;
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <istream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "job.h"
+#include "logging/logger.h"
+
+/**
+ * @class  Configuration
+ * @file   configuration.h
+ * @brief  Immutable snapshot of configuration.conf, parsed and validated as
+ *         a whole before anything uses it. The daemon publishes the current
+ *         snapshot through an atomic shared_ptr: a reload builds a new one
+ *         next to the old, transfers in flight finish with the jobs of the
+ *         old one and whoever holds a snapshot keeps it alive.
+ */
+class Configuration
+{
+public:
+    using Values = std::map<std::string, std::string>;
+
+    ///@brief Snapshot without jobs, what runs while no valid configuration was loaded
+    Configuration();
+
+    /**
+     * @brief Parse key=value lines, blank lines and lines starting with # are skipped
+     * @throw std::invalid_argument on a malformed line or value
+     */
+    static std::shared_ptr<const Configuration> parse(std::istream& in);
+
+    ///@throw std::invalid_argument on a malformed configuration, std::runtime_error if path cannot be read
+    static std::shared_ptr<const Configuration> load(const std::string& path);
+
+    const Values& values() const noexcept
+    {
+        return m_values;
+    }
+
+    const std::vector<JobConfig>& jobs() const noexcept
+    {
+        return m_jobs;
+    }
+
+    const logging::Settings& logging() const noexcept
+    {
+        return m_logging;
+    }
+
+    ///@brief Pool workers, read once at startup
+    unsigned threads() const noexcept
+    {
+        return m_threads;
+    }
+
+    ///@brief Port of the HTTP control API, 0 if it is off
+    unsigned short controlPort() const noexcept
+    {
+        return m_controlPort;
+    }
+
+    const std::string& controlAddress() const noexcept
+    {
+        return m_controlAddress;
+    }
+
+    ///@brief Whether a job shares its catalogue with other instances
+    bool partitioned() const noexcept;
+
+    ///@brief Whether job name reads the same keys in both snapshots, its running state can be kept then
+    bool sameJob(const Configuration& other, const std::string& name) const;
+
+private:
+    ///@brief Every key job name reads: its job.<name>.* keys and the defaults of all jobs
+    Values jobKeys(const std::string& name) const;
+
+private:
+    Values m_values;
+    std::vector<JobConfig> m_jobs;
+    logging::Settings m_logging;
+    unsigned m_threads = 4;
+    unsigned short m_controlPort = 0;
+    std::string m_controlAddress = "127.0.0.1";
+};
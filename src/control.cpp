@@ -0,0 +1,213 @@
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+#include "control.h"
+#include "logging/logger.h"
+
+namespace {
+
+using Response = std::shared_ptr<server::Response<server::HTTP> >;
+using Request = std::shared_ptr<server::Request<server::HTTP> >;
+
+std::string jsonString(const std::string& value)
+{
+    std::string out = "\"";
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+std::string json(const JobStatus& status)
+{
+    std::ostringstream out;
+    out << "{\"name\":" << jsonString(status.m_name)
+        << ",\"paused\":" << (status.m_paused ? "true" : "false")
+        << ",\"running\":" << status.m_running
+        << ",\"rescanning\":" << (status.m_rescanning ? "true" : "false")
+        << ",\"queued\":" << status.m_queued
+        << ",\"copies\":" << status.m_copies
+        << ",\"bytes_in_flight\":" << status.m_bytesInFlight
+        << ",\"bytes_copied\":" << status.m_bytesCopied
+        << ",\"moved\":" << status.m_moved
+        << ",\"failed\":" << status.m_failed
+        << ",\"cycles\":" << status.m_cycles
+        << ",\"last_cycle\":";
+    if (status.m_cycles == 0) {
+        out << "null";
+    } else {
+        auto start = std::chrono::duration_cast<std::chrono::milliseconds>(status.m_lastStart.time_since_epoch());
+        out << "{\"start_ms\":" << start.count()
+            << ",\"duration_ms\":" << status.m_lastDuration.count()
+            << ",\"moved\":" << status.m_lastMoved
+            << ",\"failed\":" << status.m_lastFailed << "}";
+    }
+    out << "}";
+    return out.str();
+}
+
+void reply(const Response& response, server::StatusCode code, const std::string& body)
+{
+    server::CaseInsensitiveMultimap header;
+    header.emplace("Content-Type", "application/json");
+    response->write(code, body + "\n", header);
+}
+
+void fail(const Response& response, server::StatusCode code, const std::string& message)
+{
+    reply(response, code, "{\"error\":" + jsonString(message) + "}");
+}
+
+///@brief Whether fd is a socket bound to address:port
+bool boundTo(int fd, const std::string& address, unsigned short port)
+{
+    boost::asio::ip::tcp::endpoint endpoint;
+    socklen_t length = static_cast<socklen_t>(endpoint.capacity());
+    if (getsockname(fd, endpoint.data(), &length) == -1) {
+        return false;
+    }
+    endpoint.resize(length);
+    server::error_code ec;
+    auto wanted = boost::asio::ip::address::from_string(address, ec);
+    return !ec && endpoint.address() == wanted && endpoint.port() == port;
+}
+
+} // unnamed namespace
+
+Control::Control(const std::string& address, unsigned short port, std::function<void()> wake, int listener)
+    : m_wake(std::move(wake))
+    , m_jobs(std::make_shared<Jobs>())
+{
+    m_server.m_config.m_address = address;
+    m_server.m_config.m_port = port;
+    route();
+    if (listener != -1 && !boundTo(listener, address, port)) {
+        close(listener);
+        listener = -1;
+    }
+    try {
+        if (listener != -1) {
+            m_server.assign(listener);
+        } else {
+            m_server.bind();
+        }
+    } catch (const std::exception& e) {
+        m_error = e.what();
+        return;
+    }
+    m_thread = std::thread([this] () {
+        try {
+            m_server.acceptAndRun();
+        } catch (const std::exception& e) {
+            DAEMON_LOG(LOG_ERR, "Control API stopped: %s", e.what());
+        }
+    });
+}
+
+Control::~Control()
+{
+    if (m_thread.joinable()) {
+        ///@brief The acceptor and the connections belong to the server thread, stop them there
+        m_server.m_ioService->post([this] () {
+            m_server.stop();
+        });
+        m_thread.join();
+    }
+}
+
+int Control::release()
+{
+    if (!m_thread.joinable()) {
+        return -1;
+    }
+    int fd = fcntl(m_server.nativeHandle(), F_DUPFD_CLOEXEC, 0);
+    m_server.m_ioService->post([this] () {
+        m_server.stopAccepting();
+    });
+    return fd;
+}
+
+void Control::publish(std::shared_ptr<const Jobs> jobs)
+{
+    std::atomic_store(&m_jobs, std::move(jobs));
+}
+
+std::shared_ptr<Job> Control::find(const std::string& name) const
+{
+    auto jobs = std::atomic_load(&m_jobs);
+    for (const auto& job : *jobs) {
+        if (job->config().m_name == name) {
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+void Control::route()
+{
+    m_server.m_resource["^/jobs$"]["GET"] = [this] (Response response, Request) {
+        auto jobs = std::atomic_load(&m_jobs);
+        std::string body = "[";
+        for (const auto& job : *jobs) {
+            body += (body.size() > 1 ? "," : "") + json(job->status());
+        }
+        reply(response, server::StatusCode::success_ok, body + "]");
+    };
+    m_server.m_resource["^/jobs/([^/]+)$"]["GET"] = [this] (Response response, Request request) {
+        auto name = server::Percent::decode(request->m_pathMatch[1]);
+        auto job = find(name);
+        if (!job) {
+            fail(response, server::StatusCode::client_error_not_found, "no job " + name);
+            return;
+        }
+        reply(response, server::StatusCode::success_ok, json(job->status()));
+    };
+    m_server.m_resource["^/jobs/([^/]+)/(run|pause|resume)$"]["POST"] = [this] (Response response, Request request) {
+        auto name = server::Percent::decode(request->m_pathMatch[1]);
+        auto job = find(name);
+        if (!job) {
+            fail(response, server::StatusCode::client_error_not_found, "no job " + name);
+            return;
+        }
+        std::string action = request->m_pathMatch[2];
+        if (action == "run") {
+            ///@brief A paused job keeps the request until it is resumed
+            job->trigger();
+        } else {
+            job->pause(action == "pause");
+        }
+        m_wake();
+        reply(response, server::StatusCode::success_accepted, json(job->status()));
+    };
+    m_server.m_resource["^/run$"]["POST"] = [this] (Response response, Request) {
+        auto jobs = std::atomic_load(&m_jobs);
+        for (const auto& job : *jobs) {
+            job->trigger();
+        }
+        m_wake();
+        reply(response, server::StatusCode::success_accepted, "{\"triggered\":" + std::to_string(jobs->size()) + "}");
+    };
+    auto unknown = [] (Response response, Request request) {
+        fail(response, server::StatusCode::client_error_not_found, "no resource " + request->m_method + " " +
+             request->m_path);
+    };
+    m_server.m_defaultResource["GET"] = unknown;
+    m_server.m_defaultResource["POST"] = unknown;
+    m_server.m_onError = [] (Request, const server::error_code& ec) {
+        ///@brief Clients closing their connection end up here as well
+        DAEMON_LOG(LOG_DEBUG, "Control API: %s", ec.message().c_str());
+    };
+}
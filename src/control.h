@@ -0,0 +1,76 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "httpserver.h"
+#include "job.h"
+
+/**
+ * @class  Control
+ * @file   control.h
+ * @brief  HTTP control and status API of the daemon, served on a thread of
+ *         its own and answering JSON:
+ *           GET  /jobs                  status of every job
+ *           GET  /jobs/<name>           status of one job
+ *           POST /jobs/<name>/run       rescan the job now
+ *           POST /jobs/<name>/pause     post no more transfers of the job
+ *           POST /jobs/<name>/resume    undo pause
+ *           POST /run                   rescan every job now
+ *         Requests see the job table the daemon last published and only use
+ *         the thread safe members of Job, the dispatcher is woken to act.
+ *         There is no authentication, bind it to a loopback address.
+ */
+class Control
+{
+public:
+    using Jobs = std::vector<std::shared_ptr<Job> >;
+
+    /**
+     * @brief Listen on address:port, wake is called after a request changed a job.
+     * listener is a socket a previous instance listened on, taken over if it is
+     * bound to address:port and closed otherwise; -1 binds a new one.
+     */
+    Control(const std::string& address, unsigned short port, std::function<void()> wake, int listener = -1);
+    ~Control();
+
+    Control(const Control&) = delete;
+    Control& operator=(const Control&) = delete;
+
+    ///@brief false if the address could not be bound, see error()
+    bool valid() const noexcept
+    {
+        return m_error.empty();
+    }
+
+    const std::string& error() const noexcept
+    {
+        return m_error;
+    }
+
+    /**
+     * @brief Stop accepting and return a duplicate of the listening socket for the
+     * next instance, -1 if there is none. Connections keep queueing on it and
+     * the requests already read are answered.
+     */
+    int release();
+
+    ///@brief Replace the job table requests see; any thread
+    void publish(std::shared_ptr<const Jobs> jobs);
+
+private:
+    using Server = server::Server<server::HTTP>;
+
+    void route();
+    std::shared_ptr<Job> find(const std::string& name) const;
+
+private:
+    Server m_server;
+    std::function<void()> m_wake;
+    ///@brief Only replaced through std::atomic_store
+    std::shared_ptr<const Jobs> m_jobs;
+    std::string m_error;
+    std::thread m_thread;
+};
@@ -1,88 +1,422 @@
 #include <signal.h>
-#include <syslog.h>
-#include <fstream>
 #include <sys/types.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
 
 #include "daemon.h"
+#include "logging/logger.h"
 
-bool g_exit = false;
-std::string Daemon::m_cat1;
-std::string Daemon::m_cat2;
-std::map<std::string, std::string> Daemon::s_confMap;
+int Daemon::s_wakeFd = -1;
+const char* const Daemon::s_pidFile = "proc.pid";
 
 Daemon::Daemon(int argc, char** argv)
+    : m_pidFile(-1)
+    , m_configuration(std::make_shared<Configuration>())
 {
-    setlogmask(LOG_UPTO(LOG_INFO));
-    openlog(argv[0], LOG_CONS | LOG_PERROR, LOG_USER);
-    syslog(LOG_INFO, "Daemon is constructed");
+    openlog(argv[0], 0, LOG_USER);
+    DAEMON_LOG(LOG_INFO, "Daemon is constructed");
 }
 
 Daemon::~Daemon()
 {
-    syslog(LOG_INFO, "Programm is exiting");
-    close(m_pidFile);
-    system("rm -rf proc.pid");
+    m_control.reset();
+    ///@brief Let the transfers in flight finish before the catalogues are left alone
+    m_pool.reset();
+    DAEMON_LOG(LOG_INFO, "Programm is exiting");
+    if (s_wakeFd != -1) {
+        close(s_wakeFd);
+    }
+    if (m_signalFd != -1) {
+        close(m_signalFd);
+    }
+    if (m_handoffFd != -1) {
+        close(m_handoffFd);
+        unlink(handoff::s_path);
+    }
+    if (m_predecessor != -1) {
+        ///@brief Stopped before the predecessor finished, the pid file is still its own
+        close(m_predecessor);
+    } else if (m_pidFile != -1) {
+        ///@brief Removed while it is locked, an instance waiting for the lock finds it gone and creates its own
+        unlink(s_pidFile);
+    }
+    if (m_pidFile != -1) {
+        close(m_pidFile);
+    }
+    logging::Logger::instance().stop();
+}
+
+std::shared_ptr<const Configuration> Daemon::load()
+{
+    try {
+        return Configuration::load("configuration.conf");
+    } catch (const std::exception& e) {
+        DAEMON_LOG(LOG_ERR, "Invalid configuration, %s: %s",
+                   configuration()->jobs().empty() ? "no jobs to run" : "keeping the running jobs", e.what());
+    }
+    return nullptr;
+}
+
+void Daemon::reload()
+{
+    auto next = load();
+    if (!next) {
+        return;
+    }
+    auto previous = configuration();
+    apply(previous.get(), *next);
+    std::atomic_store(&m_configuration, next);
+}
+
+void Daemon::wake()
+{
+    if (s_wakeFd != -1) {
+        uint64_t one = 1;
+        (void)write(s_wakeFd, &one, sizeof(one));
+    }
 }
 
-void Daemon::sigtermActionHandler(int)
+void Daemon::apply(const Configuration* previous, const Configuration& next)
 {
-    syslog(LOG_INFO, "Daemonis is closeing");
-    g_exit = true;
+    int error = logging::Logger::instance().configure(next.logging());
+    if (error != 0) {
+        DAEMON_LOG(LOG_ERR, "Could not open log file %s: %s", next.logging().m_path.c_str(), strerror(error));
+    }
+    if (previous != nullptr && previous->threads() != next.threads()) {
+        DAEMON_LOG(LOG_WARNING, "threads changes from %u to %u at the next start", previous->threads(), next.threads());
+    }
+    bool moved = previous == nullptr || previous->controlPort() != next.controlPort() ||
+                 previous->controlAddress() != next.controlAddress();
+    if (moved || (!m_control && next.controlPort() != 0)) {
+        m_control.reset();
+        if (next.controlPort() != 0) {
+            m_control.reset(new Control(next.controlAddress(), next.controlPort(), &Daemon::wake, m_listener));
+            m_listener = -1;
+            if (!m_control->valid()) {
+                DAEMON_LOG(LOG_ERR, "Could not serve the control API on %s:%u: %s", next.controlAddress().c_str(),
+                           next.controlPort(), m_control->error().c_str());
+                m_control.reset();
+            } else {
+                DAEMON_LOG(LOG_INFO, "Control API on %s:%u", next.controlAddress().c_str(), next.controlPort());
+            }
+        }
+    }
+    if (m_listener != -1) {
+        close(m_listener);
+        m_listener = -1;
+    }
+    std::map<std::string, std::shared_ptr<Job> > running;
+    for (auto& job : m_jobs) {
+        running[job->config().m_name] = std::move(job);
+    }
+    ///@brief Transfers of the old jobs in flight keep their job alive until they finish
+    m_jobs.clear();
+    std::map<std::string, std::shared_ptr<transfer::Journal> > journals;
+    for (const auto& config : next.jobs()) {
+        ///@brief While the predecessor finishes its copies the journals are still its own
+        auto journal = m_predecessor == -1 ? openJournal(config, journals) : nullptr;
+        ///@brief An unchanged job keeps its watch, its pending files and its schedule
+        auto it = running.find(config.m_name);
+        if (previous != nullptr && it != running.end() && previous->sameJob(next, config.m_name)) {
+            m_jobs.push_back(std::move(it->second));
+            running.erase(it);
+            continue;
+        }
+        m_jobs.push_back(std::make_shared<Job>(config, journal));
+        if (it != running.end()) {
+            m_jobs.back()->follow(it->second);
+            m_jobs.back()->pause(it->second->status().m_paused);
+        }
+        m_jobs.back()->watch();
+        const auto& job = m_jobs.back()->config();
+        std::string destinations = job.m_destination;
+        for (size_t i = 1; i < job.m_destinations.size(); ++i) {
+            destinations += ", " + job.m_destinations[i];
+        }
+        for (size_t i = 1; i < job.m_tiers.size(); ++i) {
+            destinations += " -> " + job.m_tiers[i].m_catalogue;
+        }
+        DAEMON_LOG(LOG_INFO, "Job %s: %s -> %s", job.m_name.c_str(), job.m_source.c_str(), destinations.c_str());
+    }
+    for (const auto& item : running) {
+        if (next.jobs().end() == std::find_if(next.jobs().begin(), next.jobs().end(), [&item] (const JobConfig& job) {
+                return job.m_name == item.first;
+            })) {
+            DAEMON_LOG(LOG_INFO, "Job %s: removed", item.first.c_str());
+        }
+    }
+    m_journals.swap(journals);
+    if (m_control) {
+        m_control->publish(std::make_shared<const Control::Jobs>(m_jobs));
+    }
+    if (m_jobs.empty()) {
+        DAEMON_LOG(LOG_WARNING, "No jobs configured");
+    }
 }
 
-void Daemon::readConfigFile(int)
+std::shared_ptr<transfer::Journal> Daemon::openJournal(const JobConfig& config,
+                                                       std::map<std::string, std::shared_ptr<transfer::Journal> >& journals)
 {
-    s_confMap["interval"] = "20"; // default value 20 second
-    std::ifstream infile("configuration.conf");
-    std::string line;
-    while (std::getline(infile, line)) {
-        auto pos = line.find('=');
-        s_confMap[line.substr(0, pos)] = line.substr(pos + 1, line.size() - pos);
+    ///@brief A partitioned job opens the journal of its slot itself
+    if (config.m_journal.empty() || config.m_partitions != 0) {
+        return nullptr;
+    }
+    auto it = m_journals.find(config.m_journal);
+    auto journal = it != m_journals.end() ? it->second : std::make_shared<transfer::Journal>(config.m_journal);
+    if (!journal->valid()) {
+        DAEMON_LOG(LOG_ERR, "Job %s: could not open journal %s: %s", config.m_name.c_str(), config.m_journal.c_str(),
+                   strerror(journal->error()));
+        return nullptr;
     }
-    m_cat1 = s_confMap["catalogue1"];
-    m_cat2 = s_confMap["catalogue2"];
+    journals[config.m_journal] = journal;
+    return journal;
 }
 
 void Daemon::doAction()
 {
-    std::string command = std::string("mv ") + m_cat1 + std::string("/* ") +
-        m_cat2 + std::string(" > /dev/null 2>&1");
-    m_cat1.swap(m_cat2);
-    system(command.c_str());
+    for (const auto& job : m_jobs) {
+        job->run(nullptr);
+    }
 }
 
-void Daemon::setupHandlers()
+void Daemon::dispatch()
 {
-    struct sigaction hupAction;
-    hupAction.sa_handler = &Daemon::readConfigFile;
-    hupAction.sa_flags = SA_RESTART;
-    sigaction(SIGHUP, &hupAction, nullptr);
+    std::vector<pollfd> fds;
+    std::vector<Job*> watched;
+    while (!m_exit) {
+        fds.assign(1, pollfd{s_wakeFd, POLLIN, 0});
+        fds.push_back(pollfd{m_signalFd, POLLIN, 0});
+        fds.push_back(pollfd{m_handoffFd, POLLIN, 0});
+        fds.push_back(pollfd{m_predecessor, POLLIN, 0});
+        watched.clear();
+        auto deadline = Job::Clock::time_point::max();
+        for (const auto& job : m_jobs) {
+            if (m_predecessor == -1) {
+                deadline = std::min(deadline, job->deadline());
+            }
+            if (job->watchFd() != -1) {
+                fds.push_back(pollfd{job->watchFd(), POLLIN, 0});
+                watched.push_back(job.get());
+            }
+        }
+        int timeout = -1;
+        if (deadline != Job::Clock::time_point::max()) {
+            ///@brief A job with work due asks for time_point::min(), which must not overflow the subtraction
+            auto now = Job::Clock::now();
+            long long left = -1;
+            if (deadline > now) {
+                left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count();
+            }
+            ///@brief Round up so the deadline has passed when poll returns
+            timeout = static_cast<int>(std::max<long long>(0, std::min<long long>(left + 1, 60 * 60 * 1000)));
+        }
+        if (poll(fds.data(), fds.size(), timeout) == -1 && errno != EINTR) {
+            DAEMON_LOG(LOG_ERR, "poll failed: %s", strerror(errno));
+            return;
+        }
+        if (fds[0].revents & POLLIN) {
+            uint64_t count;
+            (void)read(s_wakeFd, &count, sizeof(count));
+        }
+        if (fds[1].revents & POLLIN) {
+            handleSignals();
+        }
+        if ((fds[2].revents & POLLIN) && !m_exit) {
+            m_successor = handoff::accept(m_handoffFd);
+            if (m_successor != -1) {
+                DAEMON_LOG(LOG_INFO, "A new instance takes over");
+                m_exit = true;
+            }
+        }
+        if (fds[3].revents & (POLLIN | POLLHUP | POLLERR)) {
+            takeOver();
+        }
+        for (size_t i = 4; i < fds.size(); ++i) {
+            if (fds[i].revents & POLLIN) {
+                watched[i - 4]->collect();
+            }
+        }
+        ///@brief Like a job following the one it replaced, nothing starts while the predecessor finishes its transfers
+        if (m_exit || m_predecessor != -1) {
+            continue;
+        }
+        auto now = Job::Clock::now();
+        for (const auto& job : m_jobs) {
+            job->dispatch(now, *m_pool, &Daemon::wake);
+        }
+    }
+}
 
-    struct sigaction termAction;
-    termAction.sa_handler = &Daemon::sigtermActionHandler;
-    termAction.sa_flags = SA_RESTART;
-    sigaction(SIGTERM, &termAction, nullptr);
+bool Daemon::setupHandlers()
+{
+    ///@brief Blocked before any thread starts, every thread inherits the mask and only the signalfd sees them
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGHUP);
+    sigaddset(&signals, SIGTERM);
+    if (sigprocmask(SIG_BLOCK, &signals, nullptr) == -1) {
+        DAEMON_LOG(LOG_ERR, "Could not block signals: %s", strerror(errno));
+        return false;
+    }
+    m_signalFd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (m_signalFd == -1) {
+        DAEMON_LOG(LOG_ERR, "Could not create signalfd: %s", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void Daemon::handleSignals()
+{
+    signalfd_siginfo info;
+    bool reloading = false;
+    while (read(m_signalFd, &info, sizeof(info)) == static_cast<ssize_t>(sizeof(info))) {
+        if (info.ssi_signo == SIGTERM) {
+            DAEMON_LOG(LOG_INFO, "Daemon is closing");
+            m_exit = true;
+        } else if (info.ssi_signo == SIGHUP) {
+            reloading = true;
+        }
+    }
+    ///@brief Several SIGHUPs in a row read the file once
+    if (reloading && !m_exit) {
+        DAEMON_LOG(LOG_INFO, "Reloading the configuration");
+        reload();
+    }
 }
 
 void Daemon::run()
 {
-    readConfigFile(0);
-    setupHandlers();
+    s_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (s_wakeFd == -1) {
+        DAEMON_LOG(LOG_ERR, "Could not create eventfd: %s", strerror(errno));
+        return;
+    }
+    ///@brief Parsed before the fork, the jobs open their catalogues, locks and watches in the daemon
+    auto initial = load();
+    if (initial) {
+        std::atomic_store(&m_configuration, initial);
+    }
+    if (!setupHandlers()) {
+        return;
+    }
     daemonize();
-    auto interval = std::stoi(s_confMap["interval"]);
-    while (!g_exit) {
-        sleep(interval);
-        doAction();
+    ///@brief Threads do not survive the fork, the flusher starts in the daemon
+    logging::Logger::instance().start();
+    handoff::State state;
+    if (m_predecessor != -1) {
+        int error = handoff::receive(m_predecessor, state);
+        if (error != 0) {
+            DAEMON_LOG(LOG_ERR, "The running instance did not hand over: %s", strerror(error));
+            close(m_predecessor);
+            m_predecessor = -1;
+            stopPredecessor();
+            lockPidFile();
+        } else {
+            DAEMON_LOG(LOG_INFO, "Serving in place of the running instance, which finishes its transfers");
+        }
+    }
+    while (true) {
+        m_pool.reset(new transfer::ThreadPool(configuration()->threads()));
+        m_listener = state.m_listener;
+        apply(nullptr, *configuration());
+        for (const auto& job : m_jobs) {
+            auto it = state.m_pending.find(job->config().m_name);
+            if (it != state.m_pending.end()) {
+                job->adopt(std::move(it->second));
+            }
+        }
+        state = handoff::State();
+        listenForSuccessor();
+        dispatch();
+        if (m_successor == -1 || handOver(state)) {
+            return;
+        }
+        m_exit = false;
+    }
+}
+
+bool Daemon::handOver(handoff::State& state)
+{
+    state.m_listener = m_control ? m_control->release() : -1;
+    for (const auto& job : m_jobs) {
+        ///@brief What inotify reported meanwhile joins the batch, the successor's first rescan finds the rest
+        job->collect();
+        auto pending = job->takePending();
+        if (!pending.empty()) {
+            state.m_pending[job->config().m_name] = std::move(pending);
+        }
+    }
+    ///@brief Sent before the drain, the successor answers control requests and collects events meanwhile
+    int error = handoff::send(m_successor, state);
+    if (error != 0) {
+        ///@brief Start over with what was handed, the pid file is still ours
+        DAEMON_LOG(LOG_ERR, "The new instance went away: %s, carrying on", strerror(error));
+        close(m_successor);
+        m_successor = -1;
+        return false;
+    }
+    if (state.m_listener != -1) {
+        close(state.m_listener);
+    }
+    DAEMON_LOG(LOG_INFO, "The new instance serves the control API, finishing the transfers in flight");
+    ///@brief Posted transfers finish here, none is cut short
+    m_pool.reset();
+    m_control.reset();
+    ///@brief Journals are closed and partitions given back before the successor opens them
+    m_jobs.clear();
+    m_journals.clear();
+    ///@brief The successor listens on the path already, it is not unlinked
+    close(m_handoffFd);
+    m_handoffFd = -1;
+    ///@brief Closing the file releases the lock the successor takes next, the file itself is its now
+    close(m_pidFile);
+    m_pidFile = -1;
+    ///@brief The connection closing tells the successor to start its transfers
+    close(m_successor);
+    m_successor = -1;
+    DAEMON_LOG(LOG_INFO, "Handed over to the new instance");
+    return true;
+}
+
+void Daemon::takeOver()
+{
+    close(m_predecessor);
+    m_predecessor = -1;
+    lockPidFile();
+    std::map<std::string, std::shared_ptr<transfer::Journal> > journals;
+    for (const auto& job : m_jobs) {
+        job->attach(openJournal(job->config(), journals));
+    }
+    m_journals.swap(journals);
+    listenForSuccessor();
+    DAEMON_LOG(LOG_INFO, "The previous instance finished its transfers, starting ours");
+}
+
+void Daemon::listenForSuccessor()
+{
+    if (m_pidFile == -1 || m_predecessor != -1 || m_handoffFd != -1) {
+        return;
+    }
+    m_handoffFd = handoff::listen();
+    if (m_handoffFd == -1) {
+        DAEMON_LOG(LOG_WARNING, "Could not listen on %s, a new instance will stop this one instead: %s",
+                   handoff::s_path, strerror(errno));
     }
 }
 
 void Daemon::daemonize()
 {
-    const char* pidfile = "proc.pid";
     if (getppid() == 1) {
         return;
     }
@@ -97,21 +431,67 @@ void Daemon::daemonize()
     if (sid < 0) {
         std::exit(-1);
     }
-    m_pidFile = open(pidfile, O_RDWR | O_CREAT, 0600);
+    ///@brief Instances sharing catalogues through partitions run side by side, none replaces another
+    if (configuration()->partitioned()) {
+        return;
+    }
+    m_pidFile = open(s_pidFile, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
     if (m_pidFile == -1) {
-        syslog(LOG_INFO, "Could not open PID lock file %s, exiting", pidfile);
+        DAEMON_LOG(LOG_INFO, "Could not open PID lock file %s, exiting", s_pidFile);
         std::exit(-1);
     }
-    char buff[10] = {};
     if (lockf(m_pidFile, F_TLOCK, 0) == -1) {
-        syslog(LOG_INFO, "Daemon is currently running swapping the process");
+        ///@brief The running instance hands over once its transfers finished, run() waits for it
+        m_predecessor = handoff::connect();
+        if (m_predecessor != -1) {
+            DAEMON_LOG(LOG_INFO, "Daemon is currently running, taking over from it");
+            return;
+        }
+        stopPredecessor();
+    }
+    lockPidFile();
+}
+
+void Daemon::lockPidFile()
+{
+    while (true) {
+        ///@brief Blocks until the predecessor let go of it
+        while (lockf(m_pidFile, F_LOCK, 0) == -1 && errno == EINTR) {
+        }
+        struct stat locked;
+        struct stat named;
+        if (fstat(m_pidFile, &locked) == 0 && stat(s_pidFile, &named) == 0 &&
+                locked.st_dev == named.st_dev && locked.st_ino == named.st_ino) {
+            break;
+        }
+        ///@brief The predecessor removed the file on its way out
+        close(m_pidFile);
+        m_pidFile = open(s_pidFile, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        if (m_pidFile == -1) {
+            DAEMON_LOG(LOG_ERR, "Could not open PID lock file %s: %s", s_pidFile, strerror(errno));
+            return;
+        }
+    }
+    std::string pid = std::to_string(getpid());
+    ///@brief The pid of the predecessor may have more digits
+    if (ftruncate(m_pidFile, 0) == -1 ||
+            pwrite(m_pidFile, pid.c_str(), pid.size(), 0) != static_cast<ssize_t>(pid.size())) {
+        DAEMON_LOG(LOG_WARNING, "Could not write the PID file: %s", strerror(errno));
+    }
+}
+
+void Daemon::stopPredecessor()
+{
+    ///@brief The holder of the lock, the content of the file may be stale
+    struct flock holder;
+    memset(&holder, 0, sizeof(holder));
+    holder.l_type = F_WRLCK;
+    holder.l_whence = SEEK_SET;
+    if (fcntl(m_pidFile, F_GETLK, &holder) == -1 || holder.l_type == F_UNLCK) {
+        return;
     }
-    read(m_pidFile, buff, 10);
-    struct stat sts;
-    if (stat(std::string(std::string("/proc/") + std::string(buff)).c_str(), &sts) != -1) {
-        system(std::string(std::string("kill -9 ") + std::string(buff) + std::string(" > /dev/null 2>&1")).c_str());
-        lseek(m_pidFile, 0, SEEK_DATA);
+    if (kill(holder.l_pid, SIGTERM) == 0) {
+        DAEMON_LOG(LOG_INFO, "Daemon %d is currently running without handoff, stopping it",
+                   static_cast<int>(holder.l_pid));
     }
-    std::string str = std::to_string(getpid());
-    write(m_pidFile, str.c_str(), str.size());
 }
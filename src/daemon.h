@@ -1,5 +1,14 @@
 #pragma once
 #include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "configuration.h"
+#include "control.h"
+#include "handoff.h"
+#include "job.h"
+#include "transfer/threadpool.h"
 
 /**
  * @class  Daemon
@@ -16,16 +25,10 @@ public:
     //!@brief destructor
     ~Daemon();
 
-    //!@brief function to handle SIGTERM signals
-    static void sigtermActionHandler(int);
-
-    //!@brief function to handle SIGTERM signals
-    static void readConfigFile(int);
-
     void doAction();
 
-    //!@brief set signal handlers
-    void setupHandlers();
+    //!@brief block SIGHUP and SIGTERM and open the signalfd dispatch() reads them from
+    bool setupHandlers();
 
     //!@brief daemonize the object
     void daemonize();
@@ -33,10 +36,70 @@ public:
     //!@brief function designed to run the daemon
     void run();
 
+    //!@brief the configuration in effect, from any thread; a reload replaces it, it does not change
+    std::shared_ptr<const Configuration> configuration() const
+    {
+        return std::atomic_load(&m_configuration);
+    }
+
+private:
+    //!@brief parse and validate configuration.conf, nullptr if it is malformed
+    std::shared_ptr<const Configuration> load();
+
+    //!@brief load the configuration and publish it, keeps the current one if it is malformed
+    void reload();
+
+    //!@brief switch logging and the job table to next; unchanged jobs are kept, changed ones replaced
+    void apply(const Configuration* previous, const Configuration& next);
+
+    //!@brief act on the signals the signalfd queued: SIGHUP reloads, SIGTERM ends dispatch()
+    void handleSignals();
+
+    //!@brief wait for inotify events, job deadlines or a wake-up and hand the due work to the pool
+    void dispatch();
+
+    //!@brief wait for the pid lock, then write our pid into the file
+    void lockPidFile();
+
+    //!@brief ask the instance holding the pid lock to exit, for one which does not hand over
+    void stopPredecessor();
+
+    //!@brief send state, filled here, to the successor, then drain the transfers; false if it went away
+    bool handOver(handoff::State& state);
+
+    //!@brief the predecessor finished its transfers: take the pid lock and the journals and start ours
+    void takeOver();
+
+    //!@brief listen on handoff::s_path once this instance holds the pid lock
+    void listenForSuccessor();
+
+    //!@brief the journal of config, shared by path with the running jobs and recorded in journals; nullptr if none
+    std::shared_ptr<transfer::Journal> openJournal(const JobConfig& config,
+                                                   std::map<std::string, std::shared_ptr<transfer::Journal> >& journals);
+
+    //!@brief called by the pool workers to interrupt dispatch()
+    static void wake();
+
 private:
     int m_pidFile;
-    static std::string m_cat1;
-    static std::string m_cat2;
-    static std::map<std::string, std::string> s_confMap;
+    std::vector<std::shared_ptr<Job> > m_jobs;
+    ///@brief Journals by path, kept across reloads so two jobs never write one file
+    std::map<std::string, std::shared_ptr<transfer::Journal> > m_journals;
+    std::unique_ptr<transfer::ThreadPool> m_pool;
+    ///@brief nullptr unless control_port is set
+    std::unique_ptr<Control> m_control;
+    int m_signalFd = -1;
+    bool m_exit = false;
+    ///@brief Socket a successor connects to, -1 unless this instance owns the pid file
+    int m_handoffFd = -1;
+    ///@brief Connection to the instance this one replaces, until it finished its transfers and closed it
+    int m_predecessor = -1;
+    ///@brief Connection of the instance replacing this one, dispatch() ends once it is set
+    int m_successor = -1;
+    ///@brief Control API socket handed over by the predecessor, taken by the next apply()
+    int m_listener = -1;
+    ///@brief Only replaced through std::atomic_store, read through configuration()
+    std::shared_ptr<const Configuration> m_configuration;
+    static int s_wakeFd;
+    static const char* const s_pidFile;
 };
-
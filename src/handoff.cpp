@@ -0,0 +1,270 @@
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+#include "handoff.h"
+
+namespace handoff {
+
+namespace {
+
+///@brief "DHO1": a message of this version of the protocol
+const uint32_t s_magic = 0x44484f31;
+
+///@brief Leading every state: magic and the size of the payload following it
+struct Header
+{
+    uint32_t m_magic;
+    ///@brief Descriptors passed along, 1 with a listening socket
+    uint32_t m_fds;
+    uint64_t m_size;
+};
+
+sockaddr_un address()
+{
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, s_path, sizeof(address.sun_path) - 1);
+    return address;
+}
+
+void put(std::string& out, uint32_t value)
+{
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void put(std::string& out, const std::string& value)
+{
+    put(out, static_cast<uint32_t>(value.size()));
+    out.append(value);
+}
+
+///@brief Reads the payload back, every get fails once the payload ran out
+class Reader
+{
+public:
+    explicit Reader(const std::string& in)
+        : m_in(in)
+    {
+    }
+
+    bool get(uint32_t& value)
+    {
+        if (m_in.size() - m_offset < sizeof(value)) {
+            return false;
+        }
+        memcpy(&value, m_in.data() + m_offset, sizeof(value));
+        m_offset += sizeof(value);
+        return true;
+    }
+
+    bool get(std::string& value)
+    {
+        uint32_t size = 0;
+        if (!get(size) || m_in.size() - m_offset < size) {
+            return false;
+        }
+        value.assign(m_in, m_offset, size);
+        m_offset += size;
+        return true;
+    }
+
+private:
+    const std::string& m_in;
+    size_t m_offset = 0;
+};
+
+int writeAll(int fd, const char* data, size_t size)
+{
+    while (size > 0) {
+        auto written = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (written == -1 && errno == EINTR) {
+            continue;
+        }
+        if (written == -1) {
+            return errno;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return 0;
+}
+
+int readAll(int fd, char* data, size_t size)
+{
+    while (size > 0) {
+        auto count = ::read(fd, data, size);
+        if (count == -1 && errno == EINTR) {
+            continue;
+        }
+        if (count == -1) {
+            return errno;
+        }
+        if (count == 0) {
+            return EPROTO;
+        }
+        data += count;
+        size -= static_cast<size_t>(count);
+    }
+    return 0;
+}
+
+} // unnamed namespace
+
+const char* const s_path = "proc.sock";
+
+int listen()
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    ///@brief A socket left behind by a crashed instance has nobody listening on it
+    unlink(s_path);
+    auto local = address();
+    if (bind(fd, reinterpret_cast<const sockaddr*>(&local), sizeof(local)) == -1 || ::listen(fd, 4) == -1) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
+
+int accept(int listener)
+{
+    return accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+}
+
+int connect()
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    auto remote = address();
+    if (::connect(fd, reinterpret_cast<const sockaddr*>(&remote), sizeof(remote)) == -1) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
+
+int send(int fd, const State& state)
+{
+    std::string payload;
+    put(payload, static_cast<uint32_t>(state.m_pending.size()));
+    for (const auto& job : state.m_pending) {
+        put(payload, job.first);
+        put(payload, static_cast<uint32_t>(job.second.size()));
+        for (const auto& entry : job.second) {
+            put(payload, static_cast<uint32_t>(entry.m_type));
+            put(payload, entry.m_name);
+        }
+    }
+    Header header{ s_magic, state.m_listener != -1 ? 1u : 0u, payload.size() };
+    iovec vector{ &header, sizeof(header) };
+    msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    ///@brief The descriptor travels with the header, the payload follows as plain bytes
+    union {
+        char m_buffer[CMSG_SPACE(sizeof(int))];
+        cmsghdr m_align;
+    } control;
+    if (state.m_listener != -1) {
+        message.msg_control = control.m_buffer;
+        message.msg_controllen = sizeof(control.m_buffer);
+        auto* cmsg = CMSG_FIRSTHDR(&message);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &state.m_listener, sizeof(int));
+    }
+    ssize_t sent;
+    do {
+        sent = sendmsg(fd, &message, MSG_NOSIGNAL);
+    } while (sent == -1 && errno == EINTR);
+    if (sent == -1) {
+        return errno;
+    }
+    int error = writeAll(fd, reinterpret_cast<const char*>(&header) + sent, sizeof(header) - static_cast<size_t>(sent));
+    return error != 0 ? error : writeAll(fd, payload.data(), payload.size());
+}
+
+int receive(int fd, State& state)
+{
+    Header header;
+    iovec vector{ &header, sizeof(header) };
+    msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    union {
+        char m_buffer[CMSG_SPACE(sizeof(int))];
+        cmsghdr m_align;
+    } control;
+    message.msg_control = control.m_buffer;
+    message.msg_controllen = sizeof(control.m_buffer);
+    ssize_t received;
+    do {
+        received = recvmsg(fd, &message, MSG_CMSG_CLOEXEC);
+    } while (received == -1 && errno == EINTR);
+    if (received == -1) {
+        return errno;
+    }
+    if (received == 0) {
+        return EPROTO;
+    }
+    for (auto* cmsg = CMSG_FIRSTHDR(&message); cmsg != nullptr; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            memcpy(&state.m_listener, CMSG_DATA(cmsg), sizeof(int));
+        }
+    }
+    int error = readAll(fd, reinterpret_cast<char*>(&header) + received, sizeof(header) - static_cast<size_t>(received));
+    if (error == 0 && (header.m_magic != s_magic || header.m_fds != (state.m_listener != -1 ? 1u : 0u))) {
+        error = EPROTO;
+    }
+    std::string payload;
+    if (error == 0) {
+        payload.resize(header.m_size);
+        error = readAll(fd, &payload[0], payload.size());
+    }
+    uint32_t jobs = 0;
+    Reader reader(payload);
+    if (error == 0 && !reader.get(jobs)) {
+        error = EPROTO;
+    }
+    for (uint32_t i = 0; error == 0 && i < jobs; ++i) {
+        std::string name;
+        uint32_t count = 0;
+        if (!reader.get(name) || !reader.get(count)) {
+            error = EPROTO;
+            break;
+        }
+        auto& entries = state.m_pending[name];
+        for (uint32_t j = 0; j < count; ++j) {
+            transfer::Entry entry;
+            uint32_t type = 0;
+            if (!reader.get(type) || !reader.get(entry.m_name)) {
+                error = EPROTO;
+                break;
+            }
+            entry.m_type = static_cast<unsigned char>(type);
+            entries.push_back(std::move(entry));
+        }
+    }
+    if (error != 0 && state.m_listener != -1) {
+        close(state.m_listener);
+        state.m_listener = -1;
+    }
+    return error;
+}
+
+} // namespace handoff
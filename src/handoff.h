@@ -0,0 +1,55 @@
+#pragma once
+#include <map>
+#include <string>
+#include <vector>
+
+#include "transfer/scanner.h"
+
+/**
+ * @file   handoff.h
+ * @brief  Hands a running daemon over to the instance replacing it. The
+ *         running daemon listens on the Unix socket s_path next to proc.pid.
+ *         A new instance connects instead of killing it; the running one
+ *         stops posting transfers and accepting control requests and sends
+ *         its State at once, so the successor answers control requests and
+ *         collects inotify events while the transfers in flight finish. The
+ *         predecessor then closes its journals, lets go of the pid lock and
+ *         closes the connection; only then does the successor take the lock
+ *         and the journals and start transferring, like a job which follows
+ *         the one it replaced at a reload. No transfer is cut short and no
+ *         control request is refused, but no transfer starts during the drain.
+ */
+namespace handoff {
+
+///@brief What a daemon hands to its successor
+struct State
+{
+    ///@brief Listening socket of the control API, -1 if there is none; passed with SCM_RIGHTS
+    int m_listener = -1;
+    ///@brief Entries of the inotify batches which were not posted yet, by job name
+    std::map<std::string, std::vector<transfer::Entry> > m_pending;
+};
+
+///@brief Socket the running daemon waits for its successor on, relative to the working directory
+extern const char* const s_path;
+
+///@brief Listen for a successor on s_path, non-blocking; -1 with errno set on failure
+int listen();
+
+///@brief Accept the successor connecting to listener, -1 if it went away meanwhile
+int accept(int listener);
+
+///@brief Connect to the running daemon, -1 with errno set if none listens
+int connect();
+
+///@brief Send state to the successor on fd; 0 or the errno of the failed call
+int send(int fd, const State& state);
+
+/**
+ * @brief Wait for the state of the predecessor on fd, sent as soon as it stopped posting transfers;
+ * fd closes once its transfers finished
+ * @return 0, the errno of the failed call or EPROTO if the predecessor closed fd without a valid state
+ */
+int receive(int fd, State& state);
+
+} // namespace handoff
@@ -83,7 +83,7 @@ protected:
     asio::ssl::context m_context;
 
 private:
-        bool m_setSessionIdContext;
+        bool m_setSessionIdContext = false;
 };
 
 } // namespace server
@@ -0,0 +1,1060 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <utility>
+#include <stdexcept>
+
+#include "job.h"
+#include "logging/logger.h"
+#include "transfer/compressor.h"
+#include "transfer/fanout.h"
+#include "transfer/mover.h"
+#include "transfer/uringmover.h"
+#include "transfer/walker.h"
+
+namespace {
+
+///@brief Counts the results of a transfer cycle and logs the ones which did not succeed
+class CycleReport
+{
+public:
+    ///@brief moved and failed are the totals of the job, counted along
+    CycleReport(const std::string& job, std::atomic<uint64_t>& moved, std::atomic<uint64_t>& failed)
+        : m_job(job)
+        , m_totalMoved(moved)
+        , m_totalFailed(failed)
+    {
+    }
+
+    void operator()(const transfer::Result& result)
+    {
+        if (result.m_status == transfer::Status::Renamed) {
+            DAEMON_LOG(LOG_DEBUG, "%s: renamed %s", m_job.c_str(), result.m_name.c_str());
+            ++m_moved;
+            ++m_totalMoved;
+            return;
+        }
+        if (result.m_status == transfer::Status::Copied) {
+            DAEMON_LOG(LOG_DEBUG, "%s: copied %s using %s", m_job.c_str(), result.m_name.c_str(),
+                       transfer::strategyName(result.m_strategy));
+            ++m_moved;
+            ++m_totalMoved;
+            return;
+        }
+        ///@brief A missing entry was already moved away
+        if (result.m_error == ENOENT) {
+            return;
+        }
+        ++m_failed;
+        ++m_totalFailed;
+        DAEMON_LOG(LOG_WARNING, "%s: %s %s: %s", m_job.c_str(), transfer::statusName(result.m_status),
+                   result.m_name.c_str(), strerror(result.m_error));
+    }
+
+    ~CycleReport()
+    {
+        if (m_moved != 0 || m_failed != 0) {
+            DAEMON_LOG(LOG_INFO, "%s: transfer cycle: %zu moved, %zu not moved", m_job.c_str(), m_moved, m_failed);
+        }
+    }
+
+private:
+    const std::string& m_job;
+    std::atomic<uint64_t>& m_totalMoved;
+    std::atomic<uint64_t>& m_totalFailed;
+    size_t m_moved = 0;
+    size_t m_failed = 0;
+};
+
+class JobKeys
+{
+public:
+    JobKeys(const std::map<std::string, std::string>& conf, const std::string& job)
+        : m_conf(conf)
+        , m_prefix("job." + job + ".")
+    {
+    }
+
+    ///@brief Value of job.<name>.key, falling back to the global key and then to fallback
+    std::string get(const std::string& key, const std::string& fallback = std::string()) const
+    {
+        auto it = m_conf.find(m_prefix + key);
+        if (it == m_conf.end() || it->second.empty()) {
+            it = m_conf.find(key);
+        }
+        return it == m_conf.end() || it->second.empty() ? fallback : it->second;
+    }
+
+    unsigned long long number(const std::string& key, unsigned long long fallback) const
+    {
+        auto value = get(key);
+        if (value.empty()) {
+            return fallback;
+        }
+        size_t end = 0;
+        auto result = std::stoull(value, &end);
+        if (end != value.size()) {
+            throw std::invalid_argument(m_prefix + key + ": " + value);
+        }
+        return result;
+    }
+
+    ///@brief Like number(), for keys which may be negative
+    long long integer(const std::string& key, long long fallback) const
+    {
+        auto value = get(key);
+        if (value.empty()) {
+            return fallback;
+        }
+        size_t end = 0;
+        auto result = std::stoll(value, &end);
+        if (end != value.size()) {
+            throw std::invalid_argument(m_prefix + key + ": " + value);
+        }
+        return result;
+    }
+
+private:
+    const std::map<std::string, std::string>& m_conf;
+    std::string m_prefix;
+};
+
+///@brief One mover of type M from source into each of destinations, args follow the destination
+template <typename M, typename... Args>
+std::vector<std::unique_ptr<M> > makeMovers(const std::string& source, const std::vector<std::string>& destinations,
+                                            const Args&... args)
+{
+    std::vector<std::unique_ptr<M> > movers;
+    for (const auto& destination : destinations) {
+        movers.emplace_back(new M(source, destination, args...));
+    }
+    return movers;
+}
+
+///@brief Comma separated list, blanks around the items are dropped
+std::vector<std::string> split(const std::string& value)
+{
+    std::vector<std::string> items;
+    size_t begin = 0;
+    while (begin <= value.size()) {
+        auto end = std::min(value.find(',', begin), value.size());
+        auto first = value.find_first_not_of(" \t", begin);
+        if (first < end) {
+            auto last = value.find_last_not_of(" \t", end - 1);
+            items.push_back(value.substr(first, last + 1 - first));
+        }
+        begin = end + 1;
+    }
+    return items;
+}
+
+JobConfig makeJob(const std::map<std::string, std::string>& conf, const std::string& name)
+{
+    JobKeys keys(conf, name);
+    JobConfig job;
+    job.m_name = name;
+    job.m_source = keys.get("source");
+    auto destinations = split(keys.get("destination"));
+    if (!destinations.empty()) {
+        job.m_destination = destinations.front();
+    }
+    if (destinations.size() > 1) {
+        job.m_destinations = std::move(destinations);
+    }
+    auto placement = keys.get("placement", "balanced");
+    if (placement == "hash") {
+        job.m_spread = transfer::Spread::Hash;
+    } else if (placement != "balanced") {
+        throw std::invalid_argument("job." + name + ".placement: " + placement);
+    }
+    job.m_minFree = keys.number("min_free_mb", 1024) << 20;
+    auto trigger = keys.get("trigger", "interval");
+    if (trigger == "inotify") {
+        job.m_trigger = Trigger::Inotify;
+    } else if (trigger != "interval") {
+        throw std::invalid_argument("job." + name + ".trigger: " + trigger);
+    }
+    job.m_interval = std::chrono::seconds(keys.number("interval", 20));
+    job.m_recursive = keys.get("recursive") == "1";
+    job.m_walkWorkers = static_cast<unsigned>(std::max(1ull, keys.number("walk_workers", 4)));
+    for (const auto& item : split(keys.get("tiers"))) {
+        ///@brief <age in seconds>:<catalogue>, older tiers later
+        auto colon = item.find(':');
+        size_t end = 0;
+        unsigned long long age = 0;
+        try {
+            age = std::stoull(item.substr(0, colon), &end);
+        } catch (const std::exception&) {
+            end = std::string::npos;
+        }
+        if (colon == std::string::npos || end != colon || colon + 1 == item.size() || age == 0 ||
+            (!job.m_tiers.empty() && std::chrono::seconds(age) <= job.m_tiers.back().m_age)) {
+            throw std::invalid_argument("job." + name + ".tiers: " + item);
+        }
+        transfer::Tier tier;
+        tier.m_catalogue = item.substr(colon + 1);
+        tier.m_age = std::chrono::seconds(age);
+        job.m_tiers.push_back(std::move(tier));
+    }
+    if (!job.m_tiers.empty()) {
+        if (!job.m_destination.empty() || job.m_trigger != Trigger::Interval || job.m_recursive) {
+            throw std::invalid_argument("job." + name + ".tiers: a tiered job has no destination and is neither "
+                                        "inotify triggered nor recursive");
+        }
+        job.m_destination = job.m_tiers.front().m_catalogue;
+    }
+    auto ageClock = keys.get("tier_clock", "modified");
+    if (ageClock == "accessed") {
+        job.m_ageClock = transfer::AgeClock::Accessed;
+    } else if (ageClock != "modified") {
+        throw std::invalid_argument("job." + name + ".tier_clock: " + ageClock);
+    }
+    job.m_batchWindow = std::chrono::milliseconds(keys.number("batch_window_ms", 20));
+    job.m_maxConcurrency = static_cast<unsigned>(std::max(1ull, keys.number("max_concurrency", 1)));
+    job.m_uring = keys.get("engine", "uring") != "sync";
+    job.m_queueDepth = static_cast<unsigned>(keys.number("queue_depth", 256));
+    ///@brief A copy stages two requests per file, a single slot could never take them
+    if (job.m_queueDepth < 2) {
+        throw std::invalid_argument("job." + name + ".queue_depth: " + std::to_string(job.m_queueDepth) +
+                                    " is below 2");
+    }
+    job.m_options.m_parallelThreshold = keys.number("parallel_threshold", job.m_options.m_parallelThreshold);
+    job.m_options.m_parallelWorkers = static_cast<unsigned>(keys.number("parallel_workers", job.m_options.m_parallelWorkers));
+    job.m_options.m_includeHidden = keys.get("include_hidden") == "1";
+    job.m_options.m_checkpointInterval = keys.number("checkpoint_mb", 64) << 20;
+    auto durability = keys.get("durability", "none");
+    if (durability == "batch") {
+        job.m_options.m_durability = transfer::Durability::Batch;
+    } else if (durability == "file") {
+        job.m_options.m_durability = transfer::Durability::File;
+    } else if (durability != "none") {
+        throw std::invalid_argument("job." + name + ".durability: " + durability);
+    }
+    job.m_options.m_syncBatchFiles = static_cast<unsigned>(std::max(1ull, keys.number("sync_batch_files", 1024)));
+    job.m_options.m_syncBatchLatency = static_cast<unsigned>(keys.number("sync_batch_ms", 1000));
+    job.m_maxBytesPerSecond = keys.number("max_mb_per_second", 0) << 20;
+    job.m_maxOpsPerSecond = keys.number("max_ops_per_second", 0);
+    job.m_backoffQueueDepth = static_cast<unsigned>(keys.number("backoff_queue_depth", 0));
+    job.m_settleTime = std::chrono::milliseconds(keys.number("settle_ms", 1000));
+    transfer::FilterRules rules;
+    rules.m_include = split(keys.get("include"));
+    rules.m_exclude = split(keys.get("exclude"));
+    rules.m_minSize = keys.number("min_size", 0);
+    rules.m_maxSize = keys.number("max_size", 0);
+    rules.m_minAge = std::chrono::seconds(keys.number("min_age", 0));
+    rules.m_maxAge = std::chrono::seconds(keys.number("max_age", 0));
+    try {
+        auto filter = std::make_shared<const transfer::Filter>(rules);
+        if (!filter->empty()) {
+            job.m_filter = std::move(filter);
+        }
+    } catch (const std::invalid_argument& e) {
+        throw std::invalid_argument("job." + name + ": " + e.what());
+    }
+    auto schedule = keys.get("schedule", "fifo");
+    if (schedule == "smallest") {
+        job.m_schedule = transfer::Schedule::Smallest;
+    } else if (schedule == "oldest") {
+        job.m_schedule = transfer::Schedule::Oldest;
+    } else if (schedule == "fair") {
+        job.m_schedule = transfer::Schedule::Fair;
+    } else if (schedule != "fifo") {
+        throw std::invalid_argument("job." + name + ".schedule: " + schedule);
+    }
+    job.m_largeFileThreshold = keys.number("large_file_mb", 64) << 20;
+    job.m_partitions = static_cast<unsigned>(keys.number("partitions", 0));
+    job.m_partitionDirectory = keys.get("partition_dir", keys.get("journal_dir", "."));
+    if (keys.get("snapshot") == "1") {
+        job.m_snapshot = keys.get("journal_dir", ".") + "/" + name + ".index";
+    }
+    if (keys.get("journal", "1") == "1") {
+        job.m_journal = keys.get("journal_dir", ".") + "/" + name + ".journal";
+    }
+    auto verify = keys.get("verify", "none");
+    if (verify == "checksum") {
+        job.m_options.m_verify = transfer::Verify::Checksum;
+    } else if (verify == "readback") {
+        job.m_options.m_verify = transfer::Verify::ReadBack;
+    } else if (verify != "none") {
+        throw std::invalid_argument("job." + name + ".verify: " + verify);
+    }
+    auto compress = keys.get("compress", "none");
+    if (compress == "gzip") {
+        job.m_options.m_compression = transfer::Compression::Gzip;
+    } else if (compress == "zstd") {
+        job.m_options.m_compression = transfer::Compression::Zstd;
+    } else if (compress != "none") {
+        throw std::invalid_argument("job." + name + ".compress: " + compress);
+    }
+    if (!transfer::compressionAvailable(job.m_options.m_compression)) {
+        throw std::invalid_argument("job." + name + ".compress: " + compress + " is not built in");
+    }
+    auto level = keys.integer("compress_level", 0);
+    int lowest = 0;
+    int highest = 0;
+    transfer::compressionLevels(job.m_options.m_compression, lowest, highest);
+    if (job.m_options.m_compression != transfer::Compression::None && level != 0 &&
+        (level < lowest || level > highest)) {
+        throw std::invalid_argument("job." + name + ".compress_level: " + std::to_string(level) + " is not within " +
+                                    std::to_string(lowest) + ".." + std::to_string(highest));
+    }
+    job.m_options.m_compressionLevel = static_cast<int>(level);
+    job.m_options.m_compressionWorkers = static_cast<unsigned>(std::max(1ull, keys.number("compress_workers", 4)));
+    if (job.m_options.m_verify != transfer::Verify::None) {
+        job.m_manifest = keys.get("manifest", keys.get("journal_dir", ".") + "/" + name + ".manifest");
+    }
+    return job;
+}
+
+///@brief Everything which decides the entries a rescan of the source turns down, see Snapshot
+std::string snapshotIdentity(const JobConfig& config)
+{
+    std::string identity = config.m_source + (config.m_options.m_includeHidden ? "\nhidden" : "");
+    if (config.m_filter) {
+        const auto& rules = config.m_filter->rules();
+        for (const auto& pattern : rules.m_include) {
+            identity += "\ninclude " + pattern;
+        }
+        for (const auto& pattern : rules.m_exclude) {
+            identity += "\nexclude " + pattern;
+        }
+        identity += "\nbounds " + std::to_string(rules.m_minSize) + " " + std::to_string(rules.m_maxSize) + " " +
+                    std::to_string(rules.m_minAge.count()) + " " + std::to_string(rules.m_maxAge.count());
+    }
+    return identity;
+}
+
+///@brief path with the slot before the extension of its file name, <job>.journal becomes <job>.<slot>.journal
+std::string slotPath(const std::string& path, unsigned slot)
+{
+    auto dot = path.rfind('.');
+    auto slash = path.rfind('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash) || dot == slash + 1) {
+        return path + "." + std::to_string(slot);
+    }
+    return path.substr(0, dot) + "." + std::to_string(slot) + path.substr(dot);
+}
+
+} // unnamed namespace
+
+std::vector<JobConfig> parseJobs(const std::map<std::string, std::string>& conf)
+{
+    std::vector<JobConfig> jobs;
+    auto legacy = conf.find("catalogue1");
+    if (legacy != conf.end() && !legacy->second.empty()) {
+        auto job = makeJob(conf, "default");
+        job.m_source = legacy->second;
+        auto destination = conf.find("catalogue2");
+        job.m_destination = destination == conf.end() ? std::string() : destination->second;
+        if (!job.m_tiers.empty()) {
+            throw std::invalid_argument("tiers: the default job is not tiered, declare a job.<name>.source");
+        }
+        job.m_swap = job.m_trigger == Trigger::Interval;
+        jobs.push_back(std::move(job));
+    }
+    std::set<std::string> names;
+    for (const auto& item : conf) {
+        if (item.first.compare(0, 4, "job.") != 0) {
+            continue;
+        }
+        auto end = item.first.find('.', 4);
+        if (end != std::string::npos && end > 4) {
+            names.insert(item.first.substr(4, end - 4));
+        }
+    }
+    for (const auto& name : names) {
+        auto job = makeJob(conf, name);
+        if (job.m_source.empty() || job.m_destination.empty()) {
+            throw std::invalid_argument("job." + name + " needs a source and a destination");
+        }
+        jobs.push_back(std::move(job));
+    }
+    return jobs;
+}
+
+Job::Job(JobConfig config, std::shared_ptr<transfer::Journal> journal)
+    : m_config(std::move(config))
+    , m_running(0)
+    , m_rescanning(false)
+    , m_paused(false)
+    , m_triggered(false)
+    , m_pool(nullptr)
+    , m_moved(0)
+    , m_failed(0)
+    , m_batched(0)
+{
+    auto now = Clock::now();
+    ///@brief Interval jobs wait one interval like the old polling loop, watched jobs start with a rescan
+    m_nextRescan = now + m_config.m_interval;
+    if (m_config.m_maxBytesPerSecond != 0 || m_config.m_maxOpsPerSecond != 0 || m_config.m_backoffQueueDepth != 0) {
+        m_throttle.reset(new transfer::Throttle(m_config.m_maxBytesPerSecond, m_config.m_maxOpsPerSecond,
+                                                m_config.m_backoffQueueDepth));
+        m_throttle->watch(m_config.m_source);
+        m_throttle->watch(m_config.m_destination);
+        for (size_t i = 1; i < m_config.m_destinations.size(); ++i) {
+            m_throttle->watch(m_config.m_destinations[i]);
+        }
+        for (size_t i = 1; i < m_config.m_tiers.size(); ++i) {
+            m_throttle->watch(m_config.m_tiers[i].m_catalogue);
+        }
+    }
+    if (m_config.m_partitions != 0) {
+        m_partitions.reset(new transfer::Partitions(m_config.m_partitionDirectory, m_config.m_name,
+                                                    m_config.m_partitions));
+        if (!m_partitions->valid()) {
+            DAEMON_LOG(LOG_ERR, "%s: could not join the instances in %s: %s, moving nothing",
+                       m_config.m_name.c_str(), m_config.m_partitionDirectory.c_str(), strerror(m_partitions->error()));
+        }
+    }
+    if (!m_config.m_destinations.empty()) {
+        m_placement.reset(new transfer::Placement(m_config.m_destinations, m_config.m_spread, m_config.m_minFree));
+    }
+    ///@brief Instances of a partitioned job share journal_dir, each keeps the files of its own slot
+    auto manifest = m_config.m_manifest;
+    if (m_partitions) {
+        journal = nullptr;
+        manifest = manifest.empty() ? manifest : slotPath(manifest, m_partitions->slot());
+        if (m_partitions->valid() && !m_config.m_journal.empty()) {
+            auto path = slotPath(m_config.m_journal, m_partitions->slot());
+            journal = std::make_shared<transfer::Journal>(path);
+            if (!journal->valid()) {
+                DAEMON_LOG(LOG_ERR, "%s: could not open journal %s: %s", m_config.m_name.c_str(), path.c_str(),
+                           strerror(journal->error()));
+                journal = nullptr;
+            }
+        }
+    }
+    if (!manifest.empty()) {
+        m_manifest.reset(new transfer::Manifest(manifest));
+        if (!m_manifest->valid()) {
+            DAEMON_LOG(LOG_ERR, "%s: could not open manifest %s: %s", m_config.m_name.c_str(),
+                       manifest.c_str(), strerror(m_manifest->error()));
+        }
+    }
+    if (!m_config.m_tiers.empty()) {
+        m_tiering.reset(new transfer::Tiering(m_config.m_tiers, m_config.m_ageClock));
+    } else if (m_config.m_settleTime.count() > 0) {
+        m_stability.reset(new transfer::Stability(m_config.m_settleTime));
+    }
+    if (!m_config.m_snapshot.empty() && !m_config.m_recursive && !m_config.m_swap && m_config.m_tiers.empty() &&
+        !m_partitions) {
+        m_snapshot.reset(new transfer::Snapshot(m_config.m_snapshot, snapshotIdentity(m_config)));
+    }
+    attach(std::move(journal));
+}
+
+void Job::attach(std::shared_ptr<transfer::Journal> journal)
+{
+    m_journal = std::move(journal);
+    if (m_journal) {
+        m_recovery = m_journal->takeUnfinished();
+        ///@brief Do not leave interrupted copies waiting for a whole interval
+        m_rescanDue = m_rescanDue || !m_recovery.empty();
+    }
+}
+
+void Job::watch()
+{
+    if (m_config.m_trigger != Trigger::Inotify) {
+        return;
+    }
+    m_watcher.reset(new transfer::Watcher(m_config.m_source, m_config.m_options.m_includeHidden));
+    if (!m_watcher->valid()) {
+        DAEMON_LOG(LOG_ERR, "%s: could not watch %s: %s, falling back to polling", m_config.m_name.c_str(),
+                   m_config.m_source.c_str(), strerror(m_watcher->error()));
+        m_watcher.reset();
+        return;
+    }
+    ///@brief Pick up whatever arrived before the watch was set
+    m_rescanDue = true;
+}
+
+int Job::watchFd() const noexcept
+{
+    return m_watcher ? m_watcher->fd() : -1;
+}
+
+void Job::collect()
+{
+    if (!m_watcher) {
+        return;
+    }
+    bool hadPending = !m_pending.m_entries.empty();
+    if (!m_watcher->collect(m_pending)) {
+        return;
+    }
+    if (m_config.m_recursive) {
+        ///@brief A new subdirectory is walked by a rescan, never renamed as a whole
+        auto& entries = m_pending.m_entries;
+        auto files = std::remove_if(entries.begin(), entries.end(), [] (const transfer::Entry& entry) {
+            return entry.m_type == DT_DIR;
+        });
+        m_rescanDue = m_rescanDue || files != entries.end();
+        entries.erase(files, entries.end());
+    }
+    if (m_pending.m_overflow) {
+        DAEMON_LOG(LOG_WARNING, "%s: inotify queue overflowed, rescanning %s", m_config.m_name.c_str(),
+                   m_config.m_source.c_str());
+        m_pending.clear();
+        m_rescanDue = true;
+    } else if (!hadPending && !m_pending.m_entries.empty()) {
+        m_pendingSince = Clock::now();
+    }
+    m_batched = m_pending.m_entries.size();
+}
+
+Job::Clock::time_point Job::deadline() const noexcept
+{
+    ///@brief The last transfer of the predecessor wakes the dispatcher when it finishes
+    if (waiting() || m_paused.load()) {
+        return Clock::time_point::max();
+    }
+    auto deadline = Clock::time_point::max();
+    if (m_config.m_interval.count() > 0 || !m_watcher) {
+        deadline = m_nextRescan;
+    }
+    ///@brief Work held back by the concurrency limit is picked up when a transfer finishes
+    bool slot = m_running.load() < m_config.m_maxConcurrency;
+    if ((m_rescanDue || m_triggered.load()) && slot && !m_rescanning.load()) {
+        return Clock::time_point::min();
+    }
+    if (!m_pending.m_entries.empty() && slot) {
+        deadline = std::min(deadline, m_pendingSince + m_config.m_batchWindow);
+    }
+    if (m_stability && slot && !m_rescanning.load()) {
+        deadline = std::min(deadline, m_stability->nextDue());
+    }
+    if (m_tiering && slot && !m_rescanning.load()) {
+        deadline = std::min(deadline, m_tiering->nextDue());
+    }
+    return deadline;
+}
+
+void Job::dispatch(Clock::time_point now, transfer::ThreadPool& pool, const std::function<void()>& onFinished)
+{
+    m_pool = &pool;
+    if (waiting() || m_paused.load()) {
+        return;
+    }
+    if (m_triggered.exchange(false)) {
+        m_rescanDue = true;
+    }
+    ///@brief Without a watcher the job polls, even if the interval says it is only a safety net
+    bool polling = m_config.m_interval.count() > 0 || !m_watcher;
+    if (polling && now >= m_nextRescan) {
+        m_rescanDue = true;
+        m_nextRescan = now + std::max(m_config.m_interval, std::chrono::seconds(1));
+    }
+    ///@brief A file reaching the age of its next tier between two intervals is moved by a rescan of its own
+    if (m_tiering && now >= m_tiering->nextDue()) {
+        m_rescanDue = true;
+    }
+    if (m_rescanDue && tryStart(true)) {
+        m_rescanDue = false;
+        ///@brief The rescan picks up whatever is pending as well
+        m_pending.clear();
+        auto self = shared_from_this();
+        pool.post([self, onFinished] () {
+            self->measure([&self] () {
+                self->run(nullptr);
+            });
+            self->finish(true);
+            onFinished();
+        });
+    }
+    ///@brief A settle run takes the rescan slot, the table of pending files is not shared
+    if (m_stability && now >= m_stability->nextDue() && tryStart(true)) {
+        auto self = shared_from_this();
+        pool.post([self, onFinished] () {
+            self->measure([&self] () {
+                self->settle();
+            });
+            self->finish(true);
+            onFinished();
+        });
+    }
+    bool full = m_pending.m_entries.size() >= transfer::Watcher::s_maxBatchSize;
+    if (!m_pending.m_entries.empty() && (full || now >= m_pendingSince + m_config.m_batchWindow) && tryStart(false)) {
+        auto self = shared_from_this();
+        auto entries = std::make_shared<std::vector<transfer::Entry> >(std::move(m_pending.m_entries));
+        m_pending.clear();
+        pool.post([self, entries, onFinished] () {
+            self->measure([&self, &entries] () {
+                self->run(entries.get());
+            });
+            self->finish(false);
+            onFinished();
+        });
+    }
+    m_batched = m_pending.m_entries.size();
+}
+
+void Job::follow(const std::shared_ptr<Job>& predecessor)
+{
+    m_predecessor = predecessor;
+}
+
+std::vector<transfer::Entry> Job::takePending()
+{
+    auto entries = std::move(m_pending.m_entries);
+    m_pending.clear();
+    m_batched = 0;
+    return entries;
+}
+
+void Job::adopt(std::vector<transfer::Entry> entries)
+{
+    if (entries.empty()) {
+        return;
+    }
+    if (m_pending.m_entries.empty()) {
+        m_pendingSince = Clock::now();
+    }
+    m_pending.m_entries.insert(m_pending.m_entries.end(), std::make_move_iterator(entries.begin()),
+                               std::make_move_iterator(entries.end()));
+    m_batched = m_pending.m_entries.size();
+}
+
+void Job::trigger() noexcept
+{
+    m_triggered = true;
+}
+
+void Job::pause(bool paused) noexcept
+{
+    if (m_paused.exchange(paused) != paused) {
+        DAEMON_LOG(LOG_INFO, "%s: %s", m_config.m_name.c_str(), paused ? "paused" : "resumed");
+    }
+}
+
+JobStatus Job::status() const
+{
+    JobStatus status;
+    status.m_name = m_config.m_name;
+    status.m_paused = m_paused.load();
+    status.m_running = m_running.load();
+    status.m_rescanning = m_rescanning.load();
+    status.m_queued = m_batched.load() + (m_stability ? m_stability->waiting() : 0);
+    status.m_copies = m_traffic.copies();
+    status.m_bytesInFlight = m_traffic.inFlight();
+    status.m_bytesCopied = m_traffic.copied();
+    status.m_moved = m_moved.load();
+    status.m_failed = m_failed.load();
+    std::lock_guard<std::mutex> lock(m_cycleMutex);
+    status.m_cycles = m_cycles;
+    status.m_lastStart = m_lastStart;
+    status.m_lastDuration = m_lastDuration;
+    status.m_lastMoved = m_lastMoved;
+    status.m_lastFailed = m_lastFailed;
+    return status;
+}
+
+void Job::measure(const std::function<void()>& cycle)
+{
+    auto start = std::chrono::system_clock::now();
+    auto begun = Clock::now();
+    auto moved = m_moved.load();
+    auto failed = m_failed.load();
+    cycle();
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - begun);
+    ///@brief Transfers running next to this cycle count as well, the totals are per job
+    std::lock_guard<std::mutex> lock(m_cycleMutex);
+    ++m_cycles;
+    m_lastStart = start;
+    m_lastDuration = duration;
+    m_lastMoved = m_moved.load() - moved;
+    m_lastFailed = m_failed.load() - failed;
+}
+
+bool Job::waiting() const noexcept
+{
+    auto predecessor = m_predecessor.lock();
+    return predecessor && predecessor->m_running.load() != 0;
+}
+
+bool Job::tryStart(bool rescan) noexcept
+{
+    if (rescan && m_rescanning.load()) {
+        return false;
+    }
+    if (m_running.load() >= m_config.m_maxConcurrency) {
+        return false;
+    }
+    ++m_running;
+    if (rescan) {
+        m_rescanning = true;
+    }
+    return true;
+}
+
+void Job::finish(bool rescan) noexcept
+{
+    if (rescan) {
+        m_rescanning = false;
+    }
+    --m_running;
+}
+
+void Job::recover()
+{
+    DAEMON_LOG(LOG_INFO, "%s: resuming %zu interrupted copies", m_config.m_name.c_str(), m_recovery.size());
+    std::map<std::pair<std::string, std::string>, std::vector<transfer::Intent> > catalogues;
+    bool dropped = false;
+    for (auto& intent : m_recovery) {
+        ///@brief The partition went to another instance meanwhile, which copies the file from scratch
+        if (m_partitions && !m_partitions->holds(intent.m_name)) {
+            m_journal->finish(intent.m_id);
+            dropped = true;
+            continue;
+        }
+        catalogues[std::make_pair(intent.m_source, intent.m_destination)].push_back(std::move(intent));
+    }
+    m_recovery.clear();
+    if (dropped) {
+        m_journal->commit();
+    }
+    for (const auto& item : catalogues) {
+        transfer::Mover mover(item.first.first, item.first.second, m_config.m_options);
+        mover.setJournal(m_journal.get());
+        mover.setThrottle(m_throttle.get());
+        mover.setManifest(m_manifest.get());
+        mover.setTraffic(&m_traffic);
+        mover.setPool(m_pool.load());
+        if (!mover.valid()) {
+            ///@brief Keep the intents, the catalogues may come back
+            DAEMON_LOG(LOG_ERR, "%s: could not open %s or %s: %s", m_config.m_name.c_str(), item.first.first.c_str(),
+                       item.first.second.c_str(), strerror(mover.error()));
+            continue;
+        }
+        CycleReport report(m_config.m_name, m_moved, m_failed);
+        for (const auto& intent : item.second) {
+            report(mover.resume(intent));
+        }
+        m_journal->commit();
+    }
+}
+
+void Job::run(const std::vector<transfer::Entry>* entries)
+{
+    auto* partitions = m_partitions.get();
+    transfer::Partitions::Hold hold;
+    if (partitions != nullptr) {
+        if (entries == nullptr) {
+            rebalance();
+        }
+        hold = partitions->hold();
+    }
+    if (entries == nullptr && !m_recovery.empty()) {
+        recover();
+    }
+    if (m_tiering) {
+        tier();
+        return;
+    }
+    const auto* from = &m_config.m_source;
+    const auto* to = &m_config.m_destination;
+    if (entries == nullptr && m_config.m_swap) {
+        if (m_reversed) {
+            std::swap(from, to);
+        }
+        m_reversed = !m_reversed;
+    }
+    const auto* filter = m_config.m_filter.get();
+    transfer::Scheduler scheduler(m_config.m_schedule, m_config.m_largeFileThreshold);
+    if (entries != nullptr) {
+        withMover(*from, *to, [this, from, to, entries, partitions, filter, &scheduler] (auto& mover,
+                                                                                  CycleReport& report) {
+            if (filter == nullptr && partitions == nullptr) {
+                scheduler.add(mover.sourceFd(), *entries);
+            } else {
+                auto selected = *entries;
+                if (partitions != nullptr) {
+                    partitions->select(selected);
+                }
+                if (filter != nullptr) {
+                    filter->select(mover.sourceFd(), selected);
+                }
+                scheduler.add(mover.sourceFd(), selected);
+            }
+            moveScheduled(*from, *to, mover, report, scheduler);
+        });
+        return;
+    }
+    m_settleFrom = from;
+    m_settleTo = to;
+    if (m_config.m_recursive) {
+        walk(*from, *to, scheduler);
+        return;
+    }
+    withMover(*from, *to, [this, from, to, partitions, filter, &scheduler] (auto& mover, CycleReport& report) {
+        auto* stability = m_stability.get();
+        auto* snapshot = m_snapshot.get();
+        ///@brief Partitions change hands and pending files must be seen by every rescan, those list the directory
+        if (snapshot != nullptr && partitions == nullptr && (stability == nullptr || stability->waiting() == 0) &&
+            snapshot->unchanged(mover.sourceFd())) {
+            auto entries = snapshot->recheck(mover.sourceFd());
+            if (filter != nullptr) {
+                filter->select(mover.sourceFd(), entries);
+            }
+            if (stability != nullptr) {
+                stability->select(mover.sourceFd(), entries);
+            }
+            scheduler.add(mover.sourceFd(), entries);
+            moveScheduled(*from, *to, mover, report, scheduler);
+            return;
+        }
+        auto failed = m_failed.load();
+        transfer::Filter::Reject reject;
+        if (snapshot != nullptr) {
+            snapshot->begin(mover.sourceFd());
+            reject = [snapshot] (const transfer::Entry& entry, const struct stat& st, int64_t until) {
+                snapshot->reject(entry, st, until);
+            };
+        }
+        transfer::Select select;
+        if (partitions != nullptr || filter != nullptr || stability != nullptr) {
+            ///@brief Names are the cheapest check, only what they let through is stat'ed for stability
+            select = [partitions, filter, stability, &reject] (int dirFd, std::vector<transfer::Entry>& chunk) {
+                if (partitions != nullptr) {
+                    partitions->select(chunk);
+                }
+                if (filter != nullptr) {
+                    filter->select(dirFd, chunk, reject);
+                }
+                if (stability != nullptr) {
+                    stability->select(dirFd, chunk);
+                }
+            };
+        }
+        if (m_config.m_schedule == transfer::Schedule::Fifo) {
+            mover.moveAll(std::ref(report), select);
+        } else {
+            mover.scan([&mover, &scheduler] (const std::vector<transfer::Entry>& chunk) {
+                scheduler.add(mover.sourceFd(), chunk);
+            }, select);
+            moveScheduled(*from, *to, mover, report, scheduler);
+        }
+        if (stability != nullptr) {
+            stability->sweep();
+        }
+        if (snapshot != nullptr) {
+            ///@brief Files which failed or wait to settle are still there without being recorded
+            bool complete = mover.error() == 0 && m_failed.load() == failed &&
+                            (stability == nullptr || stability->waiting() == 0);
+            int error = snapshot->commit(complete);
+            if (error != 0) {
+                DAEMON_LOG(LOG_WARNING, "%s: could not write the snapshot index %s: %s", m_config.m_name.c_str(),
+                           m_config.m_snapshot.c_str(), strerror(error));
+            }
+        }
+    });
+}
+
+void Job::rebalance()
+{
+    m_partitions->rebalance();
+    auto held = m_partitions->held();
+    if (held != m_heldPartitions) {
+        DAEMON_LOG(LOG_INFO, "%s: holding %u of %u partitions", m_config.m_name.c_str(), held, m_partitions->count());
+        m_heldPartitions = held;
+    }
+}
+
+void Job::settle()
+{
+    if (m_settleFrom == nullptr) {
+        return;
+    }
+    transfer::Scheduler scheduler(m_config.m_schedule, m_config.m_largeFileThreshold);
+    transfer::Partitions::Hold hold;
+    if (m_partitions) {
+        hold = m_partitions->hold();
+    }
+    ///@brief Files held back by a recursive rescan may be the first of their directory
+    std::unique_ptr<transfer::Directories> directories;
+    if (m_config.m_recursive) {
+        directories.reset(new transfer::Directories(*m_settleFrom, targets(*m_settleTo)));
+    }
+    withMover(*m_settleFrom, *m_settleTo, [this, &scheduler, &directories] (auto& mover, CycleReport& report) {
+        mover.setDirectories(directories.get());
+        auto entries = m_stability->due(Clock::now());
+        if (m_partitions) {
+            m_partitions->select(entries);
+        }
+        m_stability->select(mover.sourceFd(), entries);
+        scheduler.add(mover.sourceFd(), entries);
+        moveScheduled(*m_settleFrom, *m_settleTo, mover, report, scheduler);
+    });
+}
+
+void Job::tier()
+{
+    const auto& tiers = m_config.m_tiers;
+    auto* partitions = m_partitions.get();
+    const auto* filter = m_config.m_filter.get();
+    std::vector<std::vector<transfer::Entry> > due;
+    ///@brief Younger catalogues first, so the next one lists what moved into it and knows when it is due there
+    for (size_t level = 0; level < m_tiering->levels(); ++level) {
+        const auto& from = level == 0 ? m_config.m_source : tiers[level - 1].m_catalogue;
+        int dirFd = open(from.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dirFd == -1) {
+            DAEMON_LOG(LOG_ERR, "%s: could not open %s: %s", m_config.m_name.c_str(), from.c_str(), strerror(errno));
+        }
+        int error = m_tiering->evaluate(level, dirFd, m_config.m_options.m_includeHidden, due);
+        if (error != 0) {
+            DAEMON_LOG(LOG_WARNING, "%s: could not read all of %s: %s", m_config.m_name.c_str(), from.c_str(),
+                       strerror(error));
+        }
+        for (size_t tier = level; dirFd != -1 && tier < tiers.size(); ++tier) {
+            auto& entries = due[tier];
+            if (partitions != nullptr) {
+                partitions->select(entries);
+            }
+            if (filter != nullptr) {
+                filter->select(dirFd, entries);
+            }
+            if (entries.empty()) {
+                continue;
+            }
+            const auto& to = tiers[tier].m_catalogue;
+            transfer::Scheduler scheduler(m_config.m_schedule, m_config.m_largeFileThreshold);
+            withMover(from, to, [this, &from, &to, &entries, &scheduler] (auto& mover, CycleReport& report) {
+                scheduler.add(mover.sourceFd(), entries);
+                moveScheduled(from, to, mover, report, scheduler);
+            });
+        }
+        if (dirFd != -1) {
+            close(dirFd);
+        }
+    }
+}
+
+void Job::walk(const std::string& from, const std::string& to, transfer::Scheduler& scheduler)
+{
+    transfer::Directories directories(from, targets(to));
+    transfer::Walker walker(from, m_config.m_walkWorkers, m_config.m_options.m_includeHidden);
+    if (!directories.valid() || !walker.valid()) {
+        DAEMON_LOG(LOG_ERR, "%s: could not open catalogues: %s", m_config.m_name.c_str(),
+                   strerror(directories.valid() ? walker.error() : directories.error()));
+        return;
+    }
+    const auto* partitions = m_partitions.get();
+    const auto* filter = m_config.m_filter.get();
+    auto* stability = m_stability.get();
+    bool scheduled = m_config.m_schedule != transfer::Schedule::Fifo;
+    ///@brief Guards the table of pending files and the scheduler, the walkers share them
+    std::mutex mutex;
+    auto work = [&] (unsigned worker) {
+        withMover(from, to, [&] (auto& mover, CycleReport& report) {
+            mover.setDirectories(&directories);
+            walker.run(worker, [&] (std::vector<transfer::Entry>& files) {
+                if (partitions != nullptr) {
+                    partitions->select(files);
+                }
+                if (filter != nullptr) {
+                    filter->select(walker.rootFd(), files);
+                }
+                if (stability != nullptr || scheduled) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (stability != nullptr) {
+                        stability->select(walker.rootFd(), files);
+                    }
+                    if (scheduled) {
+                        scheduler.add(walker.rootFd(), files);
+                        return;
+                    }
+                }
+                for (const auto& result : mover.moveBatch(files)) {
+                    report(result);
+                }
+            });
+        });
+    };
+    ///@brief Idle pool workers join the walk, a walker no worker took finds the tree read when join() runs it
+    transfer::Helpers helpers(m_pool.load(), walker.workers() - 1, [&work] (unsigned worker) {
+        work(worker + 1);
+    });
+    work(0);
+    helpers.join();
+    if (walker.error() != 0) {
+        DAEMON_LOG(LOG_WARNING, "%s: could not read all of %s: %s", m_config.m_name.c_str(), from.c_str(),
+                   strerror(walker.error()));
+    }
+    if (scheduled) {
+        withMover(from, to, [this, &from, &to, &directories, &scheduler] (auto& mover, CycleReport& report) {
+            mover.setDirectories(&directories);
+            moveScheduled(from, to, mover, report, scheduler);
+        });
+    }
+    if (stability != nullptr) {
+        stability->sweep();
+    }
+}
+
+template <typename Move>
+void Job::withMover(const std::string& from, const std::string& to, Move move)
+{
+    auto run = [this, &move] (auto& mover) {
+        mover.setJournal(m_journal.get());
+        mover.setThrottle(m_throttle.get());
+        mover.setManifest(m_manifest.get());
+        mover.setTraffic(&m_traffic);
+        mover.setPool(m_pool.load());
+        if (!mover.valid()) {
+            DAEMON_LOG(LOG_ERR, "%s: could not open catalogues: %s", m_config.m_name.c_str(), strerror(mover.error()));
+            return;
+        }
+        CycleReport report(m_config.m_name, m_moved, m_failed);
+        move(mover, report);
+    };
+    if (m_placement && !m_config.m_uring) {
+        transfer::FanOut<transfer::Mover> mover(makeMovers<transfer::Mover>(from, m_config.m_destinations,
+                                                                            m_config.m_options), *m_placement);
+        run(mover);
+        return;
+    }
+    if (m_placement) {
+        transfer::FanOut<transfer::UringMover> mover(makeMovers<transfer::UringMover>(
+            from, m_config.m_destinations, m_config.m_queueDepth, m_config.m_options), *m_placement);
+        run(mover);
+        return;
+    }
+    if (!m_config.m_uring) {
+        transfer::Mover mover(from, to, m_config.m_options);
+        run(mover);
+        return;
+    }
+    transfer::UringMover mover(from, to, m_config.m_queueDepth, m_config.m_options);
+    run(mover);
+}
+
+std::vector<std::string> Job::targets(const std::string& to) const
+{
+    return m_placement ? m_config.m_destinations : std::vector<std::string>(1, to);
+}
+
+template <typename Mover, typename Report>
+void Job::moveScheduled(const std::string& from, const std::string& to, Mover& mover, Report& report,
+                        transfer::Scheduler& scheduler)
+{
+    auto large = scheduler.take(transfer::Lane::Large);
+    auto* directories = mover.directories();
+    ///@brief Without an idle pool worker the large files queue up behind the small ones
+    transfer::Helpers lane(m_pool.load(), large.empty() ? 0 : 1, [this, &from, &to, &large, directories] (unsigned) {
+        withMover(from, to, [&large, directories] (auto& laneMover, CycleReport& laneReport) {
+            laneMover.setDirectories(directories);
+            for (const auto& result : laneMover.moveBatch(large)) {
+                laneReport(result);
+            }
+        });
+    });
+    for (const auto& result : mover.moveBatch(scheduler.take(transfer::Lane::Small))) {
+        report(result);
+    }
+    lane.join();
+}
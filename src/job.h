@@ -0,0 +1,278 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "transfer/filter.h"
+#include "transfer/journal.h"
+#include "transfer/manifest.h"
+#include "transfer/options.h"
+#include "transfer/partitions.h"
+#include "transfer/placement.h"
+#include "transfer/scanner.h"
+#include "transfer/scheduler.h"
+#include "transfer/snapshot.h"
+#include "transfer/stability.h"
+#include "transfer/threadpool.h"
+#include "transfer/throttle.h"
+#include "transfer/tiering.h"
+#include "transfer/traffic.h"
+#include "transfer/watcher.h"
+
+enum class Trigger
+{
+    Interval,   ///< rescan the source every interval
+    Inotify     ///< move files as soon as inotify reports them complete
+};
+
+///@brief Everything configuration.conf says about one source to destination job
+struct JobConfig
+{
+    std::string m_name;
+    std::string m_source;
+    std::string m_destination;
+    ///@brief Every destination of a fan-out job, m_destination is the first; empty for a single destination
+    std::vector<std::string> m_destinations;
+    transfer::Spread m_spread = transfer::Spread::Balanced;
+    ///@brief Bytes a fan-out job keeps free on every destination while it can
+    uint64_t m_minFree = 0;
+    Trigger m_trigger = Trigger::Interval;
+    ///@brief Rescan period, with Trigger::Inotify only a safety net; 0 disables it
+    std::chrono::seconds m_interval = std::chrono::seconds(20);
+    ///@brief Inotify events arriving within this window are moved as one batch
+    std::chrono::milliseconds m_batchWindow = std::chrono::milliseconds(20);
+    ///@brief Transfers of this job which may occupy pool workers at the same time
+    unsigned m_maxConcurrency = 1;
+    ///@brief Move the files of subdirectories too, recreating the tree in the destination
+    bool m_recursive = false;
+    ///@brief Threads walking the tree of a recursive rescan, the pool worker running it is one of them
+    unsigned m_walkWorkers = 4;
+    ///@brief Swap source and destination after every rescan, the legacy catalogue1/catalogue2 behaviour
+    bool m_swap = false;
+    bool m_uring = true;
+    unsigned m_queueDepth = 256;
+    ///@brief Path of the transfer journal, empty if copies are not journaled
+    std::string m_journal;
+    ///@brief Path of the checksum manifest, empty unless copies are verified
+    std::string m_manifest;
+    ///@brief Path of the snapshot index of the source, empty unless rescans keep one
+    std::string m_snapshot;
+    ///@brief Limits shared by every transfer of the job, 0 for unlimited
+    uint64_t m_maxBytesPerSecond = 0;
+    uint64_t m_maxOpsPerSecond = 0;
+    ///@brief I/Os in flight on a catalogue's device above which the job backs off, 0 disables it
+    unsigned m_backoffQueueDepth = 0;
+    ///@brief Rescans leave files alone until their size and mtime held still this long, 0 moves everything
+    std::chrono::milliseconds m_settleTime = std::chrono::milliseconds(1000);
+    ///@brief Order files are moved in within a cycle, anything but Fifo collects the whole cycle first
+    transfer::Schedule m_schedule = transfer::Schedule::Fifo;
+    ///@brief Scheduled files of at least this many bytes move on a lane of their own, 0 keeps one lane
+    uint64_t m_largeFileThreshold = 64ull << 20;
+    ///@brief Hash partitions of the source names shared with other instances, 0 moves every name
+    unsigned m_partitions = 0;
+    ///@brief Directory of the lease files, on a file system every instance sees
+    std::string m_partitionDirectory;
+    ///@brief Catalogues files move on to as they age, m_destination is the first; empty unless the job is tiered
+    std::vector<transfer::Tier> m_tiers;
+    transfer::AgeClock m_ageClock = transfer::AgeClock::Modified;
+    ///@brief Compiled include/exclude rules, nullptr moves every entry
+    std::shared_ptr<const transfer::Filter> m_filter;
+    transfer::Options m_options;
+};
+
+/**
+ * @brief Build the job table. Every job.<name>.<key> entry belongs to job <name>,
+ * plain keys are the defaults of every job. catalogue1/catalogue2 describe the
+ * legacy job "default". Filter rules are compiled here, once per load.
+ * Throws std::invalid_argument on malformed values.
+ */
+std::vector<JobConfig> parseJobs(const std::map<std::string, std::string>& conf);
+
+///@brief What the control API reports about one job, copied at one moment
+struct JobStatus
+{
+    std::string m_name;
+    bool m_paused = false;
+    ///@brief Transfers posted to the pool which did not finish yet
+    unsigned m_running = 0;
+    bool m_rescanning = false;
+    ///@brief Files known to wait: the inotify batch and the files a rescan held back to settle
+    size_t m_queued = 0;
+    ///@brief Cross-device copies in flight and their bytes, renames move no data
+    unsigned m_copies = 0;
+    uint64_t m_bytesInFlight = 0;
+    uint64_t m_bytesCopied = 0;
+    ///@brief Totals since the job started
+    uint64_t m_moved = 0;
+    uint64_t m_failed = 0;
+    ///@brief Finished cycles, the last* fields describe the last of them if there was one
+    uint64_t m_cycles = 0;
+    std::chrono::system_clock::time_point m_lastStart;
+    std::chrono::milliseconds m_lastDuration{0};
+    ///@brief Moved and failed by the job while the last cycle ran
+    uint64_t m_lastMoved = 0;
+    uint64_t m_lastFailed = 0;
+};
+
+/**
+ * @class  Job
+ * @file   job.h
+ * @brief  Runtime state of one transfer job. The dispatcher thread feeds it
+ *         inotify events and the clock, the job posts its transfers to the
+ *         shared pool, never more than m_maxConcurrency at a time, and only
+ *         one full rescan at a time.
+ */
+class Job : public std::enable_shared_from_this<Job>
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    ///@brief journal may be nullptr, unfinished copies it replayed are resumed by the first rescan
+    Job(JobConfig config, std::shared_ptr<transfer::Journal> journal);
+
+    const JobConfig& config() const noexcept
+    {
+        return m_config;
+    }
+
+    /**
+     * @brief Log the copies of the job to journal, which may be nullptr; before the first transfer only.
+     * The unfinished copies it replayed are resumed by the next rescan.
+     */
+    void attach(std::shared_ptr<transfer::Journal> journal);
+
+    ///@brief Hold every transfer back until predecessor, the job this one replaces at a reload, is idle
+    void follow(const std::shared_ptr<Job>& predecessor);
+
+    ///@brief Start watching the source if the job is inotify triggered
+    void watch();
+
+    ///@brief inotify descriptor to poll, -1 if the job is not watching
+    int watchFd() const noexcept;
+
+    ///@brief Drain the inotify events into the pending batch
+    void collect();
+
+    ///@brief Post the transfers which are due, onFinished is called on the worker when one ends
+    void dispatch(Clock::time_point now, transfer::ThreadPool& pool, const std::function<void()>& onFinished);
+
+    ///@brief Next time dispatch() has something to do, Clock::time_point::max() if only events can wake it
+    Clock::time_point deadline() const noexcept;
+
+    /**
+     * @brief Move entries, on the calling thread. nullptr rescans the source and
+     * moves every visible entry which is stable, inotify batches are complete already.
+     */
+    void run(const std::vector<transfer::Entry>* entries);
+
+    ///@brief Take the entries of the inotify batch which were not posted yet, for the next instance
+    std::vector<transfer::Entry> takePending();
+
+    ///@brief Queue entries the previous instance had batched, they are posted with the next batch
+    void adopt(std::vector<transfer::Entry> entries);
+
+    ///@brief Rescan at the next dispatch(), whatever the interval says; any thread
+    void trigger() noexcept;
+
+    ///@brief Post no more transfers while paused, those in flight finish; any thread
+    void pause(bool paused) noexcept;
+
+    ///@brief Counters of the job; any thread
+    JobStatus status() const;
+
+private:
+    ///@brief Whether the predecessor still has transfers in flight, which may be moving the same files
+    bool waiting() const noexcept;
+    bool tryStart(bool rescan) noexcept;
+    ///@brief Run one cycle on the calling thread and remember how long it took
+    void measure(const std::function<void()>& cycle);
+    ///@brief Finish the copies a crash interrupted, on the calling thread
+    void recover();
+    ///@brief Claim or give back partitions to hold this instance's share, before a rescan
+    void rebalance();
+    ///@brief Move the files held back by the last rescan which settled since, on the calling thread
+    void settle();
+    ///@brief Rescan a tiered job: move the files of every catalogue which reached the age of a later tier
+    void tier();
+    ///@brief Rescan a recursive job: m_walkWorkers walkers on pool workers read the tree, each moving what it finds
+    void walk(const std::string& from, const std::string& to, transfer::Scheduler& scheduler);
+    ///@brief Destinations the files of a cycle into to may land in
+    std::vector<std::string> targets(const std::string& to) const;
+    /**
+     * @brief Open the catalogues with the configured engine and hand the mover and a report to move.
+     * A fan-out job gets one mover spreading over all its destinations, to is the first of them.
+     */
+    template <typename Move>
+    void withMover(const std::string& from, const std::string& to, Move move);
+    /**
+     * @brief Move entries of from in the configured order, the large lane on a pool
+     * worker with a second mover; Schedule::Fifo moves them as they are
+     */
+    template <typename Mover, typename Report>
+    void moveScheduled(const std::string& from, const std::string& to, Mover& mover, Report& report,
+                       transfer::Scheduler& scheduler);
+    void finish(bool rescan) noexcept;
+
+private:
+    const JobConfig m_config;
+    std::atomic<unsigned> m_running;
+    std::atomic<bool> m_rescanning;
+    std::shared_ptr<transfer::Journal> m_journal;
+    ///@brief nullptr if the job is neither limited nor backing off
+    std::unique_ptr<transfer::Throttle> m_throttle;
+    std::unique_ptr<transfer::Manifest> m_manifest;
+    ///@brief nullptr unless the job shares its source with other instances
+    std::unique_ptr<transfer::Partitions> m_partitions;
+    ///@brief nullptr unless the job fans out over several destinations
+    std::unique_ptr<transfer::Placement> m_placement;
+    std::atomic<bool> m_paused;
+    std::atomic<bool> m_triggered;
+    ///@brief Pool the job is dispatched to, lends the lanes, walkers and copy workers their threads
+    std::atomic<transfer::ThreadPool*> m_pool;
+    ///@brief Status counters, updated by every thread the job runs on
+    //@{
+    transfer::Traffic m_traffic;
+    std::atomic<uint64_t> m_moved;
+    std::atomic<uint64_t> m_failed;
+    ///@brief Size of m_pending, which only the dispatcher may touch
+    std::atomic<size_t> m_batched;
+    mutable std::mutex m_cycleMutex;
+    uint64_t m_cycles = 0;
+    std::chrono::system_clock::time_point m_lastStart;
+    std::chrono::milliseconds m_lastDuration{0};
+    uint64_t m_lastMoved = 0;
+    uint64_t m_lastFailed = 0;
+    //@}
+    ///@brief Only touched by rescans and settle runs which never overlap, except their nextDue()
+    //@{
+    bool m_reversed = false;
+    unsigned m_heldPartitions = 0;
+    std::vector<transfer::Intent> m_recovery;
+    ///@brief nullptr if the job does not wait for files to settle
+    std::unique_ptr<transfer::Stability> m_stability;
+    ///@brief nullptr unless the job is tiered, which replaces waiting for files to settle
+    std::unique_ptr<transfer::Tiering> m_tiering;
+    ///@brief nullptr unless rescans of the source keep a snapshot index, never for recursive or swapping jobs
+    std::unique_ptr<transfer::Snapshot> m_snapshot;
+    ///@brief Catalogues of the last rescan, where the files held back by it are
+    const std::string* m_settleFrom = nullptr;
+    const std::string* m_settleTo = nullptr;
+    //@}
+
+    ///@brief Dispatcher thread only
+    //@{
+    std::unique_ptr<transfer::Watcher> m_watcher;
+    transfer::Batch m_pending;
+    Clock::time_point m_pendingSince;
+    Clock::time_point m_nextRescan;
+    bool m_rescanDue = false;
+    ///@brief Expires once the transfers of the job this one replaced finished
+    std::weak_ptr<Job> m_predecessor;
+    //@}
+};
@@ -0,0 +1,333 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <ctime>
+#include <algorithm>
+#include <stdexcept>
+
+#include "logger.h"
+
+namespace logging {
+
+namespace {
+
+const char* levelName(int level)
+{
+    static const char* const s_names[] = { "emergency", "alert", "critical", "error", "warning", "notice", "info",
+                                           "debug" };
+    return s_names[std::min(std::max(level, 0), 7)];
+}
+
+void writeAll(int fd, const std::string& text) noexcept
+{
+    size_t done = 0;
+    while (done < text.size()) {
+        auto written = ::write(fd, text.data() + done, text.size() - done);
+        if (written == -1 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return;
+        }
+        done += static_cast<size_t>(written);
+    }
+}
+
+int64_t now() noexcept
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+///@brief Length of the text vsnprintf wrote into a buffer of size bytes
+unsigned clamp(int length, size_t size) noexcept
+{
+    return static_cast<unsigned>(std::min<long>(std::max(length, 0), static_cast<long>(size) - 1));
+}
+
+} // unnamed namespace
+
+const std::chrono::milliseconds Logger::s_flushInterval(100);
+
+Settings makeSettings(const std::string& log, const std::string& level, const std::string& overflow)
+{
+    Settings settings;
+    if (log.empty() || log == "syslog") {
+        settings.m_sink = Sink::Syslog;
+    } else if (log == "stderr") {
+        settings.m_sink = Sink::Stderr;
+    } else {
+        settings.m_sink = Sink::File;
+        settings.m_path = log;
+    }
+    if (level == "error") {
+        settings.m_level = LOG_ERR;
+    } else if (level == "warning") {
+        settings.m_level = LOG_WARNING;
+    } else if (level == "notice") {
+        settings.m_level = LOG_NOTICE;
+    } else if (level.empty() || level == "info") {
+        settings.m_level = LOG_INFO;
+    } else if (level == "debug") {
+        settings.m_level = LOG_DEBUG;
+    } else {
+        throw std::invalid_argument("log_level: " + level);
+    }
+    if (overflow.empty() || overflow == "drop") {
+        settings.m_overflow = Overflow::Drop;
+    } else if (overflow == "block") {
+        settings.m_overflow = Overflow::Block;
+    } else {
+        throw std::invalid_argument("log_overflow: " + overflow);
+    }
+    return settings;
+}
+
+///@brief Gives the buffer of a thread back when the thread exits
+class Logger::Producer
+{
+public:
+    ~Producer()
+    {
+        if (m_buffer != nullptr) {
+            Logger::instance().release(m_buffer);
+        }
+    }
+
+    Buffer* m_buffer = nullptr;
+};
+
+Logger& Logger::instance()
+{
+    static Logger s_logger;
+    return s_logger;
+}
+
+Logger::~Logger()
+{
+    stop();
+    if (m_fd != -1) {
+        close(m_fd);
+    }
+}
+
+int Logger::configure(const Settings& settings)
+{
+    m_level = settings.m_level;
+    m_overflow = settings.m_overflow;
+    int fd = -1;
+    if (settings.m_sink == Sink::File) {
+        fd = open(settings.m_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd == -1) {
+            return errno;
+        }
+    }
+    std::lock_guard<std::mutex> lock(m_sinkMutex);
+    if (m_fd != -1) {
+        close(m_fd);
+    }
+    m_sink = settings.m_sink;
+    m_fd = fd;
+    return 0;
+}
+
+void Logger::start()
+{
+    if (m_running) {
+        return;
+    }
+    m_running = true;
+    m_thread = std::thread(&Logger::flusher, this);
+}
+
+void Logger::stop()
+{
+    if (!m_running.exchange(false)) {
+        return;
+    }
+    wake();
+    m_thread.join();
+    ///@brief Whatever was written while the flusher left
+    drain();
+}
+
+void Logger::write(int level, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    if (!m_running.load(std::memory_order_acquire)) {
+        char text[s_maxText];
+        int length = vsnprintf(text, sizeof(text), format, args);
+        va_end(args);
+        emit(std::vector<Message>(1, Message{ now(), level, clamp(length, sizeof(text)), text }));
+        return;
+    }
+    auto& buffer = local();
+    auto head = buffer.m_head.load(std::memory_order_relaxed);
+    auto used = head - buffer.m_tail.load(std::memory_order_acquire);
+    ///@brief A record never wraps, the end of the ring is skipped when the longest one would not fit there
+    auto offset = head % s_capacity;
+    size_t padding = s_capacity - offset < s_longest ? s_capacity - offset : 0;
+    if (s_capacity - used < padding + s_longest && !makeRoom(buffer, head, padding + s_longest)) {
+        va_end(args);
+        return;
+    }
+    if (padding != 0) {
+        reinterpret_cast<Header*>(&buffer.m_data[offset])->m_level = -1;
+        head += padding;
+        offset = 0;
+    }
+    auto* header = reinterpret_cast<Header*>(&buffer.m_data[offset]);
+    int length = vsnprintf(&buffer.m_data[offset + sizeof(Header)], s_maxText, format, args);
+    va_end(args);
+    header->m_time = now();
+    header->m_level = level;
+    header->m_length = clamp(length, s_maxText);
+    head += recordSize(header->m_length);
+    buffer.m_head.store(head, std::memory_order_release);
+    ///@brief Only the message which fills half of the ring pays for waking the flusher early
+    if (used < s_capacity / 2 && head - buffer.m_tail.load(std::memory_order_relaxed) >= s_capacity / 2) {
+        wake();
+    }
+}
+
+Logger::Buffer& Logger::local()
+{
+    thread_local Producer t_producer;
+    if (t_producer.m_buffer != nullptr) {
+        return *t_producer.m_buffer;
+    }
+    std::lock_guard<std::mutex> lock(m_buffersMutex);
+    for (auto& buffer : m_buffers) {
+        bool owned = false;
+        if (buffer->m_owned.compare_exchange_strong(owned, true)) {
+            t_producer.m_buffer = buffer.get();
+            return *buffer;
+        }
+    }
+    m_buffers.emplace_back(new Buffer);
+    t_producer.m_buffer = m_buffers.back().get();
+    return *t_producer.m_buffer;
+}
+
+void Logger::release(Buffer* buffer) noexcept
+{
+    ///@brief The records left in it are still flushed, the next owner writes behind them
+    buffer->m_owned = false;
+}
+
+bool Logger::makeRoom(Buffer& buffer, uint64_t head, size_t needed)
+{
+    if (m_overflow.load(std::memory_order_relaxed) == Overflow::Drop) {
+        ++m_dropped;
+        return false;
+    }
+    wake();
+    while (s_capacity - (head - buffer.m_tail.load(std::memory_order_acquire)) < needed) {
+        if (!m_running.load(std::memory_order_acquire)) {
+            ++m_dropped;
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+void Logger::wake()
+{
+    std::lock_guard<std::mutex> lock(m_wakeMutex);
+    m_wakeUp = true;
+    m_wake.notify_one();
+}
+
+void Logger::flusher()
+{
+    while (m_running.load(std::memory_order_acquire)) {
+        {
+            std::unique_lock<std::mutex> lock(m_wakeMutex);
+            m_wake.wait_for(lock, s_flushInterval, [this] () {
+                return m_wakeUp;
+            });
+            m_wakeUp = false;
+        }
+        drain();
+    }
+}
+
+void Logger::drain()
+{
+    m_messages.clear();
+    std::vector<std::pair<Buffer*, uint64_t> > heads;
+    {
+        std::lock_guard<std::mutex> lock(m_buffersMutex);
+        for (auto& buffer : m_buffers) {
+            auto tail = buffer->m_tail.load(std::memory_order_relaxed);
+            auto head = buffer->m_head.load(std::memory_order_acquire);
+            for (auto i = tail; i != head;) {
+                auto offset = i % s_capacity;
+                const auto* header = reinterpret_cast<const Header*>(&buffer->m_data[offset]);
+                if (header->m_level < 0) {
+                    i += s_capacity - offset;
+                    continue;
+                }
+                m_messages.push_back(Message{ header->m_time, header->m_level, header->m_length,
+                                              &buffer->m_data[offset + sizeof(Header)] });
+                i += recordSize(header->m_length);
+            }
+            if (head != tail) {
+                heads.emplace_back(buffer.get(), head);
+            }
+        }
+    }
+    ///@brief Each ring is in order already, the merge only interleaves the threads
+    std::stable_sort(m_messages.begin(), m_messages.end(), [] (const Message& left, const Message& right) {
+        return left.m_time < right.m_time;
+    });
+    emit(m_messages);
+    for (const auto& item : heads) {
+        item.first->m_tail.store(item.second, std::memory_order_release);
+    }
+    auto dropped = m_dropped.load(std::memory_order_relaxed);
+    if (dropped != m_reported) {
+        char text[128];
+        int length = snprintf(text, sizeof(text), "logging: %llu messages dropped, the buffers were full",
+                              static_cast<unsigned long long>(dropped - m_reported));
+        emit(std::vector<Message>(1, Message{ now(), LOG_WARNING, clamp(length, sizeof(text)), text }));
+        m_reported = dropped;
+    }
+}
+
+void Logger::emit(const std::vector<Message>& messages)
+{
+    if (messages.empty()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_sinkMutex);
+    if (m_sink == Sink::Syslog) {
+        for (const auto& message : messages) {
+            syslog(message.m_level, "%.*s", static_cast<int>(message.m_length), message.m_text);
+        }
+        return;
+    }
+    ///@brief One write per batch
+    m_text.clear();
+    for (const auto& message : messages) {
+        time_t seconds = static_cast<time_t>(message.m_time / 1000000000);
+        struct tm local;
+        localtime_r(&seconds, &local);
+        char stamp[64];
+        auto length = strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &local);
+        length += static_cast<size_t>(snprintf(stamp + length, sizeof(stamp) - length, ".%06d ",
+                                               static_cast<int>(message.m_time % 1000000000 / 1000)));
+        m_text.append(stamp, length);
+        m_text.append(levelName(message.m_level));
+        m_text.append(": ");
+        m_text.append(message.m_text, message.m_length);
+        m_text.push_back('\n');
+    }
+    writeAll(m_sink == Sink::File ? m_fd : STDERR_FILENO, m_text);
+}
+
+} // namespace logging
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <syslog.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+///@brief Messages less severe than this are compiled out, -DDAEMON_LOG_LEVEL=LOG_INFO drops the per-file ones
+#ifndef DAEMON_LOG_LEVEL
+#define DAEMON_LOG_LEVEL LOG_DEBUG
+#endif
+
+///@brief syslog(3) replacement: DAEMON_LOG(LOG_INFO, "%s: ...", ...), the arguments are not evaluated when filtered
+#define DAEMON_LOG(level, ...)                                                                  \
+    do {                                                                                        \
+        if ((level) <= DAEMON_LOG_LEVEL && ::logging::Logger::instance().enabled(level)) {      \
+            ::logging::Logger::instance().write((level), __VA_ARGS__);                          \
+        }                                                                                       \
+    } while (false)
+
+namespace logging {
+
+enum class Sink
+{
+    Syslog,
+    Stderr,
+    File
+};
+
+///@brief What a thread does when its buffer is full
+enum class Overflow
+{
+    ///@brief Count the message and go on, the flusher reports how many were lost
+    Drop,
+    ///@brief Wait for the flusher to make room
+    Block
+};
+
+struct Settings
+{
+    Sink m_sink = Sink::Syslog;
+    ///@brief File sink only
+    std::string m_path;
+    ///@brief syslog priority, less severe messages are filtered out
+    int m_level = LOG_INFO;
+    Overflow m_overflow = Overflow::Drop;
+};
+
+/**
+ * @brief Parse the log, log_level and log_overflow configuration values
+ * @throw std::invalid_argument for an unknown level or overflow policy
+ */
+Settings makeSettings(const std::string& log, const std::string& level, const std::string& overflow);
+
+/**
+ * @class  Logger
+ * @file   logger.h
+ * @brief  Asynchronous logger of the daemon. Every thread formats its
+ *         messages into a ring buffer of its own, which only it writes and
+ *         only the flusher thread reads, so logging takes no lock and no
+ *         system call. The flusher wakes every s_flushInterval, or when a
+ *         buffer gets half full, merges what the buffers hold by time and
+ *         hands it to syslog, or to a file or stderr in one write.
+ *         Until start() and after stop() messages are written synchronously,
+ *         so nothing is lost around a fork or at exit. Buffers of exited
+ *         threads are reused by new ones.
+ */
+class Logger
+{
+public:
+    static Logger& instance();
+
+    ~Logger();
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    /**
+     * @brief Apply settings, from any thread; a file sink is (re)opened
+     * @return 0 or the errno of the file which could not be opened, the sink is kept then
+     */
+    int configure(const Settings& settings);
+
+    ///@brief Start the flusher thread, messages are buffered from now on
+    void start();
+
+    ///@brief Flush everything and stop the flusher thread
+    void stop();
+
+    bool enabled(int level) const noexcept
+    {
+        return level <= m_level.load(std::memory_order_relaxed);
+    }
+
+    void write(int level, const char* format, ...) __attribute__((format(printf, 3, 4)));
+
+    ///@brief Messages dropped since the start because a buffer was full
+    uint64_t dropped() const noexcept
+    {
+        return m_dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    ///@brief Bytes of the ring of one thread, a power of two
+    static const size_t s_capacity = 1 << 20;
+    ///@brief Longer messages are truncated
+    static const size_t s_maxText = 1024;
+    ///@brief Room the longest record takes, records start 16 bytes aligned
+    static const size_t s_longest = 16 + s_maxText;
+    static const std::chrono::milliseconds s_flushInterval;
+
+    ///@brief Header of a record in a ring, its text follows; a negative level pads up to the end of the ring
+    struct Header
+    {
+        ///@brief Nanoseconds since the epoch
+        int64_t m_time;
+        int m_level;
+        unsigned m_length;
+    };
+
+    ///@brief A record as the flusher writes it out
+    struct Message
+    {
+        int64_t m_time;
+        int m_level;
+        unsigned m_length;
+        const char* m_text;
+    };
+
+    static size_t recordSize(unsigned length) noexcept
+    {
+        return (sizeof(Header) + length + 1 + 15) & ~size_t(15);
+    }
+
+    ///@brief Single producer single consumer ring of variable length records of one thread
+    struct Buffer
+    {
+        ///@brief Byte offsets, only growing; the producer writes m_head, the flusher m_tail
+        std::atomic<uint64_t> m_head{0};
+        ///@brief Keeps the producer's and the consumer's index off one cache line
+        char m_padding[64];
+        std::atomic<uint64_t> m_tail{0};
+        std::atomic<bool> m_owned{true};
+        std::unique_ptr<char[]> m_data{new char[s_capacity]};
+    };
+
+    class Producer;
+
+    Logger() = default;
+
+    ///@brief Buffer of the calling thread, taken on its first message and given back when it exits
+    Buffer& local();
+    void release(Buffer* buffer) noexcept;
+    ///@brief Wait for the flusher to free needed bytes, false if the message is to be dropped
+    bool makeRoom(Buffer& buffer, uint64_t head, size_t needed);
+    void wake();
+    void flusher();
+    ///@brief Write out and free what the buffers hold, flusher thread or stop() only
+    void drain();
+    void emit(const std::vector<Message>& messages);
+
+private:
+    std::atomic<int> m_level{LOG_INFO};
+    std::atomic<bool> m_running{false};
+    std::atomic<Overflow> m_overflow{Overflow::Drop};
+    std::atomic<uint64_t> m_dropped{0};
+    ///@brief Dropped messages the flusher has reported
+    uint64_t m_reported = 0;
+
+    ///@brief Guards the buffer list
+    std::mutex m_buffersMutex;
+    std::vector<std::unique_ptr<Buffer> > m_buffers;
+
+    ///@brief Guards the sink, the flusher holds it while writing a batch
+    std::mutex m_sinkMutex;
+    Sink m_sink = Sink::Syslog;
+    int m_fd = -1;
+    std::string m_text;
+    std::vector<Message> m_messages;
+
+    std::mutex m_wakeMutex;
+    std::condition_variable m_wake;
+    bool m_wakeUp = false;
+    std::thread m_thread;
+};
+
+} // namespace logging
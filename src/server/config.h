@@ -40,7 +40,7 @@ public:
      * @brief Set to false to avoid binding the socket to an address that is already in use.
      * Default is true.
      */
-    bool m_reuseSddress = false;
+    bool m_reuseAddress = true;
 
 private:
     friend class ServerBase<SocketType>;
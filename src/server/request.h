@@ -26,7 +26,7 @@ public:
         try {
             return m_remoteEndpoint->address().to_string();
         } catch (...) {
-            std::string();
+            return std::string();
         }
     }
 
@@ -41,6 +41,10 @@ public:
         return QueryString::parse(m_queryString);
     }
 
+private:
+    ///@brief Declared first, m_content reads from it
+    asio::streambuf m_streambuf;
+
 public:
     std::string m_method, m_path, m_queryString, m_httpVersion;
     Content<SocketType> m_content;
@@ -52,8 +56,6 @@ public:
     std::chrono::system_clock::time_point m_headerReadTime;
 
 private:
-    asio::streambuf m_streambuf;
-
     Request(size_t maxRequestStreambufSize, std::shared_ptr<asio::ip::tcp::endpoint> remoteEndpoint) noexcept
         : m_streambuf(maxRequestStreambufSize)
         , m_content(m_streambuf)
@@ -56,9 +56,8 @@ public:
     {
         *this << "HTTP/1.1 " << statusCode(sCode) << "\r\n";
         write_header(header, content.size());
-        if (content.empty()) {
+        if (!content.empty()) {
             *this << content;
-
         }
     }
 
@@ -134,8 +133,8 @@ private:
                 }
                 *this << item.first << ": " << item.second << "\r\n";
             }
-            if (!contentLengthWritten && chunkedTransferEncoding && !m_closeConnectionAfterResponse) {
-                *this << "content-Length: " << size << "\r\n\r\n";
+            if (!contentLengthWritten && !chunkedTransferEncoding && !m_closeConnectionAfterResponse) {
+                *this << "Content-Length: " << size << "\r\n\r\n";
             } else {
                 *this << "\r\n";
             }
@@ -56,9 +56,22 @@ public:
     /// Call after bind().
     void acceptAndRun();
 
+    /// Use fd, a TCP socket bound elsewhere, for instance inherited from another process, instead of binding one.
+    /// Returns its port. Call before acceptAndRun().
+    unsigned short assign(int fd);
+
     ///@brief Start the server by calling bind and acceptAndRun()
     void start();
 
+    ///@brief Stop accepting new connections but keep the socket open, connecting clients queue up in its backlog
+    void stopAccepting() noexcept;
+
+    ///@brief Descriptor of the listening socket, -1 before bind()
+    int nativeHandle() noexcept
+    {
+        return m_acceptor ? m_acceptor->native_handle() : -1;
+    }
+
     ///@brief Stop accepting new requests, and close current connections.
     void stop() noexcept;
 
@@ -87,7 +87,7 @@ unsigned short ServerBase<SocketType>::bind()
         m_internalIoService = true;
     }
 
-    if (m_acceptor) {
+    if (!m_acceptor) {
         m_acceptor = std::unique_ptr<asio::ip::tcp::acceptor>(new asio::ip::tcp::acceptor(*m_ioService));
     }
     m_acceptor->open(endpoint.protocol());
@@ -98,6 +98,38 @@ unsigned short ServerBase<SocketType>::bind()
     return m_acceptor->local_endpoint().port();
 }
 
+template <typename SocketType>
+unsigned short ServerBase<SocketType>::assign(int fd)
+{
+    sockaddr_storage address;
+    socklen_t length = sizeof(address);
+    if (getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length) == -1) {
+        throw boost::system::system_error(error_code(errno, boost::system::system_category()));
+    }
+
+    if (!m_ioService) {
+        m_ioService = std::make_shared<asio::io_service>();
+        m_internalIoService = true;
+    }
+
+    if (!m_acceptor) {
+        m_acceptor = std::unique_ptr<asio::ip::tcp::acceptor>(new asio::ip::tcp::acceptor(*m_ioService));
+    }
+    m_acceptor->assign(address.ss_family == AF_INET6 ? asio::ip::tcp::v6() : asio::ip::tcp::v4(), fd);
+
+    afterBind();
+    return m_acceptor->local_endpoint().port();
+}
+
+template <typename SocketType>
+void ServerBase<SocketType>::stopAccepting() noexcept
+{
+    if (m_acceptor) {
+        error_code ec;
+        m_acceptor->cancel(ec);
+    }
+}
+
 template <typename SocketType>
 template <typename... Args>
 auto ServerBase<SocketType>::createConnection(Args&&... args) noexcept -> ConnectionPtr
@@ -127,7 +159,7 @@ void ServerBase<SocketType>::read(const SessionPtr& session)
 {
     session->m_connection->set_timeout(m_config.m_timeoutRequest);
     asio::async_read_until(*session->m_connection->m_socket,
-        session->m_request->m_streambuf, "\r\n\r\b",
+        session->m_request->m_streambuf, "\r\n\r\n",
         [this, session](const error_code& ec, size_t bytesTransferred) {
             session->m_connection->cancel_timeout();
             auto lock = session->m_connection->m_handlerRunner->continue_lock();
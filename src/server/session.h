@@ -15,7 +15,7 @@ public:
     Session(size_t maxRequestStreambufSize, std::shared_ptr<Connection<SocketType> > connection) noexcept
         : m_connection(std::move(connection))
         {
-            if (m_connection->m_remoteEndpoint) {
+            if (!m_connection->m_remoteEndpoint) {
                 error_code ec;
                 m_connection->m_remoteEndpoint = std::make_shared<asio::ip::tcp::endpoint>(
                         m_connection->m_socket->lowest_layer().remote_endpoint(ec));
@@ -0,0 +1,169 @@
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+#include "checksum.h"
+
+namespace transfer {
+
+namespace {
+
+///@brief Reflected Castagnoli polynomial
+const uint32_t s_polynomial = 0x82f63b78;
+
+///@brief Slicing-by-8 tables, s_tables[0] is the classic byte table
+struct Tables
+{
+    uint32_t m_table[8][256];
+
+    Tables() noexcept
+    {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = crc & 1 ? (crc >> 1) ^ s_polynomial : crc >> 1;
+            }
+            m_table[0][i] = crc;
+        }
+        for (uint32_t i = 0; i < 256; ++i) {
+            for (int slice = 1; slice < 8; ++slice) {
+                uint32_t previous = m_table[slice - 1][i];
+                m_table[slice][i] = (previous >> 8) ^ m_table[0][previous & 0xff];
+            }
+        }
+    }
+};
+
+const Tables s_tables;
+
+uint32_t software(uint32_t crc, const unsigned char* data, size_t size) noexcept
+{
+    const auto& t = s_tables.m_table;
+    for (; size >= 8; data += 8, size -= 8) {
+        uint32_t low;
+        uint32_t high;
+        memcpy(&low, data, sizeof(low));
+        memcpy(&high, data + 4, sizeof(high));
+        low ^= crc;
+        crc = t[7][low & 0xff] ^ t[6][(low >> 8) & 0xff] ^ t[5][(low >> 16) & 0xff] ^ t[4][low >> 24] ^
+              t[3][high & 0xff] ^ t[2][(high >> 8) & 0xff] ^ t[1][(high >> 16) & 0xff] ^ t[0][high >> 24];
+    }
+    for (; size > 0; ++data, --size) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *data) & 0xff];
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+uint32_t hardware(uint32_t crc, const unsigned char* data, size_t size) noexcept
+{
+    uint64_t crc64 = crc;
+    for (; size >= 8; data += 8, size -= 8) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = static_cast<uint32_t>(crc64);
+    for (; size > 0; ++data, --size) {
+        crc = _mm_crc32_u8(crc, *data);
+    }
+    return crc;
+}
+
+const bool s_accelerated = __builtin_cpu_supports("sse4.2");
+#else
+const bool s_accelerated = false;
+#endif
+
+///@brief GF(2) 32x32 matrix times vector, see zlib's crc32_combine
+uint32_t times(const uint32_t* matrix, uint32_t vector) noexcept
+{
+    uint32_t sum = 0;
+    for (; vector != 0; vector >>= 1, ++matrix) {
+        if (vector & 1) {
+            sum ^= *matrix;
+        }
+    }
+    return sum;
+}
+
+void square(uint32_t* result, const uint32_t* matrix) noexcept
+{
+    for (int n = 0; n < 32; ++n) {
+        result[n] = times(matrix, matrix[n]);
+    }
+}
+
+} // unnamed namespace
+
+uint32_t crc32c(uint32_t crc, const void* data, size_t size) noexcept
+{
+    auto bytes = static_cast<const unsigned char*>(data);
+#if defined(__x86_64__)
+    if (s_accelerated) {
+        return ~hardware(~crc, bytes, size);
+    }
+#endif
+    return ~software(~crc, bytes, size);
+}
+
+uint32_t crc32cCombine(uint32_t first, uint32_t second, uint64_t secondSize) noexcept
+{
+    if (secondSize == 0) {
+        return first;
+    }
+    ///@brief Operators appending one zero bit (odd) and then two, four, ... zero bits (even)
+    uint32_t even[32];
+    uint32_t odd[32];
+    odd[0] = s_polynomial;
+    for (int n = 1; n < 32; ++n) {
+        odd[n] = 1u << (n - 1);
+    }
+    square(even, odd);
+    square(odd, even);
+    ///@brief Append secondSize zero bytes to first, then add second
+    do {
+        square(even, odd);
+        if (secondSize & 1) {
+            first = times(even, first);
+        }
+        secondSize >>= 1;
+        if (secondSize == 0) {
+            break;
+        }
+        square(odd, even);
+        if (secondSize & 1) {
+            first = times(odd, first);
+        }
+        secondSize >>= 1;
+    } while (secondSize != 0);
+    return first ^ second;
+}
+
+bool crc32cAccelerated() noexcept
+{
+    return s_accelerated;
+}
+
+uint64_t nameHash(const std::string& name) noexcept
+{
+    ///@brief FNV-1a, then mixed as its low bits are weak
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (unsigned char c : name) {
+        hash = (hash ^ c) * 0x100000001b3ull;
+    }
+    return mixHash(hash);
+}
+
+uint64_t mixHash(uint64_t value) noexcept
+{
+    value += 0x9e3779b97f4a7c15ull;
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+    return value ^ (value >> 31);
+}
+
+} // namespace transfer
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace transfer {
+
+/**
+ * @brief CRC32C (Castagnoli) of size bytes continuing crc, 0 starts a new checksum.
+ * Uses the SSE4.2 crc32 instruction when the CPU has it, slicing-by-8 tables otherwise.
+ */
+uint32_t crc32c(uint32_t crc, const void* data, size_t size) noexcept;
+
+///@brief Checksum of two blocks one after the other from the checksums of both and the size of the second
+uint32_t crc32cCombine(uint32_t first, uint32_t second, uint64_t secondSize) noexcept;
+
+///@brief true if crc32c() runs on the SSE4.2 instruction
+bool crc32cAccelerated() noexcept;
+
+///@brief Well mixed 64 bit hash of a name, the same on every host and build, unlike std::hash
+uint64_t nameHash(const std::string& name) noexcept;
+
+///@brief Finalizer of nameHash(), spreads value over all 64 bits
+uint64_t mixHash(uint64_t value) noexcept;
+
+} // namespace transfer
@@ -0,0 +1,288 @@
+#include <unistd.h>
+#include <zlib.h>
+#ifdef DAEMON_HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include <cerrno>
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "checksum.h"
+#include "compressor.h"
+#include "threadpool.h"
+#include "throttle.h"
+
+namespace transfer {
+
+namespace {
+
+///@brief Bytes which grow on demand and are never cleared, every use overwrites what it reads
+class Buffer
+{
+public:
+    ///@brief At least size bytes, the contents are undefined
+    unsigned char* reserve(size_t size)
+    {
+        if (size > m_size) {
+            m_data.reset(new unsigned char[size]);
+            m_size = size;
+        }
+        return m_data.get();
+    }
+
+    unsigned char* data() const noexcept
+    {
+        return m_data.get();
+    }
+
+private:
+    std::unique_ptr<unsigned char[]> m_data;
+    size_t m_size = 0;
+};
+
+///@brief One block on its way through the pipeline
+struct Block
+{
+    Buffer m_input;
+    Buffer m_output;
+    size_t m_inputSize = 0;
+    size_t m_outputSize = 0;
+    uint32_t m_crc = 0;
+    bool m_ready = false;
+    int m_error = 0;
+};
+
+///@brief Compress the input of block into a self-contained gzip member
+int gzipBlock(Block& block, int level) noexcept
+{
+    z_stream stream = {};
+    if (deflateInit2(&stream, level == 0 ? Z_DEFAULT_COMPRESSION : level, Z_DEFLATED, 15 + 16, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        return ENOMEM;
+    }
+    int ret = Z_MEM_ERROR;
+    try {
+        auto bound = deflateBound(&stream, static_cast<uLong>(block.m_inputSize));
+        stream.next_out = block.m_output.reserve(bound);
+        stream.avail_out = static_cast<uInt>(bound);
+        stream.next_in = block.m_input.data();
+        stream.avail_in = static_cast<uInt>(block.m_inputSize);
+        ret = deflate(&stream, Z_FINISH);
+        block.m_outputSize = stream.total_out;
+    } catch (const std::exception&) {
+    }
+    deflateEnd(&stream);
+    return ret == Z_STREAM_END ? 0 : ret == Z_MEM_ERROR ? ENOMEM : EIO;
+}
+
+int zstdBlock(Block& block, int level) noexcept
+{
+#ifdef DAEMON_HAVE_ZSTD
+    auto bound = ZSTD_compressBound(block.m_inputSize);
+    try {
+        block.m_output.reserve(bound);
+    } catch (const std::exception&) {
+        return ENOMEM;
+    }
+    auto size = ZSTD_compress(block.m_output.data(), bound, block.m_input.data(), block.m_inputSize,
+                              level == 0 ? ZSTD_CLEVEL_DEFAULT : level);
+    if (ZSTD_isError(size)) {
+        return EIO;
+    }
+    block.m_outputSize = size;
+    return 0;
+#else
+    (void)block;
+    (void)level;
+    return ENOTSUP;
+#endif
+}
+
+///@brief Read block index of in, compress it and checksum the input if asked to
+int fill(int in, off_t size, size_t index, Compression compression, int level, bool checksum, Block& block) noexcept
+{
+    auto begin = static_cast<off_t>(index * s_compressionBlock);
+    block.m_inputSize = static_cast<size_t>(std::min<off_t>(size - begin, s_compressionBlock));
+    ///@brief A small file only takes what it needs, a slot keeps its buffer for the blocks that follow
+    try {
+        block.m_input.reserve(block.m_inputSize);
+    } catch (const std::exception&) {
+        return ENOMEM;
+    }
+    for (size_t done = 0; done < block.m_inputSize; ) {
+        auto count = pread(in, block.m_input.data() + done, block.m_inputSize - done, begin + static_cast<off_t>(done));
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return count == 0 ? EIO : errno; // the source shrank under us
+        }
+        done += static_cast<size_t>(count);
+    }
+    block.m_crc = checksum ? crc32c(0, block.m_input.data(), block.m_inputSize) : 0;
+    return compression == Compression::Zstd ? zstdBlock(block, level) : gzipBlock(block, level);
+}
+
+int writeAll(int out, const unsigned char* data, size_t size) noexcept
+{
+    for (size_t done = 0; done < size; ) {
+        auto ret = write(out, data + done, size - done);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        done += static_cast<size_t>(ret);
+    }
+    return 0;
+}
+
+} // unnamed namespace
+
+const char* compressionSuffix(Compression compression) noexcept
+{
+    switch (compression) {
+    case Compression::None:
+        return "";
+    case Compression::Gzip:
+        return ".gz";
+    case Compression::Zstd:
+        return ".zst";
+    }
+    return "";
+}
+
+bool compressionAvailable(Compression compression) noexcept
+{
+#ifdef DAEMON_HAVE_ZSTD
+    return true;
+#else
+    return compression != Compression::Zstd;
+#endif
+}
+
+void compressionLevels(Compression compression, int& lowest, int& highest) noexcept
+{
+    lowest = 0;
+    highest = 0;
+    if (compression == Compression::Gzip) {
+        lowest = Z_BEST_SPEED;
+        highest = Z_BEST_COMPRESSION;
+    }
+#ifdef DAEMON_HAVE_ZSTD
+    if (compression == Compression::Zstd) {
+        lowest = ZSTD_minCLevel();
+        highest = ZSTD_maxCLevel();
+    }
+#endif
+}
+
+int compressData(int in, int out, off_t size, Compression compression, int level, unsigned workers,
+                 Progress* progress, ThreadPool* pool) noexcept
+{
+    if (!compressionAvailable(compression) || compression == Compression::None) {
+        return ENOTSUP;
+    }
+    bool checksum = progress != nullptr && progress->m_checksum;
+    Throttle* throttle = progress == nullptr ? nullptr : progress->m_throttle;
+    uint32_t crc = 0;
+    ///@brief An empty file still becomes one valid, empty member
+    size_t blocks = std::max<size_t>(1, static_cast<size_t>((size + s_compressionBlock - 1) / s_compressionBlock));
+    workers = static_cast<unsigned>(std::min<size_t>(std::max(workers, 1u), blocks));
+    auto emit = [&] (Block& block) {
+        crc = crc32cCombine(crc, block.m_crc, block.m_inputSize);
+        int err = writeAll(out, block.m_output.data(), block.m_outputSize);
+        if (err == 0 && throttle != nullptr) {
+            throttle->bytes(block.m_inputSize);
+        }
+        return err;
+    };
+
+    int error = 0;
+    if (workers == 1) {
+        Block block;
+        for (size_t i = 0; i < blocks && error == 0; ++i) {
+            error = fill(in, size, i, compression, level, checksum, block);
+            if (error == 0) {
+                error = emit(block);
+            }
+        }
+    } else {
+        ///@brief Workers run at most window blocks ahead of the writer, each block has its slot
+        const size_t window = 2 * workers;
+        std::vector<Block> slots;
+        std::unique_ptr<Helpers> helpers;
+        std::mutex mutex;
+        std::condition_variable changed;
+        size_t next = 0;
+        size_t written = 0;
+        bool stop = false;
+        auto worker = [&] (unsigned) {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                changed.wait(lock, [&] () {
+                    return stop || next >= blocks || next < written + window;
+                });
+                if (stop || next >= blocks) {
+                    return;
+                }
+                auto index = next++;
+                auto& block = slots[index % window];
+                lock.unlock();
+                int err = fill(in, size, index, compression, level, checksum, block);
+                lock.lock();
+                block.m_error = err;
+                block.m_ready = true;
+                changed.notify_all();
+            }
+        };
+        try {
+            slots.resize(window);
+            helpers.reset(new Helpers(pool, workers, worker));
+        } catch (const std::exception&) {
+            error = ENOMEM;
+        }
+        for (size_t i = 0; i < blocks && error == 0; ++i) {
+            auto& block = slots[i % window];
+            bool claimed = false;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ///@brief No worker took the block yet, compressing it beats waiting for one to come free
+                if (next == i) {
+                    ++next;
+                    claimed = true;
+                } else {
+                    changed.wait(lock, [&block] () {
+                        return block.m_ready;
+                    });
+                }
+            }
+            if (claimed) {
+                block.m_error = fill(in, size, i, compression, level, checksum, block);
+            }
+            error = block.m_error != 0 ? block.m_error : emit(block);
+            std::unique_lock<std::mutex> lock(mutex);
+            block.m_ready = false;
+            ++written;
+            changed.notify_all();
+        }
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            stop = true;
+            changed.notify_all();
+        }
+        if (helpers) {
+            helpers->cancel();
+        }
+    }
+    if (error == 0 && checksum) {
+        progress->m_crc = crc;
+    }
+    return error;
+}
+
+} // namespace transfer
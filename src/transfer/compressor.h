@@ -0,0 +1,36 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include "copier.h"
+#include "options.h"
+
+namespace transfer {
+
+///@brief Suffix a compressed file is stored under, empty for Compression::None
+const char* compressionSuffix(Compression compression) noexcept;
+
+///@brief false if the daemon was built without the library of compression
+bool compressionAvailable(Compression compression) noexcept;
+
+///@brief Levels the library of compression accepts; level 0 always stands for its default
+void compressionLevels(Compression compression, int& lowest, int& highest) noexcept;
+
+/**
+ * @brief Compress the first size bytes of in into out, which is written from its
+ * start. The input is cut into blocks of s_compressionBlock bytes and every block
+ * becomes a gzip member or zstd frame of its own; concatenated they form one valid
+ * stream. Files of more than one block are compressed by up to workers helpers
+ * lent by pool while the calling thread writes the blocks in order, compressing
+ * a block itself when no helper took it yet. progress paces the input
+ * and receives the CRC32C of the input if it asks for a checksum; checkpoints and
+ * resume offsets do not apply to compressed output.
+ * @return 0 on success or the errno of the failed call, EIO if the library failed
+ */
+int compressData(int in, int out, off_t size, Compression compression, int level, unsigned workers,
+                 Progress* progress = nullptr, ThreadPool* pool = nullptr) noexcept;
+
+///@brief Input bytes per gzip member or zstd frame
+const size_t s_compressionBlock = 4 << 20;
+
+} // namespace transfer
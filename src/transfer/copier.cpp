@@ -0,0 +1,440 @@
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <linux/fs.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "checksum.h"
+#include "copier.h"
+#include "threadpool.h"
+#include "throttle.h"
+
+namespace transfer {
+
+namespace {
+
+const size_t s_bufferSize = 4 << 20;
+const size_t s_bufferAlignment = 4096;
+///@brief Bytes per in-kernel copy call, large enough to amortise the call
+const size_t s_kernelChunk = 64 << 20;
+
+///@brief Ranges are never smaller than this and aligned to it
+const off_t s_rangeAlignment = 8 << 20;
+///@brief Ranges per worker, more than one so that workers finishing early pick up more
+const off_t s_rangesPerWorker = 4;
+
+///@brief errno values meaning the strategy is not available for this pair of files
+bool unsupported(int error) noexcept
+{
+    return error == EXDEV || error == EINVAL || error == ENOSYS ||
+        error == EOPNOTSUPP || error == ENOTTY || error == EBADF || error == EPERM;
+}
+
+struct FreeDeleter
+{
+    void operator()(char* ptr) const noexcept
+    {
+        std::free(ptr);
+    }
+};
+
+///@brief One buffer per thread, allocated on first use and reused afterwards
+char* threadBuffer() noexcept
+{
+    thread_local std::unique_ptr<char, FreeDeleter> buffer;
+    if (!buffer) {
+        void* ptr = nullptr;
+        if (posix_memalign(&ptr, s_bufferAlignment, s_bufferSize) != 0) {
+            return nullptr;
+        }
+        buffer.reset(static_cast<char*>(ptr));
+    }
+    return buffer.get();
+}
+
+///@brief Syncs the destination and reports a checkpoint every Progress::m_interval bytes
+class Checkpoints
+{
+public:
+    Checkpoints(int out, Progress* progress) noexcept
+        : m_out(out)
+        , m_progress(progress)
+        , m_last(progress == nullptr ? 0 : progress->m_offset)
+    {
+    }
+
+    void reached(off_t offset) noexcept
+    {
+        if (m_progress == nullptr || m_progress->m_interval <= 0 || !m_progress->m_checkpoint ||
+                offset - m_last < m_progress->m_interval) {
+            return;
+        }
+        if (fdatasync(m_out) == 0) {
+            m_last = offset;
+            try {
+                m_progress->m_checkpoint(offset);
+            } catch (const std::exception&) {
+                ///@brief A lost checkpoint only means a longer resume
+            }
+        }
+    }
+
+private:
+    int m_out;
+    Progress* m_progress;
+    off_t m_last;
+};
+
+///@brief Bytes the next copy call may move
+size_t allowance(const Throttle* throttle, size_t wanted) noexcept
+{
+    return throttle == nullptr ? wanted : throttle->chunk(wanted);
+}
+
+///@brief Account copied bytes, sleeping while the throttle is in debt
+void pace(Throttle* throttle, ssize_t count) noexcept
+{
+    if (throttle != nullptr) {
+        throttle->bytes(static_cast<uint64_t>(count));
+    }
+}
+
+///@brief -1 if the strategy is unsupported, otherwise 0 or the errno of the failure
+int copyFileRange(int in, int out, off_t& done, Checkpoints& checkpoints, Throttle* throttle) noexcept
+{
+    const off_t start = done;
+    while (true) {
+        off_t inOffset = done;
+        off_t outOffset = done;
+        auto count = copy_file_range(in, &inOffset, out, &outOffset, allowance(throttle, s_kernelChunk), 0);
+        if (count > 0) {
+            done += count;
+            checkpoints.reached(done);
+            pace(throttle, count);
+        } else if (count == 0) {
+            return 0;
+        } else if (errno != EINTR) {
+            return done == start && unsupported(errno) ? -1 : errno;
+        }
+    }
+}
+
+int sendFile(int in, int out, off_t& done, Checkpoints& checkpoints, Throttle* throttle) noexcept
+{
+    const off_t start = done;
+    if (lseek(out, done, SEEK_SET) == -1) {
+        return errno;
+    }
+    while (true) {
+        off_t offset = done;
+        auto count = sendfile(out, in, &offset, allowance(throttle, s_kernelChunk));
+        if (count > 0) {
+            done += count;
+            checkpoints.reached(done);
+            pace(throttle, count);
+        } else if (count == 0) {
+            return 0;
+        } else if (errno != EINTR) {
+            return done == start && unsupported(errno) ? -1 : errno;
+        }
+    }
+}
+
+int buffered(int in, int out, off_t& done, Checkpoints& checkpoints, Throttle* throttle, uint32_t* crc) noexcept
+{
+    char* buffer = threadBuffer();
+    if (buffer == nullptr) {
+        return ENOMEM;
+    }
+    posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+    while (true) {
+        auto count = pread(in, buffer, allowance(throttle, s_bufferSize), done);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        if (count == 0) {
+            return 0;
+        }
+        if (crc != nullptr) {
+            *crc = crc32c(*crc, buffer, static_cast<size_t>(count));
+        }
+        for (ssize_t written = 0; written < count; ) {
+            auto ret = pwrite(out, buffer + written, static_cast<size_t>(count - written), done + written);
+            if (ret < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return errno;
+            }
+            written += ret;
+        }
+        done += count;
+        checkpoints.reached(done);
+        pace(throttle, count);
+    }
+}
+
+/**
+ * @brief Copy [begin, end) with explicit offsets, safe to run concurrently on the same
+ * descriptors. A checksum is only possible with a buffered copy, which crc forces.
+ */
+int copyRange(int in, int out, off_t begin, off_t end, bool& buffered, Throttle* throttle, uint32_t* crc) noexcept
+{
+    buffered = buffered || crc != nullptr;
+    while (begin < end && !buffered) {
+        off_t inOffset = begin;
+        off_t outOffset = begin;
+        auto count = copy_file_range(in, &inOffset, out, &outOffset,
+                                     allowance(throttle, static_cast<size_t>(end - begin)), 0);
+        if (count > 0) {
+            begin += count;
+            pace(throttle, count);
+        } else if (count == 0) {
+            return EIO; // the source shrank under us
+        } else if (unsupported(errno)) {
+            buffered = true;
+        } else if (errno != EINTR) {
+            return errno;
+        }
+    }
+    char* buffer = threadBuffer();
+    if (begin < end && buffer == nullptr) {
+        return ENOMEM;
+    }
+    while (begin < end) {
+        auto count = pread(in, buffer, allowance(throttle, std::min<size_t>(s_bufferSize, static_cast<size_t>(end - begin))), begin);
+        if (count <= 0) {
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            return count == 0 ? EIO : errno;
+        }
+        if (crc != nullptr) {
+            *crc = crc32c(*crc, buffer, static_cast<size_t>(count));
+        }
+        for (ssize_t written = 0; written < count; ) {
+            auto ret = pwrite(out, buffer + written, static_cast<size_t>(count - written), begin + written);
+            if (ret < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return errno;
+            }
+            written += ret;
+        }
+        begin += count;
+        pace(throttle, count);
+    }
+    return 0;
+}
+
+/**
+ * @brief Split the data extents of in from pos on into ranges of at most rangeSize bytes,
+ * with holes unless they are needed for a checksum of the whole file
+ */
+std::vector<std::pair<off_t, off_t> > dataRanges(int in, off_t pos, off_t size, off_t rangeSize, bool holes)
+{
+    std::vector<std::pair<off_t, off_t> > ranges;
+    if (holes) {
+        for (off_t begin = pos; begin < size; begin += rangeSize) {
+            ranges.emplace_back(begin, std::min(size, begin + rangeSize));
+        }
+        return ranges;
+    }
+    while (pos < size) {
+        off_t data = lseek(in, pos, SEEK_DATA);
+        off_t hole = size;
+        if (data == -1 && errno == ENXIO) {
+            break; // only a hole is left
+        } else if (data == -1) {
+            data = pos; // no hole support, copy everything
+        } else {
+            hole = lseek(in, data, SEEK_HOLE);
+        }
+        if (hole == -1 || hole > size) {
+            hole = size;
+        }
+        for (off_t begin = data; begin < hole; begin += rangeSize) {
+            ranges.emplace_back(begin, std::min(hole, begin + rangeSize));
+        }
+        pos = hole;
+    }
+    return ranges;
+}
+
+} // unnamed namespace
+
+const char* strategyName(Strategy strategy) noexcept
+{
+    switch (strategy) {
+    case Strategy::None:
+        return "none";
+    case Strategy::Reflink:
+        return "reflink";
+    case Strategy::CopyFileRange:
+        return "copy_file_range";
+    case Strategy::Sendfile:
+        return "sendfile";
+    case Strategy::Splice:
+        return "splice";
+    case Strategy::Buffered:
+        return "buffered";
+    case Strategy::Gzip:
+        return "gzip";
+    case Strategy::Zstd:
+        return "zstd";
+    }
+    return "unknown";
+}
+
+bool reflink(int in, int out) noexcept
+{
+    return ioctl(out, FICLONE, in) == 0;
+}
+
+int copyData(int in, int out, Strategy& strategy, Progress* progress) noexcept
+{
+    bool checksum = progress != nullptr && progress->m_checksum;
+    strategy = Strategy::Reflink;
+    if (reflink(in, out)) {
+        if (checksum) {
+            progress->m_crc = 0;
+            return checksumRange(in, 0, -1, progress->m_crc);
+        }
+        return 0;
+    }
+    off_t done = progress == nullptr ? 0 : progress->m_offset;
+    Throttle* throttle = progress == nullptr ? nullptr : progress->m_throttle;
+    Checkpoints checkpoints(out, progress);
+    if (checksum) {
+        ///@brief The in-kernel copies never show the bytes, a buffered copy checksums them on the way
+        strategy = Strategy::Buffered;
+        progress->m_crc = 0;
+        int ret = checksumRange(in, 0, done, progress->m_crc);
+        return ret != 0 ? ret : buffered(in, out, done, checkpoints, throttle, &progress->m_crc);
+    }
+    strategy = Strategy::CopyFileRange;
+    int ret = copyFileRange(in, out, done, checkpoints, throttle);
+    if (ret != -1) {
+        return ret;
+    }
+    strategy = Strategy::Sendfile;
+    ret = sendFile(in, out, done, checkpoints, throttle);
+    if (ret != -1) {
+        return ret;
+    }
+    strategy = Strategy::Buffered;
+    return buffered(in, out, done, checkpoints, throttle, nullptr);
+}
+
+int copyParallel(int in, int out, off_t size, unsigned workers, Strategy& strategy, Progress* progress,
+                 ThreadPool* pool) noexcept
+{
+    bool checksum = progress != nullptr && progress->m_checksum;
+    strategy = Strategy::Reflink;
+    if (reflink(in, out)) {
+        if (checksum) {
+            progress->m_crc = 0;
+            return checksumRange(in, 0, -1, progress->m_crc);
+        }
+        return 0;
+    }
+    try {
+        workers = std::max(workers, 1u);
+        off_t rangeSize = size / (static_cast<off_t>(workers) * s_rangesPerWorker);
+        rangeSize = std::max(s_rangeAlignment, (rangeSize + s_rangeAlignment - 1) / s_rangeAlignment * s_rangeAlignment);
+        off_t offset = progress == nullptr ? 0 : progress->m_offset;
+        auto ranges = dataRanges(in, offset, size, rangeSize, checksum);
+        std::vector<uint32_t> crcs(checksum ? ranges.size() : 0, 0);
+        ///@brief Sizing the destination first keeps the trailing hole and lets workers write anywhere
+        if (ftruncate(out, size) == -1) {
+            return errno;
+        }
+        std::atomic<size_t> next(0);
+        std::atomic<int> error(0);
+        std::atomic<bool> anyBuffered(false);
+        ///@brief Ranges finish out of order, only the prefix finished without a gap is a checkpoint
+        Checkpoints checkpoints(out, progress);
+        Throttle* throttle = progress == nullptr ? nullptr : progress->m_throttle;
+        std::vector<bool> finished(ranges.size(), false);
+        size_t frontier = 0;
+        std::mutex frontierMutex;
+        auto worker = [&] () {
+            bool buffered = false;
+            for (size_t i = next++; i < ranges.size() && error.load() == 0; i = next++) {
+                int ret = copyRange(in, out, ranges[i].first, ranges[i].second, buffered, throttle,
+                                    checksum ? &crcs[i] : nullptr);
+                if (ret != 0) {
+                    int expected = 0;
+                    error.compare_exchange_strong(expected, ret);
+                    continue;
+                }
+                std::unique_lock<std::mutex> lock(frontierMutex);
+                finished[i] = true;
+                while (frontier < ranges.size() && finished[frontier]) {
+                    ++frontier;
+                }
+                checkpoints.reached(frontier < ranges.size() ? ranges[frontier].first : size);
+            }
+            if (buffered) {
+                anyBuffered = true;
+            }
+        };
+        auto helping = std::min<size_t>(workers, ranges.size());
+        Helpers helpers(pool, static_cast<unsigned>(helping > 1 ? helping - 1 : 0), [&worker] (unsigned) {
+            worker();
+        });
+        worker();
+        helpers.join();
+        strategy = anyBuffered ? Strategy::Buffered : Strategy::CopyFileRange;
+        if (error.load() != 0 || !checksum) {
+            return error.load();
+        }
+        progress->m_crc = 0;
+        int ret = checksumRange(in, 0, offset, progress->m_crc);
+        for (size_t i = 0; i < ranges.size(); ++i) {
+            progress->m_crc = crc32cCombine(progress->m_crc, crcs[i], static_cast<uint64_t>(ranges[i].second - ranges[i].first));
+        }
+        return ret;
+    } catch (const std::exception&) {
+        ///@brief Out of memory or threads, copy serially instead
+        return copyData(in, out, strategy, progress);
+    }
+}
+
+int checksumRange(int fd, off_t begin, off_t end, uint32_t& crc) noexcept
+{
+    char* buffer = threadBuffer();
+    if (buffer == nullptr) {
+        return ENOMEM;
+    }
+    while (end < 0 || begin < end) {
+        auto wanted = end < 0 ? s_bufferSize : std::min<size_t>(s_bufferSize, static_cast<size_t>(end - begin));
+        auto count = pread(fd, buffer, wanted, begin);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        if (count == 0) {
+            return end < 0 ? 0 : EIO;
+        }
+        crc = crc32c(crc, buffer, static_cast<size_t>(count));
+        begin += count;
+    }
+    return 0;
+}
+
+} // namespace transfer
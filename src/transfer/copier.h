@@ -0,0 +1,74 @@
+#pragma once
+
+#include <sys/types.h>
+#include <cstdint>
+#include <functional>
+
+namespace transfer {
+
+class Throttle;
+class ThreadPool;
+
+///@brief How the bytes of a cross-device transfer were copied
+enum class Strategy
+{
+    None,           ///< no data was copied
+    Reflink,        ///< ioctl(FICLONE), the destination shares the source extents
+    CopyFileRange,  ///< copy_file_range, in-kernel copy or server side copy
+    Sendfile,       ///< sendfile, in-kernel copy through the page cache
+    Splice,         ///< io_uring splice chain through a pipe
+    Buffered,       ///< read/write through an aligned user space buffer
+    Gzip,           ///< compressed into gzip members
+    Zstd            ///< compressed into zstd frames
+};
+
+const char* strategyName(Strategy strategy) noexcept;
+
+///@brief Make out share the extents of in, false if the file systems can not do it
+bool reflink(int in, int out) noexcept;
+
+///@brief Resume point, checkpoint sink and pacing of a long copy
+struct Progress
+{
+    ///@brief Bytes already in the destination, the copy continues after them
+    off_t m_offset = 0;
+    ///@brief Bytes copied between two checkpoints, 0 disables checkpoints
+    off_t m_interval = 0;
+    ///@brief Called with an offset once every byte of the destination before it was synced
+    std::function<void(off_t)> m_checkpoint;
+    ///@brief Paces the copy, nullptr for full speed
+    Throttle* m_throttle = nullptr;
+    ///@brief Checksum the source while it is copied, which keeps the bytes in user space
+    bool m_checksum = false;
+    ///@brief CRC32C of the whole source, set by a successful copy with m_checksum
+    uint32_t m_crc = 0;
+};
+
+/**
+ * @brief Copy in to out from progress->m_offset (0 without progress) up to end of
+ * file. The cheapest strategy is tried first: reflink, copy_file_range, sendfile,
+ * buffered read/write. A strategy the kernel or file systems do not support is
+ * skipped without side effects. With Progress::m_checksum the data is copied
+ * buffered and checksummed in the same pass, a reflink or a resumed prefix is
+ * read once more for its checksum.
+ * @return 0 on success or the errno of the failed call
+ */
+int copyData(int in, int out, Strategy& strategy, Progress* progress = nullptr) noexcept;
+
+/**
+ * @brief Copy a large file of the given size with several workers, each copying
+ * its own ranges with copy_file_range or pread/pwrite. Only the data extents
+ * reported by SEEK_DATA/SEEK_HOLE are copied, so holes of sparse files are kept.
+ * A reflink is tried first as it makes the copy unnecessary. Checkpoints report
+ * the end of the ranges finished without a gap. With Progress::m_checksum holes
+ * are copied as data and the checksums of the ranges are combined. The workers
+ * besides the calling thread are lent by pool, without one it copies alone.
+ * @return 0 on success or the errno of the first failed call
+ */
+int copyParallel(int in, int out, off_t size, unsigned workers, Strategy& strategy,
+                 Progress* progress = nullptr, ThreadPool* pool = nullptr) noexcept;
+
+///@brief Continue crc with the CRC32C of [begin, end) of fd, end < 0 reads to the end of file; 0 or an errno
+int checksumRange(int fd, off_t begin, off_t end, uint32_t& crc) noexcept;
+
+} // namespace transfer
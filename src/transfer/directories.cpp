@@ -0,0 +1,79 @@
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+
+#include "directories.h"
+
+namespace transfer {
+
+Directories::Directories(const std::string& source, const std::vector<std::string>& destinations)
+{
+    m_srcFd = open(source.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (m_srcFd == -1) {
+        m_error = errno;
+        return;
+    }
+    for (const auto& path : destinations) {
+        Destination destination;
+        destination.m_path = path;
+        destination.m_fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (destination.m_fd == -1 && m_error == 0) {
+            m_error = errno;
+        }
+        m_destinations.push_back(std::move(destination));
+    }
+}
+
+Directories::~Directories()
+{
+    if (m_srcFd != -1) {
+        close(m_srcFd);
+    }
+    for (const auto& destination : m_destinations) {
+        if (destination.m_fd != -1) {
+            close(destination.m_fd);
+        }
+    }
+}
+
+int Directories::make(const std::string& destination, const std::string& path)
+{
+    if (!valid()) {
+        return m_error;
+    }
+    ///@brief mkdir is rare, once per directory and cycle, the lock does not need to be finer
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& target : m_destinations) {
+        if (target.m_path == destination) {
+            return makeLocked(target, path);
+        }
+    }
+    return ENOENT;
+}
+
+int Directories::makeLocked(Destination& destination, const std::string& path)
+{
+    if (path.empty() || destination.m_made.count(path) != 0) {
+        return 0;
+    }
+    auto slash = path.rfind('/');
+    if (slash != std::string::npos) {
+        int err = makeLocked(destination, path.substr(0, slash));
+        if (err != 0) {
+            return err;
+        }
+    }
+    struct stat st;
+    mode_t mode = 0755;
+    if (fstatat(m_srcFd, path.c_str(), &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode)) {
+        mode = st.st_mode & 07777;
+    }
+    if (mkdirat(destination.m_fd, path.c_str(), mode) == -1 && errno != EEXIST) {
+        return errno;
+    }
+    destination.m_made.insert(path);
+    return 0;
+}
+
+} // namespace transfer
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace transfer {
+
+/**
+ * @class  Directories
+ * @file   directories.h
+ * @brief  Creates the directories of a destination tree on demand, each one
+ *         once: the first file moved into a subdirectory makes it, with its
+ *         parents and the permission bits of the matching source directory,
+ *         and every later file finds it in the cache. One cache serves all
+ *         movers of a transfer cycle, whichever of the destinations they
+ *         move into; thread safe.
+ */
+class Directories
+{
+public:
+    Directories(const std::string& source, const std::vector<std::string>& destinations);
+    ~Directories();
+
+    Directories(const Directories&) = delete;
+    Directories& operator=(const Directories&) = delete;
+
+    bool valid() const noexcept
+    {
+        return m_srcFd != -1 && m_error == 0;
+    }
+
+    int error() const noexcept
+    {
+        return m_error;
+    }
+
+    /**
+     * @brief Make sure the directory path, relative to destination, exists
+     * @return 0 on success, ENOENT for a destination the cache was not made for
+     * or the errno of the failed mkdir
+     */
+    int make(const std::string& destination, const std::string& path);
+
+private:
+    struct Destination
+    {
+        std::string m_path;
+        int m_fd = -1;
+        std::unordered_set<std::string> m_made;
+    };
+
+    int makeLocked(Destination& destination, const std::string& path);
+
+private:
+    int m_srcFd = -1;
+    int m_error = 0;
+    std::mutex m_mutex;
+    std::vector<Destination> m_destinations;
+};
+
+} // namespace transfer
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mover.h"
+#include "placement.h"
+#include "statbatch.h"
+
+namespace transfer {
+
+/**
+ * @class  FanOut
+ * @file   fanout.h
+ * @brief  Spreads one source catalogue over several destination catalogues.
+ *         Holds one mover M per destination, all reading the same source, and
+ *         offers the interface of a single mover: every batch is stat'ed, each
+ *         file routed by the Placement shared by all transfers of the job and
+ *         the files of each destination moved as one batch by its mover.
+ *         Not thread safe, like the movers it holds.
+ */
+template <typename M>
+class FanOut
+{
+public:
+    ///@brief movers[i] moves into destination i of placement
+    FanOut(std::vector<std::unique_ptr<M> > movers, Placement& placement)
+        : m_movers(std::move(movers))
+        , m_placement(placement)
+        , m_groups(m_movers.size())
+        , m_bytes(m_movers.size())
+    {
+    }
+
+    bool valid() const noexcept
+    {
+        for (const auto& mover : m_movers) {
+            if (!mover->valid()) {
+                return false;
+            }
+        }
+        return !m_movers.empty();
+    }
+
+    int error() const noexcept
+    {
+        for (const auto& mover : m_movers) {
+            if (mover->error() != 0) {
+                return mover->error();
+            }
+        }
+        return 0;
+    }
+
+    int sourceFd() const noexcept
+    {
+        return m_movers.front()->sourceFd();
+    }
+
+    void scan(const std::function<void(const std::vector<Entry>&)>& consume, const Select& select = Select())
+    {
+        m_movers.front()->scan(consume, select);
+    }
+
+    void moveAll(const Report& report, const Select& select = Select())
+    {
+        scan([this, &report] (const std::vector<Entry>& entries) {
+            for (const auto& result : moveBatch(entries)) {
+                report(result);
+            }
+        }, select);
+    }
+
+    std::vector<Result> moveBatch(const std::vector<Entry>& entries)
+    {
+        std::vector<int> errors;
+        m_statBatch.stat(sourceFd(), entries.size(), [&entries] (size_t i) -> const std::string& {
+            return entries[i].m_name;
+        }, m_stats, errors);
+        for (size_t i = 0; i < m_groups.size(); ++i) {
+            m_groups[i].clear();
+            m_bytes[i] = 0;
+        }
+        ///@brief Whatever could not be stat'ed is routed as empty, its mover reports the error
+        for (size_t i = 0; i < entries.size(); ++i) {
+            uint64_t size = errors[i] == 0 && S_ISREG(m_stats[i].stx_mode) ? m_stats[i].stx_size : 0;
+            auto destination = m_placement.choose(entries[i].m_name, size);
+            m_groups[destination].push_back(entries[i]);
+            m_bytes[destination] += size;
+        }
+        std::vector<Result> results;
+        results.reserve(entries.size());
+        for (size_t i = 0; i < m_groups.size(); ++i) {
+            if (m_groups[i].empty()) {
+                continue;
+            }
+            auto start = Placement::Clock::now();
+            auto moved = m_movers[i]->moveBatch(m_groups[i]);
+            m_placement.finish(i, m_bytes[i], Placement::Clock::now() - start);
+            results.insert(results.end(), moved.begin(), moved.end());
+        }
+        return results;
+    }
+
+    void setJournal(Journal* journal) noexcept
+    {
+        for (auto& mover : m_movers) {
+            mover->setJournal(journal);
+        }
+    }
+
+    void setThrottle(Throttle* throttle) noexcept
+    {
+        for (auto& mover : m_movers) {
+            mover->setThrottle(throttle);
+        }
+    }
+
+    void setManifest(Manifest* manifest) noexcept
+    {
+        for (auto& mover : m_movers) {
+            mover->setManifest(manifest);
+        }
+    }
+
+    void setTraffic(Traffic* traffic) noexcept
+    {
+        for (auto& mover : m_movers) {
+            mover->setTraffic(traffic);
+        }
+    }
+
+    void setPool(ThreadPool* pool) noexcept
+    {
+        for (auto& mover : m_movers) {
+            mover->setPool(pool);
+        }
+    }
+
+    void setDirectories(Directories* directories) noexcept
+    {
+        for (auto& mover : m_movers) {
+            mover->setDirectories(directories);
+        }
+    }
+
+    Directories* directories() const noexcept
+    {
+        return m_movers.front()->directories();
+    }
+
+private:
+    std::vector<std::unique_ptr<M> > m_movers;
+    Placement& m_placement;
+    StatBatch m_statBatch;
+    std::vector<struct statx> m_stats;
+    std::vector<std::vector<Entry> > m_groups;
+    std::vector<uint64_t> m_bytes;
+};
+
+} // namespace transfer
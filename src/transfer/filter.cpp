@@ -0,0 +1,331 @@
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <deque>
+#include <limits>
+#include <map>
+#include <stdexcept>
+
+#include "filter.h"
+
+namespace transfer {
+
+void Patterns::add(const std::string& pattern)
+{
+    std::vector<Item> items;
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        Item item;
+        auto c = static_cast<unsigned char>(pattern[i]);
+        if (c == '*') {
+            ///@brief Consecutive stars match what a single one does
+            if (!items.empty() && items.back().m_star) {
+                continue;
+            }
+            item.m_set.set();
+            item.m_star = true;
+        } else if (c == '?') {
+            item.m_set.set();
+        } else if (c == '[') {
+            size_t pos = i + 1;
+            bool negate = pos < pattern.size() && (pattern[pos] == '!' || pattern[pos] == '^');
+            if (negate) {
+                ++pos;
+            }
+            bool closed = false;
+            for (bool first = true; pos < pattern.size(); first = false) {
+                auto from = static_cast<unsigned char>(pattern[pos]);
+                if (from == ']' && !first) {
+                    closed = true;
+                    break;
+                }
+                if (from == '\\' && pos + 1 < pattern.size()) {
+                    from = static_cast<unsigned char>(pattern[++pos]);
+                }
+                auto to = from;
+                if (pos + 2 < pattern.size() && pattern[pos + 1] == '-' && pattern[pos + 2] != ']') {
+                    to = static_cast<unsigned char>(pattern[pos + 2]);
+                    pos += 2;
+                }
+                for (unsigned b = from; b <= to; ++b) {
+                    item.m_set.set(b);
+                }
+                ++pos;
+            }
+            if (!closed) {
+                throw std::invalid_argument("unterminated [ in " + pattern);
+            }
+            if (negate) {
+                item.m_set.flip();
+            }
+            i = pos;
+        } else {
+            if (c == '\\' && i + 1 < pattern.size()) {
+                c = static_cast<unsigned char>(pattern[++i]);
+            }
+            item.m_set.set(c);
+        }
+        items.push_back(item);
+    }
+
+    auto literal = [&items] (size_t from, std::string& text) {
+        for (size_t i = from; i < items.size(); ++i) {
+            if (items[i].m_star || items[i].m_set.count() != 1) {
+                return false;
+            }
+            for (unsigned b = 0; b < 256; ++b) {
+                if (items[i].m_set.test(b)) {
+                    text += static_cast<char>(b);
+                    break;
+                }
+            }
+        }
+        return true;
+    };
+    std::string text;
+    if (items.size() == 1 && items[0].m_star) {
+        m_all = true;
+    } else if (literal(0, text)) {
+        m_exact.insert(text);
+    } else if (items[0].m_star && literal(1, text)) {
+        unsigned node = 0;
+        for (auto it = text.rbegin(); it != text.rend(); ++it) {
+            auto c = static_cast<unsigned char>(*it);
+            auto& children = m_suffixes[node].m_children;
+            auto child = std::find_if(children.begin(), children.end(), [c] (const std::pair<unsigned char, unsigned>& edge) {
+                return edge.first == c;
+            });
+            if (child != children.end()) {
+                node = child->second;
+                continue;
+            }
+            children.emplace_back(c, static_cast<unsigned>(m_suffixes.size()));
+            node = static_cast<unsigned>(m_suffixes.size());
+            m_suffixes.emplace_back();
+        }
+        m_suffixes[node].m_terminal = true;
+    } else {
+        m_globs.push_back(std::move(items));
+    }
+}
+
+void Patterns::compile()
+{
+    m_items.clear();
+    m_offsets.clear();
+    m_final.clear();
+    for (const auto& glob : m_globs) {
+        m_offsets.push_back(static_cast<unsigned>(m_items.size()));
+        m_items.insert(m_items.end(), glob.begin(), glob.end());
+        m_items.emplace_back();
+        m_final.resize(m_items.size(), false);
+        m_final.back() = true;
+    }
+    m_dfa = false;
+    m_table.clear();
+    m_accepting.clear();
+    if (m_globs.empty()) {
+        return;
+    }
+
+    ///@brief Split the bytes into the classes no item tells apart
+    std::fill(std::begin(m_classes), std::end(m_classes), 0);
+    m_classCount = 1;
+    for (const auto& item : m_items) {
+        std::vector<int> split(2 * m_classCount, -1);
+        unsigned count = 0;
+        unsigned char classes[256];
+        for (unsigned b = 0; b < 256; ++b) {
+            auto& id = split[2 * m_classes[b] + (item.m_set.test(b) ? 1 : 0)];
+            if (id == -1) {
+                id = static_cast<int>(count++);
+            }
+            classes[b] = static_cast<unsigned char>(id);
+        }
+        std::copy(std::begin(classes), std::end(classes), std::begin(m_classes));
+        m_classCount = count;
+    }
+    unsigned char representative[256];
+    for (unsigned b = 256; b-- > 0; ) {
+        representative[m_classes[b]] = static_cast<unsigned char>(b);
+    }
+
+    ///@brief Subset construction, given up once the union grows too large
+    StateSet start;
+    for (auto offset : m_offsets) {
+        close(offset, start);
+    }
+    std::sort(start.begin(), start.end());
+    start.erase(std::unique(start.begin(), start.end()), start.end());
+    std::map<StateSet, int> ids;
+    std::deque<StateSet> queue;
+    ids.emplace(start, 0);
+    queue.push_back(start);
+    m_accepting.push_back(accepting(start));
+    m_table.assign(m_classCount, -1);
+    for (int state = 0; !queue.empty(); ++state) {
+        StateSet current = std::move(queue.front());
+        queue.pop_front();
+        for (unsigned c = 0; c < m_classCount; ++c) {
+            auto next = step(current, representative[c]);
+            if (next.empty()) {
+                continue;
+            }
+            auto it = ids.find(next);
+            if (it == ids.end()) {
+                if (ids.size() >= s_maxStates) {
+                    m_table.clear();
+                    m_accepting.clear();
+                    return;
+                }
+                it = ids.emplace(next, static_cast<int>(ids.size())).first;
+                m_accepting.push_back(accepting(next));
+                m_table.resize(m_table.size() + m_classCount, -1);
+                queue.push_back(std::move(next));
+            }
+            m_table[static_cast<size_t>(state) * m_classCount + c] = it->second;
+        }
+    }
+    m_dfa = true;
+}
+
+bool Patterns::matches(const std::string& name) const
+{
+    return m_all || (!m_exact.empty() && m_exact.count(name) != 0) || suffixMatches(name) || globMatches(name);
+}
+
+void Patterns::close(unsigned state, StateSet& set) const
+{
+    set.push_back(state);
+    while (!m_final[state] && m_items[state].m_star) {
+        set.push_back(++state);
+    }
+}
+
+Patterns::StateSet Patterns::step(const StateSet& set, unsigned char byte) const
+{
+    StateSet next;
+    for (auto state : set) {
+        if (m_final[state] || !m_items[state].m_set.test(byte)) {
+            continue;
+        }
+        close(m_items[state].m_star ? state : state + 1, next);
+    }
+    std::sort(next.begin(), next.end());
+    next.erase(std::unique(next.begin(), next.end()), next.end());
+    return next;
+}
+
+bool Patterns::accepting(const StateSet& set) const noexcept
+{
+    return std::any_of(set.begin(), set.end(), [this] (unsigned state) {
+        return m_final[state];
+    });
+}
+
+bool Patterns::suffixMatches(const std::string& name) const noexcept
+{
+    unsigned node = 0;
+    for (auto it = name.rbegin(); it != name.rend(); ++it) {
+        const auto& children = m_suffixes[node].m_children;
+        auto c = static_cast<unsigned char>(*it);
+        auto child = std::find_if(children.begin(), children.end(), [c] (const std::pair<unsigned char, unsigned>& edge) {
+            return edge.first == c;
+        });
+        if (child == children.end()) {
+            return false;
+        }
+        node = child->second;
+        if (m_suffixes[node].m_terminal) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Patterns::globMatches(const std::string& name) const
+{
+    if (m_globs.empty()) {
+        return false;
+    }
+    if (m_dfa) {
+        int state = 0;
+        for (auto c : name) {
+            state = m_table[static_cast<size_t>(state) * m_classCount + m_classes[static_cast<unsigned char>(c)]];
+            if (state < 0) {
+                return false;
+            }
+        }
+        return m_accepting[static_cast<size_t>(state)];
+    }
+    StateSet current;
+    for (auto offset : m_offsets) {
+        close(offset, current);
+    }
+    for (auto c : name) {
+        current = step(current, static_cast<unsigned char>(c));
+        if (current.empty()) {
+            return false;
+        }
+    }
+    return accepting(current);
+}
+
+Filter::Filter(const FilterRules& rules)
+    : m_rules(rules)
+{
+    for (const auto& pattern : m_rules.m_include) {
+        m_include.add(pattern);
+    }
+    for (const auto& pattern : m_rules.m_exclude) {
+        m_exclude.add(pattern);
+    }
+    m_include.compile();
+    m_exclude.compile();
+}
+
+void Filter::select(int dirFd, std::vector<Entry>& entries) const
+{
+    select(dirFd, entries, Reject());
+}
+
+void Filter::select(int dirFd, std::vector<Entry>& entries, const Reject& reject) const
+{
+    auto seconds = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    auto minAge = m_rules.m_minAge.count();
+    auto maxAge = m_rules.m_maxAge.count();
+    size_t kept = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const auto& entry = entries[i];
+        ///@brief Rules are about file names, not the directories of a recursive job
+        auto slash = entry.m_name.rfind('/');
+        if (!matchesName(slash == std::string::npos ? entry.m_name : entry.m_name.substr(slash + 1))) {
+            continue;
+        }
+        if (bounded() && (entry.m_type == DT_REG || entry.m_type == DT_UNKNOWN)) {
+            struct stat st;
+            if (fstatat(dirFd, entry.m_name.c_str(), &st, AT_SYMLINK_NOFOLLOW) == -1) {
+                continue;
+            }
+            auto size = static_cast<uint64_t>(st.st_size);
+            auto age = seconds - st.st_mtim.tv_sec;
+            if (S_ISREG(st.st_mode) && ((m_rules.m_minSize != 0 && size < m_rules.m_minSize) ||
+                                        (m_rules.m_maxSize != 0 && size > m_rules.m_maxSize) ||
+                                        (minAge != 0 && age < minAge) || (maxAge != 0 && age > maxAge))) {
+                if (reject) {
+                    ///@brief Only a file too young gets through by waiting, the other bounds need a change
+                    bool young = minAge != 0 && age < minAge;
+                    reject(entry, st, young ? st.st_mtim.tv_sec + minAge : std::numeric_limits<int64_t>::max());
+                }
+                continue;
+            }
+        }
+        if (kept != i) {
+            entries[kept] = std::move(entries[i]);
+        }
+        ++kept;
+    }
+    entries.resize(kept);
+}
+
+} // namespace transfer
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <sys/stat.h>
+#include <bitset>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "scanner.h"
+
+namespace transfer {
+
+/**
+ * @class  Patterns
+ * @file   filter.h
+ * @brief  Set of shell globs (*, ?, [a-z], [!a-z], \ escapes) compiled for
+ *         matching whole names. Plain names go into a hash set, "*suffix"
+ *         patterns into a trie of reversed suffixes and whatever is left into
+ *         one DFA over byte classes, so a name is matched in a single pass
+ *         however many patterns there are. A union whose DFA would grow past
+ *         s_maxStates is simulated as an NFA instead.
+ */
+class Patterns
+{
+public:
+    ///@brief Add a pattern, throws std::invalid_argument if it is malformed
+    void add(const std::string& pattern);
+
+    ///@brief Build the matcher, to be called once every pattern was added
+    void compile();
+
+    bool empty() const noexcept
+    {
+        return !m_all && m_exact.empty() && m_suffixes.size() == 1 && m_globs.empty();
+    }
+
+    ///@brief true if one of the patterns matches the whole name
+    bool matches(const std::string& name) const;
+
+public:
+    static const size_t s_maxStates = 4096;
+
+private:
+    ///@brief One byte out of m_set, or any number of them with m_star
+    struct Item
+    {
+        std::bitset<256> m_set;
+        bool m_star = false;
+    };
+
+    struct SuffixNode
+    {
+        std::vector<std::pair<unsigned char, unsigned> > m_children;
+        bool m_terminal = false;
+    };
+
+    using StateSet = std::vector<unsigned>;
+
+    ///@brief Add the NFA state and the states a star lets it skip to
+    void close(unsigned state, StateSet& set) const;
+    StateSet step(const StateSet& set, unsigned char byte) const;
+    bool accepting(const StateSet& set) const noexcept;
+    bool suffixMatches(const std::string& name) const noexcept;
+    bool globMatches(const std::string& name) const;
+
+private:
+    bool m_all = false;
+    std::unordered_set<std::string> m_exact;
+    std::vector<SuffixNode> m_suffixes = std::vector<SuffixNode>(1);
+    std::vector<std::vector<Item> > m_globs;
+
+    ///@brief NFA: state of item i of glob g is m_offsets[g] + i, the last state of a glob accepts
+    std::vector<Item> m_items;
+    std::vector<unsigned> m_offsets;
+    std::vector<bool> m_final;
+
+    ///@brief DFA: bytes are mapped to classes which no pattern tells apart, -1 is the dead state
+    unsigned char m_classes[256] = {};
+    unsigned m_classCount = 0;
+    std::vector<int> m_table;
+    std::vector<bool> m_accepting;
+    bool m_dfa = false;
+};
+
+///@brief Which entries of a catalogue a job moves
+struct FilterRules
+{
+    ///@brief Globs of the names to move, every name if empty
+    std::vector<std::string> m_include;
+    ///@brief Globs of the names never to move, they win over m_include
+    std::vector<std::string> m_exclude;
+    ///@brief Size bounds of regular files in bytes, 0 for none
+    uint64_t m_minSize = 0;
+    uint64_t m_maxSize = 0;
+    ///@brief Bounds of the time since the last modification, 0 for none
+    std::chrono::seconds m_minAge = std::chrono::seconds(0);
+    std::chrono::seconds m_maxAge = std::chrono::seconds(0);
+};
+
+/**
+ * @class  Filter
+ * @file   filter.h
+ * @brief  Compiled include/exclude rules of a job. Names are checked first,
+ *         only the regular files they let through are stat'ed, and only if a
+ *         size or age bound is set. Immutable once built, so the transfers of
+ *         a job share it across threads.
+ */
+class Filter
+{
+public:
+    ///@brief Throws std::invalid_argument if a glob is malformed
+    explicit Filter(const FilterRules& rules);
+
+    Filter(const Filter&) = delete;
+    Filter& operator=(const Filter&) = delete;
+
+    ///@brief true if names and bounds let every entry through
+    bool empty() const noexcept
+    {
+        return m_include.empty() && m_exclude.empty() && !bounded();
+    }
+
+    bool matchesName(const std::string& name) const
+    {
+        return (m_include.empty() || m_include.matches(name)) && !m_exclude.matches(name);
+    }
+
+    ///@brief Remove the entries of dirFd the rules do not let through, usable as a Select
+    void select(int dirFd, std::vector<Entry>& entries) const;
+
+    ///@brief Called for the entries a size or age bound turned down, until is when age alone may let it through
+    using Reject = std::function<void(const Entry& entry, const struct stat& st, int64_t until)>;
+
+    ///@brief select() telling reject about the entries turned down by a bound
+    void select(int dirFd, std::vector<Entry>& entries, const Reject& reject) const;
+
+    const FilterRules& rules() const noexcept
+    {
+        return m_rules;
+    }
+
+private:
+    bool bounded() const noexcept
+    {
+        return m_rules.m_minSize != 0 || m_rules.m_maxSize != 0 ||
+               m_rules.m_minAge.count() != 0 || m_rules.m_maxAge.count() != 0;
+    }
+
+private:
+    FilterRules m_rules;
+    Patterns m_include;
+    Patterns m_exclude;
+};
+
+} // namespace transfer
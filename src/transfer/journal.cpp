@@ -0,0 +1,338 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#include "journal.h"
+
+namespace transfer {
+
+namespace {
+
+const char s_magic[] = "DJRNL001";
+const size_t s_magicSize = sizeof(s_magic) - 1;
+
+enum RecordType : unsigned char
+{
+    IntentRecord = 1,
+    CheckpointRecord = 2,
+    DoneRecord = 3
+};
+
+///@brief Record header: body length and checksum of the body
+const size_t s_headerSize = 2 * sizeof(uint32_t);
+///@brief Body prefix: record type and copy id
+const size_t s_prefixSize = 1 + sizeof(uint64_t);
+
+///@brief FNV-1a, enough to tell a torn tail from a complete record
+uint32_t checksum(const char* data, size_t size) noexcept
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+template <typename T>
+void put(std::string& out, T value)
+{
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void putString(std::string& out, const std::string& value)
+{
+    put(out, static_cast<uint32_t>(value.size()));
+    out += value;
+}
+
+///@brief Reads fields from a record body, fails instead of reading past its end
+class Reader
+{
+public:
+    Reader(const char* data, size_t size)
+        : m_data(data)
+        , m_size(size)
+    {
+    }
+
+    template <typename T>
+    bool get(T& value) noexcept
+    {
+        if (m_size - m_pos < sizeof(value)) {
+            return false;
+        }
+        memcpy(&value, m_data + m_pos, sizeof(value));
+        m_pos += sizeof(value);
+        return true;
+    }
+
+    bool getString(std::string& value)
+    {
+        uint32_t size = 0;
+        if (!get(size) || m_size - m_pos < size) {
+            return false;
+        }
+        value.assign(m_data + m_pos, size);
+        m_pos += size;
+        return true;
+    }
+
+private:
+    const char* m_data;
+    size_t m_size;
+    size_t m_pos = 0;
+};
+
+std::string intentPayload(const Intent& intent)
+{
+    std::string payload;
+    put(payload, intent.m_size);
+    put(payload, intent.m_mtime);
+    put(payload, intent.m_offset);
+    putString(payload, intent.m_source);
+    putString(payload, intent.m_destination);
+    putString(payload, intent.m_name);
+    return payload;
+}
+
+std::string record(unsigned char type, uint64_t id, const std::string& payload)
+{
+    std::string body;
+    body.reserve(s_prefixSize + payload.size());
+    put(body, type);
+    put(body, id);
+    body += payload;
+    std::string out;
+    out.reserve(s_headerSize + body.size());
+    put(out, static_cast<uint32_t>(body.size()));
+    put(out, checksum(body.data(), body.size()));
+    out += body;
+    return out;
+}
+
+int writeAll(int fd, const std::string& data) noexcept
+{
+    for (size_t done = 0; done < data.size(); ) {
+        auto ret = write(fd, data.data() + done, data.size() - done);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        done += static_cast<size_t>(ret);
+    }
+    return 0;
+}
+
+///@brief Make a rename inside the directory of path durable
+int syncDirectory(const std::string& path) noexcept
+{
+    auto slash = path.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) {
+        return errno;
+    }
+    int err = fsync(fd) == -1 ? errno : 0;
+    close(fd);
+    return err;
+}
+
+} // unnamed namespace
+
+Journal::Journal(const std::string& path)
+    : m_path(path)
+{
+    m_fd = open(m_path.c_str(), O_RDONLY | O_CREAT | O_CLOEXEC, 0600);
+    if (m_fd == -1) {
+        m_error = errno;
+        return;
+    }
+    replay();
+    close(m_fd);
+    m_fd = -1;
+    ///@brief Start from a file holding the live intents only, which also drops a torn tail
+    m_error = compact();
+}
+
+Journal::~Journal()
+{
+    if (m_fd != -1) {
+        commit();
+        close(m_fd);
+    }
+}
+
+void Journal::replay()
+{
+    std::string data;
+    char chunk[64 << 10];
+    while (true) {
+        auto count = read(m_fd, chunk, sizeof(chunk));
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            break;
+        }
+        data.append(chunk, static_cast<size_t>(count));
+    }
+    if (data.compare(0, s_magicSize, s_magic, s_magicSize) != 0) {
+        return;
+    }
+    for (size_t pos = s_magicSize; data.size() - pos >= s_headerSize; ) {
+        uint32_t size = 0;
+        uint32_t sum = 0;
+        memcpy(&size, data.data() + pos, sizeof(size));
+        memcpy(&sum, data.data() + pos + sizeof(size), sizeof(sum));
+        pos += s_headerSize;
+        ///@brief The record being appended when the daemon died ends the replay
+        if (data.size() - pos < size || size < s_prefixSize || checksum(data.data() + pos, size) != sum) {
+            break;
+        }
+        Reader reader(data.data() + pos, size);
+        pos += size;
+        unsigned char type = 0;
+        uint64_t id = 0;
+        reader.get(type);
+        reader.get(id);
+        m_nextId = std::max(m_nextId, id + 1);
+        if (type == IntentRecord) {
+            Intent intent;
+            intent.m_id = id;
+            if (reader.get(intent.m_size) && reader.get(intent.m_mtime) && reader.get(intent.m_offset) &&
+                    reader.getString(intent.m_source) && reader.getString(intent.m_destination) &&
+                    reader.getString(intent.m_name)) {
+                m_live[id] = std::move(intent);
+            }
+        } else if (type == CheckpointRecord) {
+            auto it = m_live.find(id);
+            if (it != m_live.end()) {
+                reader.get(it->second.m_offset);
+            }
+        } else if (type == DoneRecord) {
+            m_live.erase(id);
+        }
+    }
+    for (const auto& item : m_live) {
+        m_unfinished.push_back(item.second);
+    }
+}
+
+std::vector<Intent> Journal::takeUnfinished()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::vector<Intent> unfinished;
+    unfinished.swap(m_unfinished);
+    return unfinished;
+}
+
+uint64_t Journal::begin(const std::string& source, const std::string& destination, const std::string& name,
+                        uint64_t size, int64_t mtime)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto id = m_nextId++;
+    auto& intent = m_live[id];
+    intent.m_id = id;
+    intent.m_source = source;
+    intent.m_destination = destination;
+    intent.m_name = name;
+    intent.m_size = size;
+    intent.m_mtime = mtime;
+    append(IntentRecord, id, intentPayload(intent));
+    return id;
+}
+
+void Journal::checkpoint(uint64_t id, uint64_t offset)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto it = m_live.find(id);
+    if (it == m_live.end()) {
+        return;
+    }
+    it->second.m_offset = offset;
+    std::string payload;
+    put(payload, offset);
+    append(CheckpointRecord, id, payload);
+    flush();
+}
+
+void Journal::finish(uint64_t id)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_live.erase(id) != 0) {
+        append(DoneRecord, id, std::string());
+    }
+}
+
+int Journal::commit()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_size + m_buffer.size() > s_compactSize && compact() == 0) {
+        return 0;
+    }
+    return flush();
+}
+
+void Journal::append(unsigned char type, uint64_t id, const std::string& payload)
+{
+    m_buffer += record(type, id, payload);
+}
+
+int Journal::flush()
+{
+    if (m_buffer.empty() || m_fd == -1) {
+        return 0;
+    }
+    int err = writeAll(m_fd, m_buffer);
+    if (err == 0 && fdatasync(m_fd) == -1) {
+        err = errno;
+    }
+    if (err == 0) {
+        m_size += m_buffer.size();
+        m_buffer.clear();
+    }
+    return err;
+}
+
+int Journal::compact()
+{
+    ///@brief The live intents already include every buffered record, the buffer is not needed any more
+    std::string data(s_magic, s_magicSize);
+    for (const auto& item : m_live) {
+        data += record(IntentRecord, item.first, intentPayload(item.second));
+    }
+    std::string tmpPath = m_path + ".tmp";
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        return errno;
+    }
+    int err = writeAll(fd, data);
+    if (err == 0 && fdatasync(fd) == -1) {
+        err = errno;
+    }
+    if (err == 0 && rename(tmpPath.c_str(), m_path.c_str()) == -1) {
+        err = errno;
+    }
+    if (err != 0) {
+        close(fd);
+        unlink(tmpPath.c_str());
+        return err;
+    }
+    syncDirectory(m_path);
+    if (m_fd != -1) {
+        close(m_fd);
+    }
+    m_fd = fd;
+    m_size = data.size();
+    m_buffer.clear();
+    return 0;
+}
+
+} // namespace transfer
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace transfer {
+
+///@brief A cross-device copy which was started but not reported finished
+struct Intent
+{
+    uint64_t m_id = 0;
+    std::string m_source;
+    std::string m_destination;
+    std::string m_name;
+    ///@brief Size and modification time of the source when the copy started
+    uint64_t m_size = 0;
+    int64_t m_mtime = 0;
+    ///@brief Bytes of the temporary known to be durable
+    uint64_t m_offset = 0;
+};
+
+/**
+ * @class  Journal
+ * @file   journal.h
+ * @brief  Append-only write-ahead log of cross-device copies. A copy appends an
+ *         intent and commits it before its temporary is written, checkpoints while
+ *         large files are copied and a done record once the source is gone. Records
+ *         are buffered and made durable with one fdatasync per commit(): the done
+ *         records of a batch ride along with the next intents, and both engines
+ *         commit the intents of a whole batch of copies at once. Renames are atomic
+ *         and never logged.
+ *         Opening the journal replays it to find the copies a crash interrupted,
+ *         takeUnfinished() hands them to the recovery. Once the file grows past
+ *         s_compactSize it is rewritten with the live intents only. Every member
+ *         may be called concurrently.
+ */
+class Journal
+{
+public:
+    explicit Journal(const std::string& path);
+    ~Journal();
+
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    bool valid() const noexcept
+    {
+        return m_fd != -1;
+    }
+
+    int error() const noexcept
+    {
+        return m_error;
+    }
+
+    ///@brief Intents which were not finished when the journal was opened, handed out only once
+    std::vector<Intent> takeUnfinished();
+
+    ///@brief Log the start of a copy, returns the id the copy is checkpointed and finished with
+    uint64_t begin(const std::string& source, const std::string& destination, const std::string& name,
+                   uint64_t size, int64_t mtime);
+
+    ///@brief Every byte of the temporary before offset is durable, commits immediately
+    void checkpoint(uint64_t id, uint64_t offset);
+
+    ///@brief The copy landed or its temporary was removed
+    void finish(uint64_t id);
+
+    ///@brief Write the buffered records and sync them, 0 or the errno of the failure
+    int commit();
+
+public:
+    ///@brief Size of the file which triggers a compaction on commit
+    static const uint64_t s_compactSize = 1 << 20;
+
+private:
+    void replay();
+    void append(unsigned char type, uint64_t id, const std::string& payload);
+    int flush();
+    int compact();
+
+private:
+    std::string m_path;
+    int m_fd = -1;
+    int m_error = 0;
+    uint64_t m_size = 0;
+    uint64_t m_nextId = 1;
+    std::string m_buffer;
+    std::map<uint64_t, Intent> m_live;
+    std::vector<Intent> m_unfinished;
+    mutable std::mutex m_mutex;
+};
+
+} // namespace transfer
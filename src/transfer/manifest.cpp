@@ -0,0 +1,62 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <ctime>
+
+#include "manifest.h"
+
+namespace transfer {
+
+const char* verdictName(Verdict verdict) noexcept
+{
+    switch (verdict) {
+    case Verdict::Checksummed:
+        return "checksummed";
+    case Verdict::Verified:
+        return "verified";
+    case Verdict::Mismatch:
+        return "mismatch";
+    }
+    return "unknown";
+}
+
+Manifest::Manifest(const std::string& path)
+{
+    m_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (m_fd == -1) {
+        m_error = errno;
+    }
+}
+
+Manifest::~Manifest()
+{
+    if (m_fd != -1) {
+        close(m_fd);
+    }
+}
+
+int Manifest::record(const std::string& source, const std::string& destination, const std::string& name,
+                     const std::string& target, uint64_t size, uint32_t crc, Verdict verdict)
+{
+    if (m_fd == -1) {
+        return m_error;
+    }
+    char head[96];
+    time_t now = time(nullptr);
+    struct tm utc;
+    gmtime_r(&now, &utc);
+    size_t length = strftime(head, sizeof(head), "%Y-%m-%dT%H:%M:%SZ", &utc);
+    snprintf(head + length, sizeof(head) - length, "\t%s\tcrc32c:%08x\t%llu\t", verdictName(verdict), crc,
+             static_cast<unsigned long long>(size));
+    std::string line = head;
+    line += source + "/" + name + "\t" + destination + "/" + target + "\n";
+    ///@brief One write per line, O_APPEND keeps concurrent lines apart
+    auto ret = write(m_fd, line.data(), line.size());
+    if (ret < 0) {
+        return errno;
+    }
+    return static_cast<size_t>(ret) == line.size() ? 0 : EIO;
+}
+
+} // namespace transfer
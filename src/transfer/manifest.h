@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace transfer {
+
+///@brief What the verification of a copy found
+enum class Verdict
+{
+    Checksummed,    ///< the checksum of the source was recorded, the compressed copy is not comparable
+    Verified,       ///< the copy read back has the checksum of the source
+    Mismatch        ///< the copy read back differs, it was removed and the source kept
+};
+
+const char* verdictName(Verdict verdict) noexcept;
+
+/**
+ * @class  Manifest
+ * @file   manifest.h
+ * @brief  Append-only, tab separated record of verified copies: UTC time,
+ *         verdict, CRC32C, size, source path and destination path, one line
+ *         per copy. Lines are appended with single O_APPEND writes, so
+ *         concurrent transfers and several openers of one file never interleave.
+ */
+class Manifest
+{
+public:
+    explicit Manifest(const std::string& path);
+    ~Manifest();
+
+    Manifest(const Manifest&) = delete;
+    Manifest& operator=(const Manifest&) = delete;
+
+    bool valid() const noexcept
+    {
+        return m_fd != -1;
+    }
+
+    int error() const noexcept
+    {
+        return m_error;
+    }
+
+    ///@brief Append the line of one copy, 0 or the errno of the failed write
+    ///@brief target is the name in destination, name with a compression suffix for instance
+    int record(const std::string& source, const std::string& destination, const std::string& name,
+               const std::string& target, uint64_t size, uint32_t crc, Verdict verdict);
+
+private:
+    int m_fd = -1;
+    int m_error = 0;
+};
+
+} // namespace transfer
@@ -0,0 +1,488 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstdio>
+#include <algorithm>
+
+#include "compressor.h"
+#include "mover.h"
+
+namespace transfer {
+
+namespace {
+
+int64_t nanoseconds(const struct timespec& time) noexcept
+{
+    return static_cast<int64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+} // unnamed namespace
+
+const char* statusName(Status status) noexcept
+{
+    switch (status) {
+    case Status::Renamed:
+        return "renamed";
+    case Status::Copied:
+        return "copied";
+    case Status::Skipped:
+        return "skipped";
+    case Status::Failed:
+        return "failed";
+    }
+    return "unknown";
+}
+
+Mover::Mover(const std::string& source, const std::string& destination, const Options& options)
+    : m_source(source)
+    , m_destination(destination)
+    , m_options(options)
+    , m_group(m_options)
+{
+    m_srcFd = open(m_source.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (m_srcFd == -1) {
+        m_error = errno;
+        return;
+    }
+    m_dstFd = open(m_destination.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (m_dstFd == -1) {
+        m_error = errno;
+        return;
+    }
+    struct stat src;
+    struct stat dst;
+    m_crossDevice = fstat(m_srcFd, &src) == 0 && fstat(m_dstFd, &dst) == 0 && src.st_dev != dst.st_dev;
+}
+
+Mover::~Mover()
+{
+    if (m_srcFd != -1) {
+        close(m_srcFd);
+    }
+    if (m_dstFd != -1) {
+        close(m_dstFd);
+    }
+}
+
+void Mover::moveAll(const Report& report, const Select& select)
+{
+    scan([this, &report] (const std::vector<Entry>& entries) {
+        declare(entries);
+        for (const auto& entry : entries) {
+            move(entry, report);
+        }
+        undeclare();
+        if (m_journal != nullptr) {
+            m_journal->commit();
+        }
+    }, select);
+    commit(report);
+}
+
+std::vector<Result> Mover::moveBatch(const std::vector<Entry>& entries)
+{
+    std::vector<Result> results;
+    if (!valid()) {
+        return results;
+    }
+    results.reserve(entries.size());
+    auto collect = [&results] (const Result& result) {
+        results.push_back(result);
+    };
+    declare(entries);
+    for (const auto& entry : entries) {
+        move(entry, collect);
+    }
+    undeclare();
+    commit(collect);
+    if (m_journal != nullptr) {
+        m_journal->commit();
+    }
+    return results;
+}
+
+void Mover::move(const Entry& entry, const Report& report)
+{
+    Result result;
+    if (stage(entry, result)) {
+        report(result);
+    } else if (m_group.due()) {
+        commit(report);
+    }
+}
+
+void Mover::declare(const std::vector<Entry>& entries)
+{
+    ///@brief Only a job which copies as a rule pays a stat per entry, a stray EXDEV commits its own intent
+    bool copies = m_crossDevice || m_options.m_compression != Compression::None;
+    if (m_journal == nullptr || !copies) {
+        return;
+    }
+    for (const auto& entry : entries) {
+        const auto& name = entry.m_name;
+        struct stat st;
+        if ((entry.m_type != DT_UNKNOWN && entry.m_type != DT_REG) ||
+                fstatat(m_srcFd, name.c_str(), &st, AT_SYMLINK_NOFOLLOW) == -1 || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        m_declared[name] = m_journal->begin(m_source, m_destination, name, static_cast<uint64_t>(st.st_size),
+                                            nanoseconds(st.st_mtim));
+    }
+    ///@brief Without its declared intent a copy commits one of its own, and fails as this commit did
+    if (!m_declared.empty() && m_journal->commit() != 0) {
+        undeclare();
+    }
+}
+
+void Mover::undeclare()
+{
+    for (const auto& declared : m_declared) {
+        m_journal->finish(declared.second);
+    }
+    m_declared.clear();
+}
+
+void Mover::defer(const Result& result, uint64_t journalId, bool unlinkSource)
+{
+    m_group.add(result, journalId, unlinkSource);
+}
+
+void Mover::commit(const Report& report)
+{
+    m_group.commit(m_srcFd, m_dstFd, m_journal, report);
+}
+
+void Mover::scan(const std::function<void(const std::vector<Entry>&)>& consume, const Select& select)
+{
+    if (!valid()) {
+        return;
+    }
+    Scanner scanner(m_srcFd);
+    std::vector<Entry> entries;
+    while (scanner.next(entries, m_options.m_includeHidden)) {
+        if (m_options.m_includeHidden) {
+            entries.erase(std::remove_if(entries.begin(), entries.end(), [] (const Entry& entry) {
+                return isTemporary(entry.m_name);
+            }), entries.end());
+        }
+        if (select) {
+            select(m_srcFd, entries);
+        }
+        consume(entries);
+    }
+    if (scanner.error() != 0) {
+        m_error = scanner.error();
+    }
+}
+
+std::string Mover::temporaryName(const std::string& name)
+{
+    ///@brief The temporary of a file in a subdirectory stays in that subdirectory
+    auto base = name.rfind('/');
+    if (base == std::string::npos) {
+        return "." + name + ".part";
+    }
+    return name.substr(0, base + 1) + "." + name.substr(base + 1) + ".part";
+}
+
+int Mover::makeParent(const std::string& name)
+{
+    auto slash = name.rfind('/');
+    if (m_directories == nullptr || slash == std::string::npos) {
+        return 0;
+    }
+    return m_directories->make(m_destination, name.substr(0, slash));
+}
+
+std::string Mover::targetName(const std::string& name) const
+{
+    return name + compressionSuffix(m_options.m_compression);
+}
+
+bool Mover::isTemporary(const std::string& name)
+{
+    const size_t suffix = 5; // ".part"
+    return name.size() > suffix + 1 && name[0] == '.' && name.compare(name.size() - suffix, suffix, ".part") == 0;
+}
+
+Result Mover::moveOne(const Entry& entry)
+{
+    Result result;
+    if (!stage(entry, result)) {
+        commit([&result] (const Result& committed) {
+            result = committed;
+        });
+    }
+    return result;
+}
+
+bool Mover::stage(const Entry& entry, Result& result)
+{
+    const auto& name = entry.m_name;
+    result = Result();
+    result.m_name = name;
+    if (m_throttle != nullptr) {
+        m_throttle->operations(1);
+    }
+    result.m_error = makeParent(name);
+    if (result.m_error != 0) {
+        return true;
+    }
+    ///@brief A compressing job has to pass every byte through the compressor, even on one device
+    bool compress = m_options.m_compression != Compression::None;
+    if (!compress && renameat2(m_srcFd, name.c_str(), m_dstFd, name.c_str(), 0) == 0) {
+        result.m_status = Status::Renamed;
+        if (m_options.m_durability == Durability::None) {
+            return true;
+        }
+        m_group.add(result, 0, false);
+        return false;
+    }
+    if (!compress && errno != EXDEV) {
+        result.m_error = errno;
+        return true;
+    }
+    bool defer = m_options.m_durability != Durability::None;
+    uint64_t id = 0;
+    result.m_error = copyEntry(entry, result.m_strategy, defer, id);
+    if (result.m_error == 0) {
+        result.m_status = Status::Copied;
+        if (defer) {
+            m_group.add(result, id, true);
+            return false;
+        }
+    } else if (result.m_error == EISDIR) {
+        result.m_status = Status::Skipped;
+    }
+    return true;
+}
+
+int Mover::copyAcross(const Entry& entry, Strategy& strategy)
+{
+    uint64_t id = 0;
+    return copyEntry(entry, strategy, false, id);
+}
+
+int Mover::copyEntry(const Entry& entry, Strategy& strategy, bool defer, uint64_t& id)
+{
+    strategy = Strategy::None;
+    ///@brief The directory already told the type, spare the open and stat of what can not be copied
+    if (entry.m_type == DT_DIR) {
+        return EISDIR;
+    }
+    if (entry.m_type != DT_UNKNOWN && entry.m_type != DT_REG) {
+        return EINVAL;
+    }
+    const auto& name = entry.m_name;
+    int in = openat(m_srcFd, name.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (in == -1) {
+        return errno;
+    }
+    struct stat st;
+    if (fstat(in, &st) == -1) {
+        int err = errno;
+        close(in);
+        return err;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        close(in);
+        return S_ISDIR(st.st_mode) ? EISDIR : EINVAL;
+    }
+
+    auto declared = m_declared.find(name);
+    if (declared != m_declared.end()) {
+        ///@brief Committed with its chunk, a source changed since only makes a resume start over
+        id = declared->second;
+        m_declared.erase(declared);
+    } else if (m_journal != nullptr) {
+        id = m_journal->begin(m_source, m_destination, name, static_cast<uint64_t>(st.st_size), nanoseconds(st.st_mtim));
+        ///@brief Without a durable intent a crash would leave the temporary behind with nothing to clean it up
+        int err = m_journal->commit();
+        if (err != 0) {
+            m_journal->finish(id);
+            close(in);
+            return err;
+        }
+    }
+    auto bytes = static_cast<uint64_t>(st.st_size);
+    if (m_traffic != nullptr) {
+        m_traffic->begin(bytes);
+    }
+    int err = copyFile(in, st, name, 0, id, defer, strategy);
+    if (m_traffic != nullptr) {
+        m_traffic->end(bytes, err == 0);
+    }
+    close(in);
+    return err;
+}
+
+Result Mover::resume(const Intent& intent)
+{
+    const auto& name = intent.m_name;
+    Result result;
+    result.m_name = name;
+    auto finish = [this, &intent] () {
+        if (m_journal != nullptr) {
+            m_journal->finish(intent.m_id);
+        }
+    };
+    auto target = targetName(name);
+    std::string tmpName = temporaryName(target);
+    bool compress = m_options.m_compression != Compression::None;
+    struct stat st;
+    int in = openat(m_srcFd, name.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (in == -1) {
+        result.m_error = errno;
+    } else if (fstat(in, &st) == -1) {
+        result.m_error = errno;
+    } else if (!S_ISREG(st.st_mode)) {
+        result.m_error = EINVAL;
+    }
+    if (result.m_error != 0) {
+        ///@brief ENOENT: the copy landed and the source was unlinked before the crash
+        if (in != -1) {
+            close(in);
+        }
+        unlinkat(m_dstFd, tmpName.c_str(), 0);
+        finish();
+        return result;
+    }
+    bool unchanged = static_cast<uint64_t>(st.st_size) == intent.m_size && nanoseconds(st.st_mtim) == intent.m_mtime;
+    struct stat tmp;
+    bool hasTemporary = fstatat(m_dstFd, tmpName.c_str(), &tmp, AT_SYMLINK_NOFOLLOW) == 0 && S_ISREG(tmp.st_mode);
+    struct stat landed;
+    if (unchanged && !hasTemporary && fstatat(m_dstFd, target.c_str(), &landed, AT_SYMLINK_NOFOLLOW) == 0 &&
+            S_ISREG(landed.st_mode) && (compress || landed.st_size == st.st_size) &&
+            nanoseconds(landed.st_mtim) == intent.m_mtime) {
+        ///@brief Renamed into place, only the unlink of the source was lost
+        close(in);
+        result.m_error = unlinkat(m_srcFd, name.c_str(), 0) == -1 ? errno : 0;
+        result.m_status = result.m_error == 0 ? Status::Copied : Status::Failed;
+        finish();
+        return result;
+    }
+    off_t offset = 0;
+    ///@brief Compressed output has no offset to continue from, it is started over
+    if (!compress && unchanged && hasTemporary && static_cast<uint64_t>(tmp.st_size) >= intent.m_offset) {
+        offset = static_cast<off_t>(intent.m_offset);
+    }
+    auto bytes = static_cast<uint64_t>(st.st_size - offset);
+    if (m_traffic != nullptr) {
+        m_traffic->begin(bytes);
+    }
+    result.m_error = copyFile(in, st, name, offset, intent.m_id, false, result.m_strategy);
+    if (m_traffic != nullptr) {
+        m_traffic->end(bytes, result.m_error == 0);
+    }
+    close(in);
+    result.m_status = result.m_error == 0 ? Status::Copied : Status::Failed;
+    return result;
+}
+
+int Mover::copyFile(int in, const struct stat& st, const std::string& name, off_t offset, uint64_t id,
+                    bool defer, Strategy& strategy)
+{
+    auto durability = m_options.m_durability;
+    auto target = targetName(name);
+    ///@brief Copy into a hidden temporary so consumers never see a partial file
+    std::string tmpName = temporaryName(target);
+    int flags = (m_options.m_verify != Verify::None ? O_RDWR : O_WRONLY) | O_CREAT | O_CLOEXEC |
+                (offset == 0 ? O_TRUNC : 0);
+    int out = openat(m_dstFd, tmpName.c_str(), flags, st.st_mode & 07777);
+    if (out == -1) {
+        int err = errno;
+        if (m_journal != nullptr) {
+            m_journal->finish(id);
+        }
+        return err;
+    }
+    Progress progress;
+    progress.m_offset = offset;
+    progress.m_throttle = m_throttle;
+    progress.m_checksum = m_options.m_verify != Verify::None;
+    if (m_journal != nullptr) {
+        progress.m_interval = static_cast<off_t>(m_options.m_checkpointInterval);
+        progress.m_checkpoint = [this, id] (off_t done) {
+            m_journal->checkpoint(id, static_cast<uint64_t>(done));
+        };
+    }
+    int err = 0;
+    ///@brief Whatever follows the checkpoint may not have reached the disk
+    if (offset != 0 && ftruncate(out, offset) == -1) {
+        err = errno;
+    } else if (m_options.m_compression != Compression::None) {
+        strategy = m_options.m_compression == Compression::Zstd ? Strategy::Zstd : Strategy::Gzip;
+        err = compressData(in, out, st.st_size, m_options.m_compression, m_options.m_compressionLevel,
+                           m_options.m_compressionWorkers, &progress, m_pool);
+    } else if (m_options.m_parallelThreshold != 0 && m_options.m_parallelWorkers > 1 &&
+            static_cast<uint64_t>(st.st_size) >= m_options.m_parallelThreshold) {
+        err = copyParallel(in, out, st.st_size, m_options.m_parallelWorkers, strategy, &progress, m_pool);
+    } else {
+        err = copyData(in, out, strategy, &progress);
+    }
+    if (err == 0 && progress.m_checksum) {
+        err = verify(out, st, name, progress.m_crc);
+    }
+    if (err == 0) {
+        const struct timespec times[2] = { st.st_atim, st.st_mtim };
+        futimens(out, times);
+    }
+    ///@brief A copy which is not covered by a group sync has to sync its own data
+    bool syncData = durability == Durability::File || (durability == Durability::Batch && !defer);
+    if (err == 0 && syncData && fdatasync(out) == -1) {
+        err = errno;
+    }
+    if (close(out) == -1 && err == 0) {
+        err = errno;
+    }
+    if (err == 0 && renameat(m_dstFd, tmpName.c_str(), m_dstFd, target.c_str()) == -1) {
+        err = errno;
+    }
+    if (err == 0 && defer) {
+        ///@brief The group unlinks the source and finishes the journal record once it is synced
+        return 0;
+    }
+    if (err == 0 && durability != Durability::None && fsync(m_dstFd) == -1) {
+        err = errno;
+    }
+    if (err != 0) {
+        unlinkat(m_dstFd, tmpName.c_str(), 0);
+    } else if (unlinkat(m_srcFd, name.c_str(), 0) == -1) {
+        err = errno;
+    } else if (durability != Durability::None) {
+        fsync(m_srcFd);
+    }
+    if (m_journal != nullptr) {
+        m_journal->finish(id);
+    }
+    return err;
+}
+
+int Mover::verify(int out, const struct stat& st, const std::string& name, uint32_t crc)
+{
+    auto verdict = Verdict::Checksummed;
+    ///@brief Compressed output is not comparable with the source, its checksum is recorded only
+    if (m_options.m_verify != Verify::None && m_options.m_compression == Compression::None) {
+        ///@brief Only clean pages can be dropped, and only without them the read comes from the disk
+        if (m_options.m_verify == Verify::ReadBack) {
+            if (fdatasync(out) == -1) {
+                return errno;
+            }
+            posix_fadvise(out, 0, 0, POSIX_FADV_DONTNEED);
+        }
+        uint32_t copied = 0;
+        int err = checksumRange(out, 0, -1, copied);
+        if (err != 0) {
+            return err;
+        }
+        verdict = copied == crc ? Verdict::Verified : Verdict::Mismatch;
+    }
+    if (m_manifest != nullptr) {
+        m_manifest->record(m_source, m_destination, name, targetName(name), static_cast<uint64_t>(st.st_size), crc,
+                           verdict);
+    }
+    return verdict == Verdict::Mismatch ? EIO : 0;
+}
+
+} // namespace transfer
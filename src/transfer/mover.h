@@ -0,0 +1,232 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "copier.h"
+#include "directories.h"
+#include "journal.h"
+#include "manifest.h"
+#include "options.h"
+#include "result.h"
+#include "scanner.h"
+#include "syncgroup.h"
+#include "threadpool.h"
+#include "throttle.h"
+#include "traffic.h"
+
+namespace transfer {
+
+/**
+ * @class  Mover
+ * @file   mover.h
+ * @brief  Moves the content of one catalogue into another without a shell.
+ *         Entries are renamed when both catalogues are on the same device,
+ *         otherwise they are copied next to the destination and unlinked.
+ *         With Options::m_compression set every file is compressed into
+ *         targetName() instead, on any device.
+ */
+class Mover
+{
+public:
+    Mover(const std::string& source, const std::string& destination, const Options& options = Options());
+    ~Mover();
+
+    Mover(const Mover&) = delete;
+    Mover& operator=(const Mover&) = delete;
+
+    ///@brief false if one of the catalogues could not be opened, see error()
+    bool valid() const noexcept
+    {
+        return m_srcFd != -1 && m_dstFd != -1;
+    }
+
+    int error() const noexcept
+    {
+        return m_error;
+    }
+
+    /**
+     * @brief Move every visible entry of the source catalogue while it is being read,
+     * except those select removes from their chunk. With Options::m_durability set,
+     * results are reported once their group is synced.
+     */
+    void moveAll(const Report& report, const Select& select = Select());
+
+    ///@brief Move the given entries of the source catalogue
+    std::vector<Result> moveBatch(const std::vector<Entry>& entries);
+
+    ///@brief Move a single entry of the source catalogue, synced on its own if durability is set
+    Result moveOne(const Entry& entry);
+
+    /**
+     * @brief Copy a regular file into the destination catalogue and unlink the source,
+     * with durability set the copy and both catalogues are synced before it returns
+     * @return 0 on success, EISDIR for directories or the errno of the failed call
+     */
+    int copyAcross(const Entry& entry, Strategy& strategy);
+
+    ///@brief Hand a move made elsewhere to the sync group, see SyncGroup::add()
+    void defer(const Result& result, uint64_t journalId, bool unlinkSource);
+
+    ///@brief Sync the pending group and report its results
+    void commit(const Report& report);
+
+    bool due() const noexcept
+    {
+        return m_group.due();
+    }
+
+    /**
+     * @brief Finish a copy a crash interrupted: unlink a source which already landed,
+     * continue the temporary from its last checkpoint if the source did not change,
+     * copy from scratch otherwise
+     */
+    Result resume(const Intent& intent);
+
+    ///@brief Log copies to journal, nullptr stops logging; every intent is committed before its copy starts
+    void setJournal(Journal* journal) noexcept
+    {
+        m_journal = journal;
+    }
+
+    Journal* journal() const noexcept
+    {
+        return m_journal;
+    }
+
+    ///@brief Pace entries and copied bytes with throttle, nullptr for full speed
+    void setThrottle(Throttle* throttle) noexcept
+    {
+        m_throttle = throttle;
+    }
+
+    Throttle* throttle() const noexcept
+    {
+        return m_throttle;
+    }
+
+    ///@brief Record the checksum of every verified copy in manifest, nullptr records nothing
+    void setManifest(Manifest* manifest) noexcept
+    {
+        m_manifest = manifest;
+    }
+
+    ///@brief Count the copies in flight and their bytes in traffic, nullptr counts nothing
+    void setTraffic(Traffic* traffic) noexcept
+    {
+        m_traffic = traffic;
+    }
+
+    Traffic* traffic() const noexcept
+    {
+        return m_traffic;
+    }
+
+    ///@brief Borrow the workers of pool for parallel and compressed copies, nullptr copies on the calling thread
+    void setPool(ThreadPool* pool) noexcept
+    {
+        m_pool = pool;
+    }
+
+    /**
+     * @brief Create the destination subdirectories of entries named by a relative
+     * path through directories, once per directory; nullptr moves top level names only
+     */
+    void setDirectories(Directories* directories) noexcept
+    {
+        m_directories = directories;
+    }
+
+    Directories* directories() const noexcept
+    {
+        return m_directories;
+    }
+
+    ///@brief Create the destination directory of name if it lies in a subdirectory, 0 or the errno of mkdir
+    int makeParent(const std::string& name);
+
+    /**
+     * @brief Read the source catalogue chunk by chunk and hand every chunk to consume.
+     * Hidden entries are only included if configured, our own temporaries never,
+     * and select may drop more.
+     */
+    void scan(const std::function<void(const std::vector<Entry>&)>& consume, const Select& select = Select());
+
+    const std::string& source() const noexcept
+    {
+        return m_source;
+    }
+
+    const std::string& destination() const noexcept
+    {
+        return m_destination;
+    }
+
+    int sourceFd() const noexcept
+    {
+        return m_srcFd;
+    }
+
+    int destinationFd() const noexcept
+    {
+        return m_dstFd;
+    }
+
+    ///@brief Name of the hidden temporary a copy of name is written to, next to it in its subdirectory
+    static std::string temporaryName(const std::string& name);
+
+    ///@brief Name the file name of the source is stored under in the destination
+    std::string targetName(const std::string& name) const;
+
+    ///@brief true if name is one of the temporaries written by a mover
+    static bool isTemporary(const std::string& name);
+
+    const Options& options() const noexcept
+    {
+        return m_options;
+    }
+
+private:
+    ///@brief Move entry and report it, or add it to the group and commit the group once it is due
+    void move(const Entry& entry, const Report& report);
+    ///@brief Move entry, false if the result went to the group instead
+    bool stage(const Entry& entry, Result& result);
+    ///@brief Log the intents of the copies among entries and make them durable with one commit
+    void declare(const std::vector<Entry>& entries);
+    ///@brief Finish the declared intents no copy took, their entries were renamed or failed early
+    void undeclare();
+    ///@brief Open, journal and copy entry, id receives the journal record
+    int copyEntry(const Entry& entry, Strategy& strategy, bool defer, uint64_t& id);
+    /**
+     * @brief Copy the opened source from offset on and rename it into place. The
+     * source is unlinked and the journal record finished unless defer is set.
+     */
+    int copyFile(int in, const struct stat& st, const std::string& name, off_t offset, uint64_t id,
+                 bool defer, Strategy& strategy);
+    ///@brief Check the copy in out against crc of the source as configured and record it, EIO on a mismatch
+    int verify(int out, const struct stat& st, const std::string& name, uint32_t crc);
+
+private:
+    std::string m_source;
+    std::string m_destination;
+    Options m_options;
+    SyncGroup m_group;
+    int m_srcFd = -1;
+    int m_dstFd = -1;
+    int m_error = 0;
+    ///@brief Source and destination are on different devices, every regular file is copied
+    bool m_crossDevice = false;
+    Journal* m_journal = nullptr;
+    ///@brief Intents committed ahead of the copies of a chunk, by source name
+    std::unordered_map<std::string, uint64_t> m_declared;
+    Throttle* m_throttle = nullptr;
+    Manifest* m_manifest = nullptr;
+    Traffic* m_traffic = nullptr;
+    ThreadPool* m_pool = nullptr;
+    Directories* m_directories = nullptr;
+};
+
+} // namespace transfer
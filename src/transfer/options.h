@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+
+namespace transfer {
+
+///@brief When moved files are forced to stable storage
+enum class Durability
+{
+    None,   ///< left to the kernel writeback
+    Batch,  ///< one syncfs or a pair of directory fsyncs per group of moves
+    File    ///< fdatasync of every copy and fsync of both parent directories per move
+};
+
+///@brief How much a cross-device copy is checked before its source is unlinked
+enum class Verify
+{
+    None,       ///< the copy is trusted
+    Checksum,   ///< CRC32C of the source computed while copying, compared with the copy as cached and recorded
+    ReadBack    ///< ... the copy is read back from disk instead
+};
+
+///@brief Transform applied to files on their way into the destination
+enum class Compression
+{
+    None,   ///< files are moved as they are
+    Gzip,   ///< stored as name.gz, one gzip member per block
+    Zstd    ///< stored as name.zst, one zstd frame per block, needs DAEMON_HAVE_ZSTD
+};
+
+///@brief Tunables of a transfer, filled from configuration.conf by the daemon
+struct Options
+{
+    ///@brief Files of at least this many bytes are copied in parallel ranges, 0 disables it
+    uint64_t m_parallelThreshold = 1ull << 30;
+    ///@brief Number of threads copying the ranges of one large file
+    unsigned m_parallelWorkers = 4;
+    ///@brief Bytes of a journaled copy between two checkpoints it can resume from
+    uint64_t m_checkpointInterval = 64ull << 20;
+    Durability m_durability = Durability::None;
+    ///@brief Durability::Batch commits a group once it holds this many moves
+    unsigned m_syncBatchFiles = 1024;
+    ///@brief ... or once its first move waited this many milliseconds
+    unsigned m_syncBatchLatency = 1000;
+    Verify m_verify = Verify::None;
+    ///@brief Compressing jobs never rename, every file is read and written compressed
+    Compression m_compression = Compression::None;
+    ///@brief Library level, 0 for its default
+    int m_compressionLevel = 0;
+    ///@brief Threads compressing the blocks of one large file
+    unsigned m_compressionWorkers = 4;
+    ///@brief Move entries starting with a dot, the shell glob used to skip them
+    bool m_includeHidden = false;
+};
+
+} // namespace transfer
@@ -0,0 +1,219 @@
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <algorithm>
+
+#include "checksum.h"
+#include "partitions.h"
+
+namespace transfer {
+
+namespace {
+
+std::string hostName()
+{
+    char name[256] = {};
+    if (gethostname(name, sizeof(name) - 1) == -1) {
+        return "localhost";
+    }
+    return name;
+}
+
+///@brief host.pid.sequence, the jobs of a configuration being reloaded join next to the old ones
+std::string instanceName()
+{
+    static std::atomic<unsigned> s_sequence(0);
+    return hostName() + "." + std::to_string(getpid()) + "." + std::to_string(s_sequence++);
+}
+
+///@brief Replace the content of fd with text, for whoever wonders who holds a lock
+void describe(int fd, const std::string& text) noexcept
+{
+    if (ftruncate(fd, 0) == 0) {
+        (void)pwrite(fd, text.data(), text.size(), 0);
+    }
+}
+
+} // unnamed namespace
+
+Partitions::Partitions(const std::string& directory, const std::string& job, unsigned count)
+    : m_directory(directory)
+    , m_job(job)
+    , m_membersDirectory(directory + "/" + job + ".members")
+    , m_instance(instanceName())
+    , m_leases(std::max(count, 1u))
+{
+    for (auto& lease : m_leases) {
+        lease = -1;
+    }
+    if (mkdir(m_membersDirectory.c_str(), 0755) == -1 && errno != EEXIST) {
+        m_error = errno;
+        return;
+    }
+    ///@brief Locked before it gets its name, so nobody takes the new member file for a stale one
+    auto path = m_membersDirectory + "/" + m_instance;
+    auto hidden = m_membersDirectory + "/." + m_instance;
+    m_memberFd = open(hidden.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (m_memberFd == -1) {
+        m_error = errno;
+        return;
+    }
+    if (flock(m_memberFd, LOCK_EX | LOCK_NB) == -1 || rename(hidden.c_str(), path.c_str()) == -1) {
+        m_error = errno;
+        close(m_memberFd);
+        m_memberFd = -1;
+        unlink(hidden.c_str());
+        return;
+    }
+    ///@brief The lowest free slot, a restarted instance usually gets the one it had before
+    for (unsigned slot = 0; m_slotFd == -1; ++slot) {
+        auto slotPath = m_directory + "/" + m_job + "." + std::to_string(slot) + ".slot";
+        int fd = open(slotPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd == -1) {
+            m_error = errno;
+            break;
+        }
+        if (flock(fd, LOCK_EX | LOCK_NB) == -1) {
+            int err = errno;
+            close(fd);
+            if (err != EWOULDBLOCK) {
+                m_error = err;
+                break;
+            }
+            continue;
+        }
+        describe(fd, m_instance + "\n");
+        m_slot = slot;
+        m_slotFd = fd;
+    }
+    if (m_slotFd == -1) {
+        unlink(path.c_str());
+        close(m_memberFd);
+        m_memberFd = -1;
+    }
+}
+
+Partitions::~Partitions()
+{
+    for (unsigned i = 0; i < m_leases.size(); ++i) {
+        release(i);
+    }
+    if (m_memberFd != -1) {
+        unlink((m_membersDirectory + "/" + m_instance).c_str());
+        close(m_memberFd);
+    }
+    if (m_slotFd != -1) {
+        close(m_slotFd);
+    }
+}
+
+void Partitions::rebalance()
+{
+    if (!valid()) {
+        return;
+    }
+    std::lock_guard<std::mutex> guard(m_rebalance);
+    auto instances = members();
+    auto share = (count() + instances - 1) / instances;
+    auto holding = held();
+    ///@brief Every instance starts looking at a different partition, they do not all race for the same ones
+    auto start = static_cast<unsigned>(nameHash(m_instance) % count());
+    if (holding > share) {
+        std::unique_lock<std::shared_timed_mutex> lock(m_mutex);
+        for (unsigned i = 0; i < count() && holding > share; ++i) {
+            auto index = (start + count() - 1 - i) % count();
+            if (m_leases[index].load() != -1) {
+                release(index);
+                --holding;
+            }
+        }
+        return;
+    }
+    for (unsigned i = 0; i < count() && holding < share; ++i) {
+        auto index = (start + i) % count();
+        if (m_leases[index].load() == -1 && claim(index)) {
+            ++holding;
+        }
+    }
+}
+
+void Partitions::select(std::vector<Entry>& entries) const
+{
+    entries.erase(std::remove_if(entries.begin(), entries.end(), [this] (const Entry& entry) {
+        return !holds(entry.m_name);
+    }), entries.end());
+}
+
+unsigned Partitions::partition(const std::string& name) const noexcept
+{
+    return static_cast<unsigned>(nameHash(name) % count());
+}
+
+unsigned Partitions::held() const noexcept
+{
+    unsigned holding = 0;
+    for (const auto& lease : m_leases) {
+        holding += lease.load() != -1 ? 1 : 0;
+    }
+    return holding;
+}
+
+unsigned Partitions::members()
+{
+    unsigned alive = 1;
+    int dirFd = open(m_membersDirectory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd == -1) {
+        return alive;
+    }
+    Scanner scanner(dirFd);
+    std::vector<Entry> entries;
+    while (scanner.next(entries, false)) {
+        for (const auto& entry : entries) {
+            if (entry.m_name == m_instance) {
+                continue;
+            }
+            int fd = openat(dirFd, entry.m_name.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd == -1) {
+                continue;
+            }
+            ///@brief A member file nobody holds is left over from a dead instance
+            if (flock(fd, LOCK_EX | LOCK_NB) == 0) {
+                unlinkat(dirFd, entry.m_name.c_str(), 0);
+            } else {
+                ++alive;
+            }
+            close(fd);
+        }
+    }
+    close(dirFd);
+    return alive;
+}
+
+bool Partitions::claim(unsigned index)
+{
+    auto path = m_directory + "/" + m_job + "." + std::to_string(index) + ".lease";
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        return false;
+    }
+    if (flock(fd, LOCK_EX | LOCK_NB) == -1) {
+        close(fd);
+        return false;
+    }
+    describe(fd, m_instance + "\n");
+    m_leases[index] = fd;
+    return true;
+}
+
+void Partitions::release(unsigned index)
+{
+    auto fd = m_leases[index].exchange(-1);
+    if (fd != -1) {
+        ///@brief Closing the only descriptor drops the lock
+        close(fd);
+    }
+}
+
+} // namespace transfer
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+#include "scanner.h"
+
+namespace transfer {
+
+/**
+ * @class  Partitions
+ * @file   partitions.h
+ * @brief  Splits the names of one source catalogue between daemon instances,
+ *         on one host or on several hosts sharing a file system. The name
+ *         space is cut into hash partitions and an instance only moves the
+ *         names of the partitions it holds. A partition is held through an
+ *         flock on its lease file <directory>/<job>.<index>.lease; the kernel,
+ *         or the NFS lock manager, drops it when its holder dies. Every
+ *         instance also holds the lock of its member file in
+ *         <directory>/<job>.members, which is how the others count it, and
+ *         the lowest free slot <directory>/<job>.<slot>.slot, which names the
+ *         files it keeps for itself.
+ *         rebalance() claims free partitions up to the instance's share of
+ *         ceil(partitions / instances) and gives back those above it, so the
+ *         partitions of a dead instance are taken over and a new instance
+ *         gets its share on the next rebalance of each of them.
+ *         Thread safe; selecting and moving happen under hold(), which
+ *         keeps a partition from being given back while its files move.
+ */
+class Partitions
+{
+public:
+    using Hold = std::shared_lock<std::shared_timed_mutex>;
+
+    Partitions(const std::string& directory, const std::string& job, unsigned count);
+    ///@brief Gives back every partition and leaves the members
+    ~Partitions();
+
+    Partitions(const Partitions&) = delete;
+    Partitions& operator=(const Partitions&) = delete;
+
+    bool valid() const noexcept
+    {
+        return m_memberFd != -1;
+    }
+
+    int error() const noexcept
+    {
+        return m_error;
+    }
+
+    ///@brief Count the live instances and claim or give back partitions to hold this instance's share
+    void rebalance();
+
+    ///@brief Keep the transfers of the held partitions, the partitions stay held until it is released
+    Hold hold() const
+    {
+        return Hold(m_mutex);
+    }
+
+    ///@brief Remove the entries of the partitions this instance does not hold, under hold()
+    void select(std::vector<Entry>& entries) const;
+
+    ///@brief Whether this instance holds the partition of the name, under hold()
+    bool holds(const std::string& name) const noexcept
+    {
+        return m_leases[partition(name)].load() != -1;
+    }
+
+    ///@brief Partition of the name, its path relative to the catalogue
+    unsigned partition(const std::string& name) const noexcept;
+
+    ///@brief Number of partitions this instance holds
+    unsigned held() const noexcept;
+
+    unsigned count() const noexcept
+    {
+        return static_cast<unsigned>(m_leases.size());
+    }
+
+    ///@brief Slot of this instance, no other live instance of the job has the same one
+    unsigned slot() const noexcept
+    {
+        return m_slot;
+    }
+
+private:
+    ///@brief Live instances which joined, this one included; stale member files are removed
+    unsigned members();
+    bool claim(unsigned index);
+    void release(unsigned index);
+
+private:
+    std::string m_directory;
+    std::string m_job;
+    std::string m_membersDirectory;
+    ///@brief Host, pid and sequence number of this instance, the name of its member file
+    std::string m_instance;
+    int m_memberFd = -1;
+    int m_slotFd = -1;
+    unsigned m_slot = 0;
+    int m_error = 0;
+    ///@brief Lease descriptor of every partition, -1 unless this instance holds it; claims need no lock
+    std::vector<std::atomic<int> > m_leases;
+    mutable std::shared_timed_mutex m_mutex;
+    ///@brief Serializes rebalance(), which only takes m_mutex exclusively to give partitions back
+    std::mutex m_rebalance;
+};
+
+} // namespace transfer
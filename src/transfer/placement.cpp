@@ -0,0 +1,144 @@
+#include <sys/statvfs.h>
+#include <algorithm>
+
+#include "checksum.h"
+#include "placement.h"
+
+namespace transfer {
+
+namespace {
+
+///@brief Files are charged at least this many bytes, a small file still costs a create and a rename
+const uint64_t s_minCharge = 64 << 10;
+///@brief Weight of the latest batch in the moving average of the cost per byte
+const double s_costWeight = 0.2;
+
+} // unnamed namespace
+
+const Placement::Clock::duration Placement::s_refreshInterval = std::chrono::seconds(2);
+
+Placement::Placement(const std::vector<std::string>& destinations, Spread spread, uint64_t minFree)
+    : m_spread(spread)
+    , m_minFree(minFree)
+{
+    for (const auto& path : destinations) {
+        Destination destination;
+        destination.m_path = path;
+        m_destinations.push_back(std::move(destination));
+    }
+    ///@brief Points depend on the path only, adding a destination moves just the names it takes over
+    for (size_t i = 0; i < m_destinations.size(); ++i) {
+        auto seed = nameHash(m_destinations[i].m_path);
+        for (unsigned node = 0; node < s_virtualNodes; ++node) {
+            m_ring.emplace_back(mixHash(seed + node), i);
+        }
+    }
+    std::sort(m_ring.begin(), m_ring.end());
+}
+
+size_t Placement::choose(const std::string& name, uint64_t size)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto now = Clock::now();
+    for (auto& destination : m_destinations) {
+        if (!destination.m_known || now - destination.m_checked >= s_refreshInterval) {
+            refresh(destination, now);
+        }
+    }
+    auto index = m_spread == Spread::Hash ? hashed(name, size) : balanced(size);
+    m_destinations[index].m_inFlight += size;
+    return index;
+}
+
+void Placement::finish(size_t destination, uint64_t bytes, Clock::duration elapsed)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& target = m_destinations[destination];
+    target.m_inFlight -= std::min(target.m_inFlight, bytes);
+    ///@brief Until the next statvfs what landed is known to be used
+    target.m_free -= std::min(target.m_free, bytes);
+    auto cost = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) /
+        static_cast<double>(std::max(bytes, s_minCharge));
+    target.m_cost = target.m_cost == 0 ? cost : (1 - s_costWeight) * target.m_cost + s_costWeight * cost;
+}
+
+void Placement::refresh(Destination& destination, Clock::time_point now)
+{
+    struct statvfs vfs;
+    destination.m_checked = now;
+    destination.m_known = true;
+    if (statvfs(destination.m_path.c_str(), &vfs) == -1) {
+        destination.m_free = 0;
+        destination.m_total = 0;
+        return;
+    }
+    destination.m_free = static_cast<uint64_t>(vfs.f_bavail) * vfs.f_frsize;
+    destination.m_total = static_cast<uint64_t>(vfs.f_blocks) * vfs.f_frsize;
+}
+
+bool Placement::fits(const Destination& destination, uint64_t size) const noexcept
+{
+    return destination.m_total != 0 && destination.m_free >= destination.m_inFlight + size + m_minFree;
+}
+
+size_t Placement::balanced(uint64_t size) const
+{
+    ///@brief Destinations nothing landed on yet are assumed to be as fast as the average of the others
+    double known = 0;
+    size_t measured = 0;
+    for (const auto& destination : m_destinations) {
+        if (destination.m_cost != 0) {
+            known += destination.m_cost;
+            ++measured;
+        }
+    }
+    double fallbackCost = measured == 0 ? 1 : known / static_cast<double>(measured);
+    size_t best = m_destinations.size();
+    double bestScore = 0;
+    size_t roomiest = 0;
+    uint64_t mostRoom = 0;
+    for (size_t i = 0; i < m_destinations.size(); ++i) {
+        const auto& destination = m_destinations[i];
+        auto room = destination.m_free - std::min(destination.m_free, destination.m_inFlight);
+        if (room > mostRoom) {
+            roomiest = i;
+            mostRoom = room;
+        }
+        if (!fits(destination, size)) {
+            continue;
+        }
+        ///@brief Time to drain what is queued there plus this file, stretched as the volume fills up
+        auto cost = destination.m_cost != 0 ? destination.m_cost : fallbackCost;
+        auto freeShare = std::max(0.01, static_cast<double>(room) / static_cast<double>(destination.m_total));
+        auto score = static_cast<double>(destination.m_inFlight + std::max(size, s_minCharge)) * cost / freeShare;
+        if (best == m_destinations.size() || score < bestScore) {
+            best = i;
+            bestScore = score;
+        }
+    }
+    return best == m_destinations.size() ? roomiest : best;
+}
+
+size_t Placement::hashed(const std::string& name, uint64_t size) const
+{
+    auto point = std::lower_bound(m_ring.begin(), m_ring.end(), std::make_pair(nameHash(name), size_t(0)));
+    std::vector<bool> tried(m_destinations.size(), false);
+    size_t left = m_destinations.size();
+    for (size_t step = 0; step < m_ring.size() && left != 0; ++step, ++point) {
+        if (point == m_ring.end()) {
+            point = m_ring.begin();
+        }
+        auto index = point->second;
+        if (tried[index]) {
+            continue;
+        }
+        if (fits(m_destinations[index], size)) {
+            return index;
+        }
+        tried[index] = true;
+        --left;
+    }
+    return balanced(size);
+}
+
+} // namespace transfer
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace transfer {
+
+///@brief How a file picks its destination catalogue among several
+enum class Spread
+{
+    Balanced,   ///< the least loaded: free space, recent write latency and bytes in flight
+    Hash        ///< consistent hashing of the name, the same name always lands in the same place
+};
+
+/**
+ * @class  Placement
+ * @file   placement.h
+ * @brief  Routes every file of a fan-out job to one of its destination
+ *         catalogues. Free space is read with statvfs and cached for
+ *         s_refreshInterval; the bytes reserved by files in flight count as
+ *         used already. A destination which cannot take a file and keep
+ *         minFree bytes free is skipped, by Spread::Hash too, which then
+ *         continues clockwise on its ring. Thread safe.
+ */
+class Placement
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    Placement(const std::vector<std::string>& destinations, Spread spread, uint64_t minFree);
+
+    Placement(const Placement&) = delete;
+    Placement& operator=(const Placement&) = delete;
+
+    size_t size() const noexcept
+    {
+        return m_destinations.size();
+    }
+
+    /**
+     * @brief Destination for the file name of size bytes; its bytes count as in
+     * flight there until finish(). Falls back to the destination with the most
+     * free space if none has room for the file.
+     */
+    size_t choose(const std::string& name, uint64_t size);
+
+    ///@brief bytes chosen for destination landed (or failed) after elapsed
+    void finish(size_t destination, uint64_t bytes, Clock::duration elapsed);
+
+public:
+    ///@brief Age at which the cached free space of a destination is read again
+    static const Clock::duration s_refreshInterval;
+    ///@brief Points of every destination on the Spread::Hash ring
+    static const unsigned s_virtualNodes = 128;
+
+private:
+    struct Destination
+    {
+        std::string m_path;
+        uint64_t m_free = 0;
+        uint64_t m_total = 0;
+        Clock::time_point m_checked;
+        bool m_known = false;
+        uint64_t m_inFlight = 0;
+        ///@brief Moving average of nanoseconds per byte, 0 until the first batch landed
+        double m_cost = 0;
+    };
+
+    void refresh(Destination& destination, Clock::time_point now);
+    bool fits(const Destination& destination, uint64_t size) const noexcept;
+    size_t balanced(uint64_t size) const;
+    size_t hashed(const std::string& name, uint64_t size) const;
+
+private:
+    std::vector<Destination> m_destinations;
+    Spread m_spread;
+    uint64_t m_minFree;
+    ///@brief Sorted ring of (point, destination) for Spread::Hash
+    std::vector<std::pair<uint64_t, size_t> > m_ring;
+    mutable std::mutex m_mutex;
+};
+
+} // namespace transfer
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include "copier.h"
+
+namespace transfer {
+
+///@brief Outcome of a single file transfer
+enum class Status
+{
+    Renamed,    ///< moved with a rename on the same device
+    Copied,     ///< copied across devices and the source unlinked
+    Skipped,    ///< entry type can not be transferred
+    Failed      ///< transfer failed, see Result::m_error
+};
+
+///@brief Per-file transfer report
+struct Result
+{
+    std::string m_name;
+    Status m_status = Status::Failed;
+    ///@brief errno value describing the failure, 0 on success
+    int m_error = 0;
+    ///@brief How the data was copied, None for renames
+    Strategy m_strategy = Strategy::None;
+};
+
+const char* statusName(Status status) noexcept;
+
+///@brief Receives every result while a catalogue is streamed through a mover
+using Report = std::function<void(const Result&)>;
+
+} // namespace transfer
@@ -0,0 +1,185 @@
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include "ring.h"
+
+namespace transfer {
+
+namespace {
+
+int ioUringSetup(unsigned entries, struct io_uring_params* params)
+{
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int ioUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+int ioUringRegister(int fd, unsigned opcode, void* arg, unsigned nrArgs)
+{
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs));
+}
+
+template <typename T>
+T* at(void* base, unsigned offset)
+{
+    return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+}
+
+} // unnamed namespace
+
+Ring::Ring(unsigned entries)
+{
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    m_fd = ioUringSetup(entries, &params);
+    if (m_fd == -1) {
+        m_error = errno;
+        return;
+    }
+    m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap && m_cqRingSize > m_sqRingSize) {
+        m_sqRingSize = m_cqRingSize;
+    }
+    m_sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+    if (m_sqRing == MAP_FAILED) {
+        m_sqRing = nullptr;
+    } else if (singleMmap) {
+        m_cqRing = m_sqRing;
+    } else {
+        m_cqRing = mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+        if (m_cqRing == MAP_FAILED) {
+            m_cqRing = nullptr;
+        }
+    }
+    m_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+    if (m_sqRing == nullptr || m_cqRing == nullptr || sqes == MAP_FAILED) {
+        m_error = errno;
+        if (sqes != MAP_FAILED) {
+            munmap(sqes, m_sqesSize);
+        }
+        release();
+        return;
+    }
+    m_sqes = static_cast<struct io_uring_sqe*>(sqes);
+
+    m_sqHead = at<std::atomic<unsigned> >(m_sqRing, params.sq_off.head);
+    m_sqTail = at<std::atomic<unsigned> >(m_sqRing, params.sq_off.tail);
+    m_sqMask = *at<unsigned>(m_sqRing, params.sq_off.ring_mask);
+    m_sqEntries = params.sq_entries;
+    ///@brief Submission slots map one to one onto the entry array
+    auto array = at<unsigned>(m_sqRing, params.sq_off.array);
+    for (unsigned i = 0; i < m_sqEntries; ++i) {
+        array[i] = i;
+    }
+    m_sqeTail = m_sqTail->load(std::memory_order_relaxed);
+
+    m_cqHead = at<std::atomic<unsigned> >(m_cqRing, params.cq_off.head);
+    m_cqTail = at<std::atomic<unsigned> >(m_cqRing, params.cq_off.tail);
+    m_cqMask = *at<unsigned>(m_cqRing, params.cq_off.ring_mask);
+    m_cqes = at<struct io_uring_cqe>(m_cqRing, params.cq_off.cqes);
+
+    const unsigned probeOps = 256;
+    std::vector<char> probeBuffer(sizeof(struct io_uring_probe) + probeOps * sizeof(struct io_uring_probe_op));
+    auto probe = reinterpret_cast<struct io_uring_probe*>(probeBuffer.data());
+    if (ioUringRegister(m_fd, IORING_REGISTER_PROBE, probe, probeOps) == 0) {
+        for (unsigned i = 0; i < probe->ops_len; ++i) {
+            m_supported[probe->ops[i].op] = probe->ops[i].flags & IO_URING_OP_SUPPORTED;
+        }
+    }
+}
+
+Ring::~Ring()
+{
+    release();
+}
+
+void Ring::release() noexcept
+{
+    if (m_sqes != nullptr) {
+        munmap(m_sqes, m_sqesSize);
+        m_sqes = nullptr;
+    }
+    if (m_cqRing != nullptr && m_cqRing != m_sqRing) {
+        munmap(m_cqRing, m_cqRingSize);
+    }
+    m_cqRing = nullptr;
+    if (m_sqRing != nullptr) {
+        munmap(m_sqRing, m_sqRingSize);
+        m_sqRing = nullptr;
+    }
+    if (m_fd != -1) {
+        close(m_fd);
+        m_fd = -1;
+    }
+}
+
+bool Ring::supports(unsigned char opcode) const noexcept
+{
+    return m_supported[opcode] != 0;
+}
+
+unsigned Ring::space() const noexcept
+{
+    return m_sqEntries - (m_sqeTail - m_sqHead->load(std::memory_order_acquire));
+}
+
+struct io_uring_sqe* Ring::getSqe() noexcept
+{
+    if (space() == 0) {
+        return nullptr;
+    }
+    auto sqe = &m_sqes[m_sqeTail & m_sqMask];
+    ++m_sqeTail;
+    std::memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+unsigned Ring::unsubmitted() noexcept
+{
+    m_sqTail->store(m_sqeTail, std::memory_order_release);
+    ///@brief The kernel moves the head past what it took, a refused or partial submission stays counted
+    return m_sqeTail - m_sqHead->load(std::memory_order_acquire);
+}
+
+int Ring::submit(unsigned waitNr) noexcept
+{
+    int ret;
+    do {
+        ret = ioUringEnter(m_fd, unsubmitted(), waitNr, waitNr != 0 ? IORING_ENTER_GETEVENTS : 0);
+    } while (ret == -1 && errno == EINTR);
+    return ret == -1 ? -errno : ret;
+}
+
+bool Ring::peek(struct io_uring_cqe& cqe) noexcept
+{
+    unsigned head = m_cqHead->load(std::memory_order_relaxed);
+    if (head == m_cqTail->load(std::memory_order_acquire)) {
+        return false;
+    }
+    cqe = m_cqes[head & m_cqMask];
+    m_cqHead->store(head + 1, std::memory_order_release);
+    return true;
+}
+
+bool Ring::wait(struct io_uring_cqe& cqe) noexcept
+{
+    while (!peek(cqe)) {
+        int ret = ioUringEnter(m_fd, unsubmitted(), 1, IORING_ENTER_GETEVENTS);
+        if (ret == -1 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace transfer
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <linux/io_uring.h>
+#include <atomic>
+#include <cstddef>
+
+namespace transfer {
+
+/**
+ * @class  Ring
+ * @file   ring.h
+ * @brief  Minimal io_uring submission/completion queue pair built directly
+ *         on the io_uring_setup/io_uring_enter system calls.
+ *         Not thread safe, every thread has to use its own ring.
+ */
+class Ring
+{
+public:
+    explicit Ring(unsigned entries);
+    ~Ring();
+
+    Ring(const Ring&) = delete;
+    Ring& operator=(const Ring&) = delete;
+
+    bool valid() const noexcept
+    {
+        return m_fd != -1;
+    }
+
+    int error() const noexcept
+    {
+        return m_error;
+    }
+
+    ///@brief Number of submission queue entries
+    unsigned capacity() const noexcept
+    {
+        return m_sqEntries;
+    }
+
+    ///@brief true if the running kernel implements the opcode
+    bool supports(unsigned char opcode) const noexcept;
+
+    ///@brief Zeroed submission entry, nullptr if the submission queue is full
+    struct io_uring_sqe* getSqe() noexcept;
+
+    ///@brief Number of free submission entries
+    unsigned space() const noexcept;
+
+    ///@brief Submit the prepared entries and those the kernel refused before, and wait for waitNr completions
+    int submit(unsigned waitNr = 0) noexcept;
+
+    ///@brief Pop a completion if one is ready
+    bool peek(struct io_uring_cqe& cqe) noexcept;
+
+    ///@brief Pop a completion, block until one is ready; submits what is still queued first
+    bool wait(struct io_uring_cqe& cqe) noexcept;
+
+private:
+    void release() noexcept;
+    ///@brief Publish the prepared entries, returns how many the kernel did not take yet
+    unsigned unsubmitted() noexcept;
+
+private:
+    int m_fd = -1;
+    int m_error = 0;
+
+    void* m_sqRing = nullptr;
+    size_t m_sqRingSize = 0;
+    void* m_cqRing = nullptr;
+    size_t m_cqRingSize = 0;
+    struct io_uring_sqe* m_sqes = nullptr;
+    size_t m_sqesSize = 0;
+
+    std::atomic<unsigned>* m_sqHead = nullptr;
+    std::atomic<unsigned>* m_sqTail = nullptr;
+    unsigned m_sqMask = 0;
+    unsigned m_sqEntries = 0;
+    ///@brief Entries handed out by getSqe(), published to the kernel by submit()
+    unsigned m_sqeTail = 0;
+
+    std::atomic<unsigned>* m_cqHead = nullptr;
+    std::atomic<unsigned>* m_cqTail = nullptr;
+    unsigned m_cqMask = 0;
+    struct io_uring_cqe* m_cqes = nullptr;
+
+    unsigned char m_supported[256] = {};
+};
+
+} // namespace transfer
@@ -0,0 +1,71 @@
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdint>
+
+#include "scanner.h"
+
+namespace transfer {
+
+namespace {
+
+///@brief Record layout of getdents64, not exported by the C library headers
+struct LinuxDirent64
+{
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+};
+
+} // unnamed namespace
+
+Scanner::Scanner(int dirFd, size_t bufferSize)
+    : m_buffer(bufferSize)
+{
+    m_fd = openat(dirFd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (m_fd == -1) {
+        m_error = errno;
+    }
+}
+
+Scanner::~Scanner()
+{
+    if (m_fd != -1) {
+        close(m_fd);
+    }
+}
+
+bool Scanner::next(std::vector<Entry>& entries, bool includeHidden)
+{
+    entries.clear();
+    while (m_fd != -1 && entries.empty()) {
+        auto length = syscall(SYS_getdents64, m_fd, m_buffer.data(), m_buffer.size());
+        if (length <= 0) {
+            if (length == -1 && errno == EINTR) {
+                continue;
+            }
+            m_error = length == 0 ? 0 : errno;
+            close(m_fd);
+            m_fd = -1;
+            return false;
+        }
+        for (long offset = 0; offset < length; ) {
+            auto dirent = reinterpret_cast<const LinuxDirent64*>(m_buffer.data() + offset);
+            offset += dirent->d_reclen;
+            const char* name = dirent->d_name;
+            if (name[0] == '.' && (!includeHidden || name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+            entries.emplace_back();
+            entries.back().m_name = name;
+            entries.back().m_type = dirent->d_type;
+            entries.back().m_inode = dirent->d_ino;
+        }
+    }
+    return !entries.empty();
+}
+
+} // namespace transfer
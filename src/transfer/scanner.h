@@ -0,0 +1,69 @@
+#pragma once
+
+#include <dirent.h>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace transfer {
+
+///@brief Directory entry as handed to the movers
+struct Entry
+{
+    std::string m_name;
+    ///@brief DT_* type reported by the directory, DT_UNKNOWN if the file system does not tell
+    unsigned char m_type = DT_UNKNOWN;
+    ///@brief Inode reported by the directory, 0 if it is not known
+    uint64_t m_inode = 0;
+};
+
+///@brief Removes the entries of a chunk read from dirFd which must not be moved (yet)
+using Select = std::function<void(int dirFd, std::vector<Entry>& entries)>;
+
+/**
+ * @class  Scanner
+ * @file   scanner.h
+ * @brief  Streaming directory reader built on getdents64. Entries are
+ *         returned chunk by chunk out of one reusable buffer, so memory stays
+ *         bounded however large the directory is, and the d_type of every
+ *         entry comes for free without a stat call.
+ */
+class Scanner
+{
+public:
+    ///@brief dirFd is not taken over, the scanner reads through its own descriptor
+    explicit Scanner(int dirFd, size_t bufferSize = s_defaultBufferSize);
+    ~Scanner();
+
+    Scanner(const Scanner&) = delete;
+    Scanner& operator=(const Scanner&) = delete;
+
+    bool valid() const noexcept
+    {
+        return m_fd != -1;
+    }
+
+    ///@brief errno of the failed call, 0 if the directory was read to the end
+    int error() const noexcept
+    {
+        return m_error;
+    }
+
+    /**
+     * @brief Replace entries with the next chunk of the directory, "." and ".."
+     * are never returned and hidden entries only when includeHidden is set.
+     * @return false once the directory is exhausted or reading failed
+     */
+    bool next(std::vector<Entry>& entries, bool includeHidden);
+
+public:
+    static const size_t s_defaultBufferSize = 256 * 1024;
+
+private:
+    int m_fd = -1;
+    int m_error = 0;
+    std::vector<char> m_buffer;
+};
+
+} // namespace transfer
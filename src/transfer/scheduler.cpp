@@ -0,0 +1,121 @@
+#include <cerrno>
+#include <algorithm>
+
+#include "scheduler.h"
+
+namespace transfer {
+
+Scheduler::Scheduler(Schedule schedule, uint64_t largeThreshold)
+    : m_schedule(schedule)
+    , m_largeThreshold(largeThreshold)
+{
+}
+
+void Scheduler::add(int dirFd, const std::vector<Entry>& entries)
+{
+    if (m_schedule == Schedule::Fifo) {
+        m_lanes[0].reserve(m_lanes[0].size() + entries.size());
+        for (const auto& entry : entries) {
+            Item item;
+            item.m_entry = entry;
+            m_lanes[0].push_back(std::move(item));
+        }
+        return;
+    }
+    std::vector<int> errors;
+    m_statBatch.stat(dirFd, entries.size(), [&entries] (size_t i) -> const std::string& {
+        return entries[i].m_name;
+    }, m_stats, errors);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (errors[i] == ENOENT) {
+            continue;
+        }
+        Item item;
+        item.m_entry = entries[i];
+        item.m_sequence = m_sequence++;
+        bool regular = errors[i] == 0 && S_ISREG(m_stats[i].stx_mode);
+        if (regular) {
+            item.m_size = m_stats[i].stx_size;
+            item.m_mtime = static_cast<int64_t>(m_stats[i].stx_mtime.tv_sec) * 1000000000 + m_stats[i].stx_mtime.tv_nsec;
+        }
+        bool large = regular && m_largeThreshold != 0 && item.m_size >= m_largeThreshold;
+        m_lanes[large ? 1 : 0].push_back(std::move(item));
+    }
+}
+
+std::vector<Entry> Scheduler::take(Lane lane)
+{
+    auto& items = m_lanes[lane == Lane::Large ? 1 : 0];
+    switch (m_schedule) {
+    case Schedule::Fifo:
+        break;
+    case Schedule::Smallest:
+        std::sort(items.begin(), items.end(), [] (const Item& left, const Item& right) {
+            return left.m_size != right.m_size ? left.m_size < right.m_size : left.m_sequence < right.m_sequence;
+        });
+        break;
+    case Schedule::Oldest:
+        std::sort(items.begin(), items.end(), [] (const Item& left, const Item& right) {
+            return left.m_mtime != right.m_mtime ? left.m_mtime < right.m_mtime : left.m_sequence < right.m_sequence;
+        });
+        break;
+    case Schedule::Fair:
+        items = fair(items);
+        break;
+    }
+    std::vector<Entry> entries;
+    entries.reserve(items.size());
+    for (auto& item : items) {
+        entries.push_back(std::move(item.m_entry));
+    }
+    items.clear();
+    return entries;
+}
+
+unsigned Scheduler::sizeClass(uint64_t size) noexcept
+{
+    unsigned index = 0;
+    for (uint64_t limit = 64 << 10; index + 1 < s_fairClasses && size >= limit; limit <<= 4) {
+        ++index;
+    }
+    return index;
+}
+
+std::vector<Scheduler::Item> Scheduler::fair(std::vector<Item>& items) const
+{
+    ///@brief Deficit round robin: every round each class earns a quantum of bytes and
+    ///       moves files in listing order for as long as its credit covers them
+    std::vector<size_t> classes[s_fairClasses];
+    for (size_t i = 0; i < items.size(); ++i) {
+        classes[sizeClass(items[i].m_size)].push_back(i);
+    }
+    size_t heads[s_fairClasses] = {};
+    uint64_t credit[s_fairClasses] = {};
+    std::vector<Item> ordered;
+    ordered.reserve(items.size());
+    while (ordered.size() < items.size()) {
+        unsigned active = 0;
+        for (unsigned c = 0; c < s_fairClasses; ++c) {
+            active += heads[c] < classes[c].size() ? 1 : 0;
+        }
+        for (unsigned c = 0; c < s_fairClasses; ++c) {
+            auto& indices = classes[c];
+            if (heads[c] == indices.size()) {
+                continue;
+            }
+            credit[c] += s_fairQuantum;
+            ///@brief Nobody left to be fair to, a class on its own goes in one round
+            while (heads[c] < indices.size() && (active == 1 || items[indices[heads[c]]].m_size <= credit[c])) {
+                auto& item = items[indices[heads[c]++]];
+                credit[c] -= std::min(credit[c], item.m_size);
+                ordered.push_back(std::move(item));
+            }
+            if (heads[c] == indices.size()) {
+                credit[c] = 0;
+            }
+        }
+    }
+    return ordered;
+}
+
+} // namespace transfer
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "scanner.h"
+#include "statbatch.h"
+
+namespace transfer {
+
+///@brief Order in which the entries of a transfer cycle are moved
+enum class Schedule
+{
+    Fifo,       ///< as the directory lists them, unstat'ed and on the small lane
+    Smallest,   ///< smallest file first
+    Oldest,     ///< least recently modified file first
+    Fair        ///< size classes take turns, each moves the same number of bytes per round
+};
+
+///@brief Worker lane an entry is moved on
+enum class Lane
+{
+    Small,
+    Large
+};
+
+/**
+ * @class  Scheduler
+ * @file   scheduler.h
+ * @brief  Collects the entries of one transfer cycle and hands them out in the
+ *         order of a Schedule, so a huge file early in the listing does not
+ *         delay the many small ones behind it. Entries are sized with one
+ *         batch of statx calls per chunk. Regular files of at least the large
+ *         file threshold go to Lane::Large, meant to be moved concurrently with
+ *         the small lane; everything else, including entries which could not
+ *         be stat'ed, goes to Lane::Small for the mover to deal with.
+ *         Entries which vanished are dropped. Not thread safe.
+ */
+class Scheduler
+{
+public:
+    ///@brief largeThreshold 0 keeps every entry on the small lane
+    Scheduler(Schedule schedule, uint64_t largeThreshold);
+
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    ///@brief Stat and queue entries of dirFd
+    void add(int dirFd, const std::vector<Entry>& entries);
+
+    ///@brief The entries of lane in the order they are to be moved, the lane is left empty
+    std::vector<Entry> take(Lane lane);
+
+    bool empty() const noexcept
+    {
+        return m_lanes[0].empty() && m_lanes[1].empty();
+    }
+
+public:
+    ///@brief Schedule::Fair size classes start at 64 KiB and grow by a factor of 16
+    static const unsigned s_fairClasses = 5;
+    ///@brief Bytes every size class may move per Schedule::Fair round
+    static const uint64_t s_fairQuantum = 16ull << 20;
+
+private:
+    struct Item
+    {
+        Entry m_entry;
+        uint64_t m_size = 0;
+        int64_t m_mtime = 0;
+        ///@brief Position in the listing, ties keep it
+        uint64_t m_sequence = 0;
+    };
+
+    static unsigned sizeClass(uint64_t size) noexcept;
+    std::vector<Item> fair(std::vector<Item>& items) const;
+
+private:
+    Schedule m_schedule;
+    uint64_t m_largeThreshold;
+    StatBatch m_statBatch;
+    std::vector<Item> m_lanes[2];
+    uint64_t m_sequence = 0;
+    std::vector<struct statx> m_stats;
+};
+
+} // namespace transfer
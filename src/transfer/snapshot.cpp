@@ -0,0 +1,227 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+#include "checksum.h"
+#include "snapshot.h"
+
+namespace transfer {
+
+namespace {
+
+///@brief "DSI1": an index of this layout
+const uint32_t s_magic = 0x31495344;
+
+int64_t nanoseconds(const struct statx_timestamp& time) noexcept
+{
+    return static_cast<int64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+int64_t wallClock() noexcept
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+} // unnamed namespace
+
+Snapshot::Snapshot(const std::string& path, const std::string& identity)
+    : m_path(path)
+    , m_fingerprint(nameHash(identity))
+    , m_statBatch(s_statBatch)
+{
+    map();
+}
+
+Snapshot::~Snapshot()
+{
+    unmap();
+}
+
+bool Snapshot::unchanged(int dirFd)
+{
+    auto* index = header();
+    uint64_t inode = 0;
+    int64_t modified = -1;
+    return index != nullptr && index->m_modified != -1 && directory(dirFd, inode, modified) &&
+           inode == index->m_inode && modified == index->m_modified;
+}
+
+std::vector<Entry> Snapshot::recheck(int dirFd)
+{
+    std::vector<Entry> entries;
+    auto* index = header();
+    if (index == nullptr || index->m_count == 0) {
+        return entries;
+    }
+    const auto* recorded = records();
+    const char* names = reinterpret_cast<const char*>(recorded + index->m_count);
+    std::vector<std::string> paths;
+    paths.reserve(index->m_count);
+    for (uint64_t i = 0; i < index->m_count; ++i) {
+        paths.emplace_back(names + recorded[i].m_nameOffset, recorded[i].m_nameSize);
+    }
+    std::vector<int> errors;
+    m_statBatch.stat(dirFd, paths.size(), [&paths] (size_t i) -> const std::string& {
+        return paths[i];
+    }, m_stats, errors);
+    auto now = wallClock() / 1000000000;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        const auto& record = recorded[i];
+        const auto& stx = m_stats[i];
+        ///@brief Whatever the stat says, the rules and the mover are to decide on it again
+        bool changed = errors[i] != 0 || stx.stx_ino != record.m_inode || stx.stx_size != record.m_size ||
+                       nanoseconds(stx.stx_mtime) != record.m_mtime || now >= record.m_until;
+        if (changed && errors[i] != ENOENT) {
+            Entry entry;
+            entry.m_name = std::move(paths[i]);
+            entry.m_inode = record.m_inode;
+            entries.push_back(std::move(entry));
+        }
+    }
+    if (!entries.empty()) {
+        index->m_modified = -1;
+    }
+    return entries;
+}
+
+void Snapshot::begin(int dirFd)
+{
+    m_records.clear();
+    m_names.clear();
+    m_inode = 0;
+    m_modified = -1;
+    int64_t modified = -1;
+    ///@brief Taken before the listing, a change while it runs shows at the next rescan
+    if (directory(dirFd, m_inode, modified) && wallClock() - modified >= s_coarseTime) {
+        m_modified = modified;
+    }
+}
+
+void Snapshot::reject(const Entry& entry, const struct stat& st, int64_t until)
+{
+    Record record;
+    memset(&record, 0, sizeof(record));
+    record.m_inode = st.st_ino;
+    record.m_size = static_cast<uint64_t>(st.st_size);
+    record.m_mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    record.m_until = until;
+    record.m_nameOffset = m_names.size();
+    record.m_nameSize = static_cast<uint32_t>(entry.m_name.size());
+    m_names += entry.m_name;
+    m_records.push_back(record);
+}
+
+int Snapshot::commit(bool complete)
+{
+    Header index;
+    memset(&index, 0, sizeof(index));
+    index.m_magic = s_magic;
+    index.m_fingerprint = m_fingerprint;
+    index.m_inode = m_inode;
+    index.m_modified = complete ? m_modified : -1;
+    index.m_count = m_records.size();
+    index.m_names = m_names.size();
+    size_t size = sizeof(Header) + m_records.size() * sizeof(Record) + m_names.size();
+    std::string tmpPath = m_path + ".tmp";
+    int fd = open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        return errno;
+    }
+    int err = ftruncate(fd, static_cast<off_t>(size)) == -1 ? errno : 0;
+    void* data = MAP_FAILED;
+    if (err == 0) {
+        data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        err = data == MAP_FAILED ? errno : 0;
+    }
+    if (err == 0) {
+        auto* out = static_cast<char*>(data);
+        memcpy(out, &index, sizeof(index));
+        if (!m_records.empty()) {
+            memcpy(out + sizeof(index), m_records.data(), m_records.size() * sizeof(Record));
+        }
+        memcpy(out + sizeof(index) + m_records.size() * sizeof(Record), m_names.data(), m_names.size());
+        munmap(data, size);
+    }
+    close(fd);
+    if (err == 0 && rename(tmpPath.c_str(), m_path.c_str()) == -1) {
+        err = errno;
+    }
+    if (err != 0) {
+        unlink(tmpPath.c_str());
+    }
+    m_records.clear();
+    m_records.shrink_to_fit();
+    m_names.clear();
+    m_names.shrink_to_fit();
+    unmap();
+    map();
+    return err;
+}
+
+void Snapshot::map()
+{
+    int fd = open(m_path.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd == -1) {
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(Header)) {
+        m_mapSize = static_cast<size_t>(st.st_size);
+        m_map = mmap(nullptr, m_mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (m_map == MAP_FAILED) {
+            m_map = nullptr;
+        }
+    }
+    close(fd);
+    auto* index = header();
+    if (index == nullptr) {
+        return;
+    }
+    ///@brief Built for other rules, by another layout or torn: as good as none
+    bool valid = index->m_magic == s_magic && index->m_fingerprint == m_fingerprint &&
+                 index->m_count <= m_mapSize / sizeof(Record) &&
+                 sizeof(Header) + index->m_count * sizeof(Record) + index->m_names == m_mapSize;
+    for (uint64_t i = 0; valid && i < index->m_count; ++i) {
+        const auto& record = records()[i];
+        valid = record.m_nameSize != 0 && record.m_nameOffset + record.m_nameSize <= index->m_names;
+    }
+    if (!valid) {
+        unmap();
+    }
+}
+
+void Snapshot::unmap() noexcept
+{
+    if (m_map != nullptr) {
+        munmap(m_map, m_mapSize);
+    }
+    m_map = nullptr;
+    m_mapSize = 0;
+}
+
+Snapshot::Header* Snapshot::header() const noexcept
+{
+    return static_cast<Header*>(m_map);
+}
+
+const Snapshot::Record* Snapshot::records() const noexcept
+{
+    return reinterpret_cast<const Record*>(static_cast<const char*>(m_map) + sizeof(Header));
+}
+
+bool Snapshot::directory(int dirFd, uint64_t& inode, int64_t& modified)
+{
+    struct statx stx;
+    if (statx(dirFd, "", AT_EMPTY_PATH | AT_STATX_FORCE_SYNC, STATX_INO | STATX_MTIME, &stx) == -1) {
+        return false;
+    }
+    inode = stx.stx_ino;
+    modified = nanoseconds(stx.stx_mtime);
+    return true;
+}
+
+} // namespace transfer
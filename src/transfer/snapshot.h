@@ -0,0 +1,124 @@
+#pragma once
+
+#include <sys/stat.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "scanner.h"
+#include "statbatch.h"
+
+namespace transfer {
+
+/**
+ * @class  Snapshot
+ * @file   snapshot.h
+ * @brief  Persistent index of what a rescan left in a catalogue. A rescan moves
+ *         everything its rules let through, so after a pass which neither
+ *         failed nor held files back to settle the catalogue only holds entries
+ *         the rules turned down. The index records the directory as it was
+ *         listed and, with their inode, size and mtime, the entries turned down
+ *         by a size or age bound, whose verdict may change while the directory
+ *         does not. As long as the directory keeps its modification time
+ *         nothing was added, removed or renamed in it: a rescan then skips the
+ *         listing and only stats the recorded entries, in batches. Entries
+ *         turned down by name are not recorded at all, they cannot change.
+ *
+ *         The index is a memory mapped file, rewritten after every listing and
+ *         dropped if the rules it was built for changed. Losing it only costs
+ *         one listing, so it is never synced. Not thread safe.
+ */
+class Snapshot
+{
+public:
+    ///@brief identity is whatever decides which entries the rules turn down, an index built for another is dropped
+    Snapshot(const std::string& path, const std::string& identity);
+    ~Snapshot();
+
+    Snapshot(const Snapshot&) = delete;
+    Snapshot& operator=(const Snapshot&) = delete;
+
+    /**
+     * @brief Whether the directory dirFd is still what the index describes, then
+     * recheck() stands in for the listing. Attributes are revalidated with the
+     * server of a network file system.
+     */
+    bool unchanged(int dirFd);
+
+    /**
+     * @brief Recorded entries of dirFd whose size or mtime changed or whose time given to
+     * reject() came, to be selected and moved like listed ones; if there are any the
+     * index is marked stale, so the next rescan lists the directory again
+     */
+    std::vector<Entry> recheck(int dirFd);
+
+    ///@brief Start listing dirFd, every entry turned down by a bound is to be passed to reject()
+    void begin(int dirFd);
+
+    ///@brief Record an entry turned down by a bound, as st says it is; until is when time alone may let it through
+    void reject(const Entry& entry, const struct stat& st, int64_t until);
+
+    /**
+     * @brief Replace the index with the entries recorded since begin(). complete says whether
+     * the whole directory was read and only entries the rules turned down were left behind,
+     * the next rescan lists the directory again otherwise.
+     * @return 0 or the errno of writing the index
+     */
+    int commit(bool complete);
+
+public:
+    ///@brief A directory modified this recently may change again within the granularity of its timestamp
+    static const int64_t s_coarseTime = 1000000000;
+    ///@brief statx requests submitted at once
+    static const unsigned s_statBatch = 64;
+
+private:
+    struct Header
+    {
+        uint32_t m_magic;
+        uint32_t m_reserved;
+        uint64_t m_fingerprint;
+        ///@brief Inode and modification time of the directory when it was listed, -1 if it has to be listed again
+        uint64_t m_inode;
+        int64_t m_modified;
+        uint64_t m_count;
+        ///@brief Bytes of the names following the records
+        uint64_t m_names;
+    };
+
+    struct Record
+    {
+        uint64_t m_inode;
+        uint64_t m_size;
+        int64_t m_mtime;
+        ///@brief Wall clock seconds from which the entry may pass the bounds unchanged
+        int64_t m_until;
+        uint64_t m_nameOffset;
+        uint32_t m_nameSize;
+        uint32_t m_reserved;
+    };
+
+    void map();
+    void unmap() noexcept;
+    Header* header() const noexcept;
+    const Record* records() const noexcept;
+    ///@brief statx of the directory itself, false if it failed
+    static bool directory(int dirFd, uint64_t& inode, int64_t& modified);
+
+private:
+    std::string m_path;
+    uint64_t m_fingerprint;
+    void* m_map = nullptr;
+    size_t m_mapSize = 0;
+    ///@brief Listing in progress: the directory as begin() found it and the recorded entries
+    //@{
+    uint64_t m_inode = 0;
+    int64_t m_modified = -1;
+    std::vector<Record> m_records;
+    std::string m_names;
+    //@}
+    StatBatch m_statBatch;
+    std::vector<struct statx> m_stats;
+};
+
+} // namespace transfer
@@ -0,0 +1,141 @@
+#include <cerrno>
+#include <algorithm>
+
+#include "stability.h"
+
+namespace transfer {
+
+namespace {
+
+int64_t nanoseconds(const struct statx_timestamp& time) noexcept
+{
+    return static_cast<int64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+} // unnamed namespace
+
+Stability::Stability(std::chrono::milliseconds settleTime)
+    : m_settleTime(settleTime)
+    , m_statBatch(s_statBatch)
+    , m_nextDue(Clock::time_point::max().time_since_epoch().count())
+{
+}
+
+void Stability::select(int dirFd, std::vector<Entry>& entries)
+{
+    auto now = Clock::now();
+    std::vector<bool> keep(entries.size(), true);
+    std::vector<size_t> check;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        ///@brief Only regular files can be half written, the movers deal with everything else
+        if (entries[i].m_type != DT_REG && entries[i].m_type != DT_UNKNOWN) {
+            continue;
+        }
+        auto it = m_pending.find(entries[i].m_name);
+        if (it != m_pending.end()) {
+            it->second.m_scan = m_scan;
+            if (now < it->second.m_due) {
+                keep[i] = false;
+                continue;
+            }
+        }
+        check.push_back(i);
+    }
+
+    std::vector<int> errors;
+    m_statBatch.stat(dirFd, check.size(), [&] (size_t i) -> const std::string& {
+        return entries[check[i]].m_name;
+    }, m_stats, errors);
+    auto wallClock = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    auto settle = std::chrono::duration_cast<std::chrono::nanoseconds>(m_settleTime).count();
+    for (size_t i = 0; i < check.size(); ++i) {
+        auto index = check[i];
+        const auto& name = entries[index].m_name;
+        const auto& stx = m_stats[i];
+        auto it = m_pending.find(name);
+        if (errors[i] != 0 || !S_ISREG(stx.stx_mode)) {
+            ///@brief Gone or not a file any more, the mover reports whatever it is
+            if (it != m_pending.end()) {
+                m_pending.erase(it);
+            }
+            keep[index] = errors[i] != ENOENT;
+            continue;
+        }
+        auto mtime = nanoseconds(stx.stx_mtime);
+        if (it == m_pending.end()) {
+            if (wallClock - mtime >= settle) {
+                continue;
+            }
+            auto& pending = m_pending[name];
+            pending.m_size = stx.stx_size;
+            pending.m_mtime = mtime;
+            pending.m_due = now + m_settleTime;
+            pending.m_type = entries[index].m_type;
+            pending.m_scan = m_scan;
+            keep[index] = false;
+            continue;
+        }
+        auto& pending = it->second;
+        if (pending.m_size == stx.stx_size && pending.m_mtime == mtime) {
+            m_pending.erase(it);
+            continue;
+        }
+        ///@brief Still being written, start the settle time over
+        pending.m_size = stx.stx_size;
+        pending.m_mtime = mtime;
+        pending.m_due = now + m_settleTime;
+        keep[index] = false;
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (keep[i]) {
+            if (kept != i) {
+                entries[kept] = std::move(entries[i]);
+            }
+            ++kept;
+        }
+    }
+    entries.resize(kept);
+    updateNextDue();
+}
+
+std::vector<Entry> Stability::due(Clock::time_point now) const
+{
+    std::vector<Entry> entries;
+    for (const auto& item : m_pending) {
+        if (item.second.m_due <= now) {
+            Entry entry;
+            entry.m_name = item.first;
+            entry.m_type = item.second.m_type;
+            entries.push_back(std::move(entry));
+        }
+    }
+    return entries;
+}
+
+void Stability::sweep()
+{
+    for (auto it = m_pending.begin(); it != m_pending.end(); ) {
+        if (it->second.m_scan != m_scan) {
+            it = m_pending.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    ++m_scan;
+    updateNextDue();
+}
+
+void Stability::updateNextDue() noexcept
+{
+    auto next = Clock::time_point::max();
+    for (const auto& item : m_pending) {
+        next = std::min(next, item.second.m_due);
+    }
+    m_nextDue = next.time_since_epoch().count();
+    m_waiting = m_pending.size();
+}
+
+} // namespace transfer
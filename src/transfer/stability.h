@@ -0,0 +1,86 @@
+#pragma once
+
+#include <sys/stat.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "scanner.h"
+#include "statbatch.h"
+
+namespace transfer {
+
+/**
+ * @class  Stability
+ * @file   stability.h
+ * @brief  Keeps files a producer is still writing out of the transfers. A file
+ *         is stable once its size and modification time did not change for the
+ *         settle time. Files last modified longer ago pass on their first
+ *         sighting, the others are remembered in a table of pending files and
+ *         checked again only after their own settle time, so they never hold
+ *         back the rest of a chunk. The statx calls of a chunk are submitted
+ *         as one io_uring batch where the kernel allows it.
+ *         Not thread safe apart from nextDue() and waiting().
+ */
+class Stability
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit Stability(std::chrono::milliseconds settleTime);
+
+    Stability(const Stability&) = delete;
+    Stability& operator=(const Stability&) = delete;
+
+    ///@brief Remove the files of dirFd which are not stable yet from entries, remember them as pending
+    void select(int dirFd, std::vector<Entry>& entries);
+
+    ///@brief Pending files whose settle time passed, to be handed to select() again
+    std::vector<Entry> due(Clock::time_point now) const;
+
+    ///@brief Forget the pending files the full scan since the last sweep did not see
+    void sweep();
+
+    ///@brief Earliest time a pending file is due, Clock::time_point::max() if none; any thread
+    Clock::time_point nextDue() const noexcept
+    {
+        return Clock::time_point(Clock::duration(m_nextDue.load()));
+    }
+
+    ///@brief Number of pending files; any thread
+    size_t waiting() const noexcept
+    {
+        return m_waiting.load(std::memory_order_relaxed);
+    }
+
+public:
+    ///@brief statx requests submitted at once
+    static const unsigned s_statBatch = 64;
+
+private:
+    struct Pending
+    {
+        uint64_t m_size = 0;
+        int64_t m_mtime = 0;
+        Clock::time_point m_due;
+        unsigned char m_type = DT_UNKNOWN;
+        ///@brief Number of the full scan which saw the file last
+        uint64_t m_scan = 0;
+    };
+
+    void updateNextDue() noexcept;
+
+private:
+    std::chrono::milliseconds m_settleTime;
+    std::unordered_map<std::string, Pending> m_pending;
+    uint64_t m_scan = 0;
+    StatBatch m_statBatch;
+    std::vector<struct statx> m_stats;
+    std::atomic<Clock::rep> m_nextDue;
+    std::atomic<size_t> m_waiting{0};
+};
+
+} // namespace transfer
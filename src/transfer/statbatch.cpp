@@ -0,0 +1,72 @@
+#include <fcntl.h>
+#include <cerrno>
+#include <cstdint>
+#include <algorithm>
+
+#include "statbatch.h"
+
+namespace transfer {
+
+namespace {
+
+void prepStatx(struct io_uring_sqe* sqe, int dir, const std::string& name, struct statx* buffer)
+{
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd = dir;
+    sqe->addr = reinterpret_cast<uintptr_t>(name.c_str());
+    sqe->len = StatBatch::s_mask;
+    sqe->addr2 = reinterpret_cast<uintptr_t>(buffer);
+    sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+}
+
+} // unnamed namespace
+
+StatBatch::StatBatch(unsigned depth)
+    : m_depth(depth)
+{
+}
+
+void StatBatch::run(int dirFd, std::vector<struct statx>& stats, std::vector<int>& errors)
+{
+    const auto count = m_names.size();
+    stats.assign(count, {});
+    errors.assign(count, 0);
+    if (!m_ring && count != 0) {
+        m_ring.reset(new Ring(m_depth));
+        m_batched = m_ring->valid() && m_ring->supports(IORING_OP_STATX);
+    }
+    ///@brief Names whose statx the ring completed, the rest get a plain call
+    std::vector<bool> reaped(count, false);
+    size_t done = 0;
+    while (m_batched && done < count) {
+        auto batch = std::min<size_t>(count - done, m_ring->space());
+        for (size_t i = done; i < done + batch; ++i) {
+            auto sqe = m_ring->getSqe();
+            prepStatx(sqe, dirFd, *m_names[i], &stats[i]);
+            sqe->user_data = i;
+        }
+        int ret = m_ring->submit(static_cast<unsigned>(batch));
+        if (ret < 0 && ret != -EAGAIN && ret != -EBUSY) {
+            m_batched = false;
+            break;
+        }
+        for (size_t n = 0; n < batch; ++n) {
+            struct io_uring_cqe cqe;
+            if (!m_ring->wait(cqe)) {
+                m_batched = false;
+                break;
+            }
+            errors[cqe.user_data] = cqe.res < 0 ? -cqe.res : 0;
+            reaped[cqe.user_data] = true;
+        }
+        done += batch;
+    }
+    ///@brief Plain system calls for whatever the ring did not take or complete
+    for (size_t i = 0; i < count; ++i) {
+        if (!reaped[i] && statx(dirFd, m_names[i]->c_str(), AT_SYMLINK_NOFOLLOW, s_mask, &stats[i]) == -1) {
+            errors[i] = errno;
+        }
+    }
+}
+
+} // namespace transfer
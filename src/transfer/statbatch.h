@@ -0,0 +1,56 @@
+#pragma once
+
+#include <sys/stat.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ring.h"
+
+namespace transfer {
+
+/**
+ * @class  StatBatch
+ * @file   statbatch.h
+ * @brief  statx of many names of one directory, submitted to io_uring as one
+ *         batch per ring full where the kernel allows it and issued as plain
+ *         system calls otherwise. The ring is set up by the first stat() which
+ *         has something to stat. Not thread safe.
+ */
+class StatBatch
+{
+public:
+    explicit StatBatch(unsigned depth = s_defaultDepth);
+
+    StatBatch(const StatBatch&) = delete;
+    StatBatch& operator=(const StatBatch&) = delete;
+
+    /**
+     * @brief statx name(i) of dirFd for i < count without following symlinks,
+     * stats[i] and errors[i] (0 or an errno) receive the outcome of each
+     */
+    template <typename Name>
+    void stat(int dirFd, size_t count, Name name, std::vector<struct statx>& stats, std::vector<int>& errors)
+    {
+        m_names.clear();
+        for (size_t i = 0; i < count; ++i) {
+            m_names.push_back(&name(i));
+        }
+        run(dirFd, stats, errors);
+    }
+
+public:
+    static const unsigned s_defaultDepth = 64;
+    static const unsigned s_mask = STATX_TYPE | STATX_MODE | STATX_INO | STATX_SIZE | STATX_ATIME | STATX_MTIME;
+
+private:
+    void run(int dirFd, std::vector<struct statx>& stats, std::vector<int>& errors);
+
+private:
+    unsigned m_depth;
+    std::unique_ptr<Ring> m_ring;
+    bool m_batched = false;
+    std::vector<const std::string*> m_names;
+};
+
+} // namespace transfer
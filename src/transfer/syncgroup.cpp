@@ -0,0 +1,108 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <set>
+#include <string>
+
+#include "syncgroup.h"
+
+namespace transfer {
+
+namespace {
+
+///@brief fsync the catalogue fd and every directory of it in directories, the first errno or 0
+int syncDirectories(int fd, const std::set<std::string>& directories)
+{
+    int err = fsync(fd) == -1 ? errno : 0;
+    for (const auto& directory : directories) {
+        int dirFd = openat(fd, directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dirFd == -1 || fsync(dirFd) == -1) {
+            err = err != 0 ? err : errno;
+        }
+        if (dirFd != -1) {
+            close(dirFd);
+        }
+    }
+    return err;
+}
+
+} // unnamed namespace
+
+SyncGroup::SyncGroup(const Options& options)
+    : m_options(options)
+{
+}
+
+void SyncGroup::add(const Result& result, uint64_t journalId, bool unlinkSource)
+{
+    if (m_pending.empty()) {
+        m_since = std::chrono::steady_clock::now();
+    }
+    m_pending.push_back(Pending{result, journalId, unlinkSource});
+}
+
+bool SyncGroup::due() const noexcept
+{
+    if (m_pending.empty()) {
+        return false;
+    }
+    if (m_options.m_durability != Durability::Batch || m_pending.size() >= m_options.m_syncBatchFiles) {
+        return true;
+    }
+    return std::chrono::steady_clock::now() - m_since >= std::chrono::milliseconds(m_options.m_syncBatchLatency);
+}
+
+void SyncGroup::commit(int srcFd, int dstFd, Journal* journal, const Report& report)
+{
+    if (m_pending.empty()) {
+        return;
+    }
+    bool copies = false;
+    ///@brief Subdirectories the names of a recursive job went through, each holds an entry which changed
+    std::set<std::string> directories;
+    for (const auto& pending : m_pending) {
+        copies = copies || pending.m_unlinkSource;
+        const auto& name = pending.m_result.m_name;
+        auto slash = name.rfind('/');
+        while (slash != std::string::npos && slash != 0) {
+            directories.insert(name.substr(0, slash));
+            slash = name.rfind('/', slash - 1);
+        }
+    }
+    ///@brief Copied data is only covered by syncfs, unless every copy was synced on its own
+    int syncError = 0;
+    if (copies && m_options.m_durability == Durability::Batch) {
+        syncError = syncfs(dstFd) == -1 ? errno : 0;
+    } else {
+        syncError = syncDirectories(dstFd, directories);
+    }
+    for (auto& pending : m_pending) {
+        auto& result = pending.m_result;
+        if (pending.m_unlinkSource) {
+            ///@brief Keep the source of a copy which may not have reached the disk
+            if (syncError == 0 && unlinkat(srcFd, result.m_name.c_str(), 0) == -1) {
+                result.m_error = errno;
+            } else if (syncError != 0) {
+                result.m_error = syncError;
+            }
+            if (journal != nullptr) {
+                journal->finish(pending.m_journalId);
+            }
+        } else if (syncError != 0) {
+            result.m_error = syncError;
+        }
+        if (result.m_error != 0) {
+            result.m_status = Status::Failed;
+        }
+    }
+    ///@brief Renames and unlinks removed names from the source catalogue
+    if (syncError == 0) {
+        syncDirectories(srcFd, directories);
+    }
+    for (const auto& pending : m_pending) {
+        report(pending.m_result);
+    }
+    m_pending.clear();
+}
+
+} // namespace transfer
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "journal.h"
+#include "options.h"
+#include "result.h"
+
+namespace transfer {
+
+/**
+ * @class  SyncGroup
+ * @file   syncgroup.h
+ * @brief  Moves waiting for the sync which makes them durable. A copy keeps
+ *         its source until the group commits: the destination is synced
+ *         first, with one syncfs for the whole group under Durability::Batch
+ *         or else an fsync of every directory whose entries the group changed,
+ *         and only then are the sources unlinked and the results reported.
+ *         Under Durability::File every move is a group of its own.
+ */
+class SyncGroup
+{
+public:
+    explicit SyncGroup(const Options& options);
+
+    ///@brief unlinkSource: the result is a copy whose source is unlinked on commit
+    void add(const Result& result, uint64_t journalId, bool unlinkSource);
+
+    bool empty() const noexcept
+    {
+        return m_pending.empty();
+    }
+
+    ///@brief The group reached its size or latency bound
+    bool due() const noexcept;
+
+    ///@brief Sync, unlink the sources of the copies, finish their journal records and report every result
+    void commit(int srcFd, int dstFd, Journal* journal, const Report& report);
+
+private:
+    struct Pending
+    {
+        Result m_result;
+        uint64_t m_journalId;
+        bool m_unlinkSource;
+    };
+
+    const Options& m_options;
+    std::vector<Pending> m_pending;
+    std::chrono::steady_clock::time_point m_since;
+};
+
+} // namespace transfer
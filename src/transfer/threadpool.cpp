@@ -0,0 +1,127 @@
+#include <signal.h>
+#include <algorithm>
+
+#include "threadpool.h"
+
+namespace transfer {
+
+ThreadPool::ThreadPool(size_t threads)
+{
+    ///@brief Workers inherit the signal mask of the thread creating them
+    sigset_t all;
+    sigset_t previous;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &previous);
+    for (size_t i = 0; i < std::max<size_t>(threads, 1); ++i) {
+        m_threads.emplace_back([this] () {
+            work();
+        });
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_condition.notify_all();
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+}
+
+void ThreadPool::post(std::function<void()> task)
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_tasks.push_back(std::move(task));
+    }
+    m_condition.notify_one();
+}
+
+void ThreadPool::work()
+{
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this] () {
+                return m_stop || !m_tasks.empty();
+            });
+            if (m_tasks.empty()) {
+                return;
+            }
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+        task();
+    }
+}
+
+Helpers::Helpers(ThreadPool* pool, unsigned count, std::function<void(unsigned)> task)
+    : m_state(std::make_shared<State>())
+{
+    m_state->m_task = std::move(task);
+    m_state->m_count = count;
+    for (unsigned i = 0; pool != nullptr && i < count; ++i) {
+        ///@brief The posted task outlives the helpers if no worker got to it in time, it owns the state
+        auto state = m_state;
+        pool->post([state] () {
+            unsigned index;
+            {
+                std::unique_lock<std::mutex> lock(state->m_mutex);
+                if (state->m_next >= state->m_count) {
+                    return;
+                }
+                index = state->m_next++;
+                ++state->m_running;
+            }
+            state->m_task(index);
+            std::unique_lock<std::mutex> lock(state->m_mutex);
+            --state->m_running;
+            state->m_finished.notify_all();
+        });
+    }
+}
+
+Helpers::~Helpers()
+{
+    cancel();
+}
+
+void Helpers::join()
+{
+    while (true) {
+        unsigned index;
+        {
+            std::unique_lock<std::mutex> lock(m_state->m_mutex);
+            if (m_state->m_next >= m_state->m_count) {
+                break;
+            }
+            index = m_state->m_next++;
+        }
+        m_state->m_task(index);
+    }
+    wait();
+}
+
+void Helpers::cancel()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_state->m_mutex);
+        m_state->m_next = m_state->m_count;
+    }
+    wait();
+}
+
+void Helpers::wait()
+{
+    std::unique_lock<std::mutex> lock(m_state->m_mutex);
+    m_state->m_finished.wait(lock, [this] () {
+        return m_state->m_running == 0;
+    });
+}
+
+} // namespace transfer
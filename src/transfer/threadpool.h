@@ -0,0 +1,95 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace transfer {
+
+/**
+ * @class  ThreadPool
+ * @file   threadpool.h
+ * @brief  Fixed number of worker threads executing posted tasks in order.
+ *         Workers block every signal so that signals are always handled by
+ *         the thread which created the pool.
+ */
+class ThreadPool
+{
+public:
+    explicit ThreadPool(size_t threads);
+
+    ///@brief Runs the tasks still queued, then joins the workers
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void post(std::function<void()> task);
+
+    size_t size() const noexcept
+    {
+        return m_threads.size();
+    }
+
+private:
+    void work();
+
+private:
+    std::vector<std::thread> m_threads;
+    std::deque<std::function<void()> > m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    bool m_stop = false;
+};
+
+/**
+ * @class  Helpers
+ * @file   threadpool.h
+ * @brief  Lends pool workers to one piece of work of the calling thread: up to
+ *         count helpers are posted, each runs task with its own index once a
+ *         worker takes it. join() runs the helpers no worker started on the
+ *         calling thread, so work already running on the pool may wait for its
+ *         helpers without starving it. A helper never starts once join() or
+ *         cancel() returned. Without a pool every helper runs in join().
+ */
+class Helpers
+{
+public:
+    Helpers(ThreadPool* pool, unsigned count, std::function<void(unsigned)> task);
+    ///@brief Cancels the helpers no worker started and waits for the others
+    ~Helpers();
+
+    Helpers(const Helpers&) = delete;
+    Helpers& operator=(const Helpers&) = delete;
+
+    ///@brief Run the helpers no worker started, then wait for those running
+    void join();
+
+    ///@brief Drop the helpers no worker started, then wait for those running
+    void cancel();
+
+private:
+    struct State
+    {
+        std::function<void(unsigned)> m_task;
+        unsigned m_count = 0;
+        ///@brief Helpers started, on a worker or in join()
+        unsigned m_next = 0;
+        ///@brief Helpers still running on a worker
+        unsigned m_running = 0;
+        std::mutex m_mutex;
+        std::condition_variable m_finished;
+    };
+
+    ///@brief Wait until no helper runs on a worker any more
+    void wait();
+
+private:
+    std::shared_ptr<State> m_state;
+};
+
+} // namespace transfer
@@ -0,0 +1,161 @@
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include "throttle.h"
+
+namespace transfer {
+
+namespace {
+
+const double s_minFactor = 1.0 / 64;
+const double s_recovery = 1.0 / 16;
+///@brief Longest single pause while an unlimited job waits for a congested device
+const std::chrono::milliseconds s_congestionPause(50);
+
+///@brief Highest "I/Os currently in progress" among the devices, -1 if none was found
+long inFlight(const std::vector<dev_t>& devices)
+{
+    std::ifstream diskstats("/proc/diskstats");
+    std::string line;
+    long highest = -1;
+    while (std::getline(diskstats, line)) {
+        std::istringstream fields(line);
+        unsigned major = 0;
+        unsigned minor = 0;
+        std::string name;
+        if (!(fields >> major >> minor >> name)) {
+            continue;
+        }
+        if (std::find(devices.begin(), devices.end(), makedev(major, minor)) == devices.end()) {
+            continue;
+        }
+        ///@brief The ninth counter after the name, see Documentation/admin-guide/iostats.rst
+        unsigned long value = 0;
+        for (int i = 0; i < 9 && (fields >> value); ++i) {
+        }
+        if (fields) {
+            highest = std::max(highest, static_cast<long>(value));
+        }
+    }
+    return highest;
+}
+
+} // unnamed namespace
+
+const std::chrono::milliseconds Throttle::s_samplePeriod(100);
+
+Throttle::Throttle(uint64_t bytesPerSecond, uint64_t opsPerSecond, unsigned queueThreshold)
+    : m_queueThreshold(queueThreshold)
+{
+    auto now = Clock::now();
+    m_bytes.m_rate = bytesPerSecond;
+    m_bytes.m_tokens = static_cast<double>(bytesPerSecond);
+    m_bytes.m_refilled = now;
+    m_ops.m_rate = opsPerSecond;
+    m_ops.m_tokens = static_cast<double>(opsPerSecond);
+    m_ops.m_refilled = now;
+}
+
+void Throttle::watch(const std::string& path)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) == -1 || major(st.st_dev) == 0) {
+        return; // tmpfs, overlay and friends have no queue to look at
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (std::find(m_devices.begin(), m_devices.end(), st.st_dev) == m_devices.end()) {
+        m_devices.push_back(st.st_dev);
+    }
+}
+
+size_t Throttle::chunk(size_t wanted) const noexcept
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_bytes.m_rate == 0) {
+        return wanted;
+    }
+    ///@brief A tenth of a second worth of bytes keeps the pacing smooth
+    auto limit = static_cast<size_t>(static_cast<double>(m_bytes.m_rate) * m_factor / 10);
+    return std::max<size_t>(std::min(wanted, limit), 64 << 10);
+}
+
+void Throttle::bytes(uint64_t count) noexcept
+{
+    Clock::duration wait;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto now = Clock::now();
+        bool busy = congested(now);
+        wait = take(m_bytes, static_cast<double>(count), now);
+        if (busy && m_bytes.m_rate == 0) {
+            wait = std::max<Clock::duration>(wait, s_congestionPause);
+        }
+    }
+    sleepFor(wait);
+}
+
+void Throttle::operations(uint64_t count) noexcept
+{
+    Clock::duration wait;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto now = Clock::now();
+        bool busy = congested(now);
+        wait = take(m_ops, static_cast<double>(count), now);
+        if (busy && m_ops.m_rate == 0 && m_bytes.m_rate == 0) {
+            wait = std::max<Clock::duration>(wait, s_congestionPause);
+        }
+    }
+    sleepFor(wait);
+}
+
+double Throttle::factor() const noexcept
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_factor;
+}
+
+Throttle::Clock::duration Throttle::take(Bucket& bucket, double count, Clock::time_point now) noexcept
+{
+    if (bucket.m_rate == 0) {
+        return Clock::duration::zero();
+    }
+    double rate = static_cast<double>(bucket.m_rate) * m_factor;
+    double elapsed = std::chrono::duration<double>(now - bucket.m_refilled).count();
+    bucket.m_refilled = now;
+    bucket.m_tokens = std::min(bucket.m_tokens + elapsed * rate, rate) - count;
+    if (bucket.m_tokens >= 0) {
+        return Clock::duration::zero();
+    }
+    return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(-bucket.m_tokens / rate));
+}
+
+bool Throttle::congested(Clock::time_point now) noexcept
+{
+    if (m_queueThreshold == 0 || m_devices.empty() || now - m_sampled < s_samplePeriod) {
+        return m_congested;
+    }
+    m_sampled = now;
+    long queue = -1;
+    try {
+        queue = inFlight(m_devices);
+    } catch (const std::exception&) {
+        return m_congested;
+    }
+    m_congested = queue > static_cast<long>(m_queueThreshold);
+    m_factor = m_congested ? std::max(m_factor / 2, s_minFactor) : std::min(m_factor + s_recovery, 1.0);
+    return m_congested;
+}
+
+void Throttle::sleepFor(Clock::duration duration) noexcept
+{
+    if (duration > Clock::duration::zero()) {
+        std::this_thread::sleep_for(duration);
+    }
+}
+
+} // namespace transfer
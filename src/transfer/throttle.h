@@ -0,0 +1,80 @@
+#pragma once
+
+#include <sys/types.h>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace transfer {
+
+/**
+ * @class  Throttle
+ * @file   throttle.h
+ * @brief  Token buckets limiting the bytes and operations per second of one
+ *         job. Callers take what they used and sleep while the bucket is in
+ *         debt, a bucket holds at most one second worth of tokens.
+ *         With a queue threshold set, the "I/Os currently in progress" of the
+ *         watched block devices is sampled from /proc/diskstats: above the
+ *         threshold the rates are halved, down to 1/64 of the configured
+ *         ones, below it they grow back by 1/16 per sample. Without a
+ *         configured rate a congested device simply pauses the transfers.
+ *         Every member may be called concurrently.
+ */
+class Throttle
+{
+public:
+    ///@brief 0 disables the corresponding limit
+    Throttle(uint64_t bytesPerSecond, uint64_t opsPerSecond, unsigned queueThreshold);
+
+    Throttle(const Throttle&) = delete;
+    Throttle& operator=(const Throttle&) = delete;
+
+    ///@brief Watch the block device path lives on, file systems without one are ignored
+    void watch(const std::string& path);
+
+    ///@brief Largest amount of bytes one copy call should move, wanted if unlimited
+    size_t chunk(size_t wanted) const noexcept;
+
+    ///@brief Account bytes which were just copied, sleeps while the bucket is in debt
+    void bytes(uint64_t count) noexcept;
+
+    ///@brief Account operations about to be issued, sleeps while the bucket is in debt
+    void operations(uint64_t count) noexcept;
+
+    ///@brief Fraction of the configured rates currently allowed
+    double factor() const noexcept;
+
+public:
+    ///@brief Minimal time between two samples of /proc/diskstats
+    static const std::chrono::milliseconds s_samplePeriod;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Bucket
+    {
+        uint64_t m_rate = 0;
+        double m_tokens = 0;
+        Clock::time_point m_refilled;
+    };
+
+    ///@brief Take count tokens from bucket, returns how long the caller has to sleep
+    Clock::duration take(Bucket& bucket, double count, Clock::time_point now) noexcept;
+    ///@brief Sample the watched devices when the period elapsed, true if one of them is congested
+    bool congested(Clock::time_point now) noexcept;
+    void sleepFor(Clock::duration duration) noexcept;
+
+private:
+    Bucket m_bytes;
+    Bucket m_ops;
+    unsigned m_queueThreshold;
+    std::vector<dev_t> m_devices;
+    double m_factor = 1.0;
+    bool m_congested = false;
+    Clock::time_point m_sampled;
+    mutable std::mutex m_mutex;
+};
+
+} // namespace transfer
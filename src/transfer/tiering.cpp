@@ -0,0 +1,212 @@
+#include <fcntl.h>
+#include <cerrno>
+#include <algorithm>
+#include <functional>
+#include <limits>
+
+#include "mover.h"
+#include "tiering.h"
+
+namespace transfer {
+
+namespace {
+
+int64_t nanoseconds(const struct statx_timestamp& time) noexcept
+{
+    return static_cast<int64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+int64_t wallClock() noexcept
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+} // unnamed namespace
+
+Tiering::Tiering(const std::vector<Tier>& tiers, AgeClock clock)
+    : m_clock(clock)
+    , m_levels(tiers.size())
+    , m_statBatch(s_statBatch)
+    , m_nextDue(Clock::time_point::max().time_since_epoch().count())
+{
+    for (const auto& tier : tiers) {
+        m_ages.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(tier.m_age).count());
+    }
+}
+
+int Tiering::evaluate(size_t index, int dirFd, bool includeHidden, std::vector<std::vector<Entry> >& due)
+{
+    due.assign(m_ages.size(), std::vector<Entry>());
+    auto now = wallClock();
+    auto& level = m_levels[index];
+    if (dirFd == -1) {
+        level = Level();
+        updateNextDue(now);
+        return 0;
+    }
+    ///@brief Files only come and go through the directory, its modification time tells whether any did
+    struct statx directory;
+    int64_t modified = -1;
+    if (statx(dirFd, "", AT_EMPTY_PATH, STATX_MTIME, &directory) == 0) {
+        modified = nanoseconds(directory.stx_mtime);
+    }
+    int error = 0;
+    if (modified == -1 || modified != level.m_listed) {
+        error = list(index, dirFd, includeHidden);
+        ///@brief A change within the granularity of the timestamp would not show, list such a directory again
+        level.m_listed = error == 0 && now - modified >= s_coarseTime ? modified : -1;
+    }
+    examine(index, dirFd, now, due);
+    updateNextDue(now);
+    return error;
+}
+
+int Tiering::list(size_t index, int dirFd, bool includeHidden)
+{
+    auto& level = m_levels[index];
+    ++level.m_listing;
+    Scanner scanner(dirFd);
+    std::vector<Entry> entries;
+    std::vector<Entry> fresh;
+    while (scanner.next(entries, includeHidden)) {
+        fresh.clear();
+        for (auto& entry : entries) {
+            ///@brief Directories and special files stay where they are
+            if ((entry.m_type != DT_REG && entry.m_type != DT_UNKNOWN) || Mover::isTemporary(entry.m_name)) {
+                continue;
+            }
+            auto it = level.m_records.find(entry.m_inode);
+            if (entry.m_inode != 0 && it != level.m_records.end() && it->second.m_name == entry.m_name) {
+                it->second.m_listing = level.m_listing;
+                continue;
+            }
+            fresh.push_back(std::move(entry));
+        }
+        track(index, dirFd, fresh);
+    }
+    if (scanner.error() != 0) {
+        return scanner.error();
+    }
+    for (auto it = level.m_records.begin(); it != level.m_records.end(); ) {
+        if (it->second.m_listing != level.m_listing) {
+            it = level.m_records.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    ///@brief Slots of forgotten files pile up in the heap until they are popped, rebuild it once they dominate
+    if (level.m_heap.size() > 2 * level.m_records.size() + s_statBatch) {
+        level.m_heap.clear();
+        for (const auto& item : level.m_records) {
+            level.m_heap.emplace_back(item.second.m_due, item.first);
+        }
+        std::make_heap(level.m_heap.begin(), level.m_heap.end(), std::greater<Slot>());
+    }
+    return 0;
+}
+
+void Tiering::track(size_t index, int dirFd, const std::vector<Entry>& entries)
+{
+    auto& level = m_levels[index];
+    m_statBatch.stat(dirFd, entries.size(), [&entries] (size_t i) -> const std::string& {
+        return entries[i].m_name;
+    }, m_stats, m_errors);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const auto& stx = m_stats[i];
+        if (m_errors[i] != 0 || !S_ISREG(stx.stx_mode)) {
+            continue;
+        }
+        auto& record = level.m_records[stx.stx_ino];
+        record.m_name = entries[i].m_name;
+        record.m_due = stamp(stx) + m_ages[index];
+        record.m_listing = level.m_listing;
+        push(level, record.m_due, stx.stx_ino);
+    }
+}
+
+void Tiering::examine(size_t index, int dirFd, int64_t now, std::vector<std::vector<Entry> >& due)
+{
+    auto& level = m_levels[index];
+    std::vector<uint64_t> inodes;
+    while (!level.m_heap.empty() && level.m_heap.front().first <= now) {
+        std::pop_heap(level.m_heap.begin(), level.m_heap.end(), std::greater<Slot>());
+        auto slot = level.m_heap.back();
+        level.m_heap.pop_back();
+        auto it = level.m_records.find(slot.second);
+        if (it == level.m_records.end() || it->second.m_due != slot.first) {
+            continue;
+        }
+        ///@brief A second slot of the same time must not pick the file twice
+        it->second.m_due = -1;
+        inodes.push_back(slot.second);
+    }
+    ///@brief The file may have been read or rewritten since its time was worked out, ask again
+    m_statBatch.stat(dirFd, inodes.size(), [&level, &inodes] (size_t i) -> const std::string& {
+        return level.m_records[inodes[i]].m_name;
+    }, m_stats, m_errors);
+    for (size_t i = 0; i < inodes.size(); ++i) {
+        const auto& stx = m_stats[i];
+        auto it = level.m_records.find(inodes[i]);
+        if (m_errors[i] != 0 || !S_ISREG(stx.stx_mode) || stx.stx_ino != inodes[i]) {
+            ///@brief Gone or replaced, the next listing finds whatever took the name
+            level.m_records.erase(it);
+            level.m_listed = -1;
+            continue;
+        }
+        auto from = stamp(stx);
+        auto target = reached(index, from, now);
+        if (target == index) {
+            it->second.m_due = from + m_ages[index];
+            push(level, it->second.m_due, inodes[i]);
+            continue;
+        }
+        Entry entry;
+        entry.m_name = std::move(it->second.m_name);
+        entry.m_type = DT_REG;
+        entry.m_inode = inodes[i];
+        due[target - 1].push_back(std::move(entry));
+        ///@brief Moving changes the directory, a file which stayed is tracked again by the next listing
+        level.m_records.erase(it);
+        level.m_listed = -1;
+    }
+}
+
+void Tiering::push(Level& level, int64_t due, uint64_t inode)
+{
+    level.m_heap.emplace_back(due, inode);
+    std::push_heap(level.m_heap.begin(), level.m_heap.end(), std::greater<Slot>());
+}
+
+int64_t Tiering::stamp(const struct statx& stx) const noexcept
+{
+    auto modified = nanoseconds(stx.stx_mtime);
+    return m_clock == AgeClock::Accessed ? std::max(modified, nanoseconds(stx.stx_atime)) : modified;
+}
+
+size_t Tiering::reached(size_t index, int64_t stamp, int64_t now) const noexcept
+{
+    while (index < m_ages.size() && now - stamp >= m_ages[index]) {
+        ++index;
+    }
+    return index;
+}
+
+void Tiering::updateNextDue(int64_t now) noexcept
+{
+    auto next = std::numeric_limits<int64_t>::max();
+    for (const auto& level : m_levels) {
+        if (!level.m_heap.empty()) {
+            next = std::min(next, level.m_heap.front().first);
+        }
+    }
+    if (next == std::numeric_limits<int64_t>::max()) {
+        m_nextDue = Clock::time_point::max().time_since_epoch().count();
+        return;
+    }
+    ///@brief Ages run on the wall clock, the dispatcher waits on the steady one
+    auto wait = std::chrono::nanoseconds(std::max<int64_t>(next - now, 0));
+    m_nextDue = (Clock::now() + std::chrono::duration_cast<Clock::duration>(wait)).time_since_epoch().count();
+}
+
+} // namespace transfer
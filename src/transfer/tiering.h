@@ -0,0 +1,129 @@
+#pragma once
+
+#include <sys/stat.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "scanner.h"
+#include "statbatch.h"
+
+namespace transfer {
+
+///@brief What the age of a file counts from
+enum class AgeClock
+{
+    Modified,   ///< its last modification
+    Accessed    ///< its last read or modification, whichever came later
+};
+
+///@brief Catalogue files move on to once they are at least m_age old
+struct Tier
+{
+    std::string m_catalogue;
+    std::chrono::seconds m_age = std::chrono::seconds(0);
+};
+
+/**
+ * @class  Tiering
+ * @file   tiering.h
+ * @brief  Age policy of a tiered job: files move from the source to the
+ *         catalogue of the oldest tier whose age they reached, and on from
+ *         there as they grow older. Every catalogue but the last keeps a table
+ *         of its files by inode holding the time each one reaches its next
+ *         tier, and a heap ordered by that time. A pass lists a catalogue only
+ *         if its directory changed since the last listing and stats only the
+ *         inodes the table does not know yet, with batched statx; what it
+ *         re-examines are the files whose time came, so a pass over millions
+ *         of files which are not due costs a statx of each directory.
+ *         Not thread safe apart from nextDue().
+ */
+class Tiering
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    ///@brief tiers are ordered by increasing age, the source is level 0 and tiers[i] level i + 1
+    Tiering(const std::vector<Tier>& tiers, AgeClock clock);
+
+    Tiering(const Tiering&) = delete;
+    Tiering& operator=(const Tiering&) = delete;
+
+    ///@brief Catalogue levels files move out of: the source and every tier but the last
+    size_t levels() const noexcept
+    {
+        return m_levels.size();
+    }
+
+    /**
+     * @brief Pass over the catalogue of level, open as dirFd; -1 if it could not be
+     * opened, which forgets its table. due[i] receives the files to move into
+     * tiers[i] and is left empty for i < level. Files handed out are forgotten,
+     * the next listing picks up those which could not be moved. Hidden entries
+     * are tracked only if includeHidden is set, temporaries of the movers never.
+     * @return 0 or the errno of reading the directory
+     */
+    int evaluate(size_t level, int dirFd, bool includeHidden, std::vector<std::vector<Entry> >& due);
+
+    ///@brief Earliest time a tracked file reaches its next tier, Clock::time_point::max() if none; any thread
+    Clock::time_point nextDue() const noexcept
+    {
+        return Clock::time_point(Clock::duration(m_nextDue.load()));
+    }
+
+public:
+    ///@brief statx requests submitted at once
+    static const unsigned s_statBatch = 64;
+    ///@brief Directory timestamps are coarse: one changed this recently is listed again regardless
+    static const int64_t s_coarseTime = 1000000000;
+
+private:
+    struct Record
+    {
+        std::string m_name;
+        ///@brief Wall clock nanoseconds the file reaches the next tier at
+        int64_t m_due = 0;
+        ///@brief Number of the listing which saw the file last
+        uint32_t m_listing = 0;
+    };
+
+    ///@brief Due time and inode, the heap keeps the earliest on top; stale pairs are skipped when popped
+    using Slot = std::pair<int64_t, uint64_t>;
+
+    struct Level
+    {
+        std::unordered_map<uint64_t, Record> m_records;
+        std::vector<Slot> m_heap;
+        ///@brief Modification time of the directory at its last complete listing, -1 to list it again
+        int64_t m_listed = -1;
+        uint32_t m_listing = 0;
+    };
+
+    ///@brief List the catalogue of level index again, 0 or the errno of reading it
+    int list(size_t index, int dirFd, bool includeHidden);
+    ///@brief Stat the files of entries and add them to level index
+    void track(size_t index, int dirFd, const std::vector<Entry>& entries);
+    ///@brief Re-examine the files of level index whose time came
+    void examine(size_t index, int dirFd, int64_t now, std::vector<std::vector<Entry> >& due);
+    static void push(Level& level, int64_t due, uint64_t inode);
+    ///@brief Wall clock nanoseconds the age of a file counts from
+    int64_t stamp(const struct statx& stx) const noexcept;
+    ///@brief Level a file of level index belongs in, index itself if it reached no further tier
+    size_t reached(size_t index, int64_t stamp, int64_t now) const noexcept;
+    void updateNextDue(int64_t now) noexcept;
+
+private:
+    std::vector<int64_t> m_ages;
+    AgeClock m_clock;
+    std::vector<Level> m_levels;
+    StatBatch m_statBatch;
+    std::vector<struct statx> m_stats;
+    std::vector<int> m_errors;
+    std::atomic<Clock::rep> m_nextDue;
+};
+
+} // namespace transfer
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace transfer {
+
+/**
+ * @class  Traffic
+ * @file   traffic.h
+ * @brief  Copies of one job in flight and the bytes they carry, for status
+ *         reports. Renames move no data and are not counted. Every member
+ *         may be called concurrently.
+ */
+class Traffic
+{
+public:
+    ///@brief A copy of bytes starts
+    void begin(uint64_t bytes) noexcept
+    {
+        ++m_copies;
+        m_inFlight += bytes;
+    }
+
+    ///@brief The copy begin() announced ended, copied tells whether it landed
+    void end(uint64_t bytes, bool copied) noexcept
+    {
+        m_inFlight -= bytes;
+        --m_copies;
+        if (copied) {
+            m_copied += bytes;
+        }
+    }
+
+    unsigned copies() const noexcept
+    {
+        return m_copies.load(std::memory_order_relaxed);
+    }
+
+    uint64_t inFlight() const noexcept
+    {
+        return m_inFlight.load(std::memory_order_relaxed);
+    }
+
+    ///@brief Bytes of every copy which landed
+    uint64_t copied() const noexcept
+    {
+        return m_copied.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<unsigned> m_copies{0};
+    std::atomic<uint64_t> m_inFlight{0};
+    std::atomic<uint64_t> m_copied{0};
+};
+
+} // namespace transfer
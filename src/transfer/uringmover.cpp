@@ -0,0 +1,626 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstdint>
+#include <algorithm>
+
+#include "uringmover.h"
+
+namespace transfer {
+
+namespace {
+
+///@brief Upper bound of copy chains running at the same time
+const size_t s_maxChains = 16;
+const int s_pipeSize = 1 << 20;
+
+const unsigned char s_requiredOps[] = {
+    IORING_OP_RENAMEAT,
+    IORING_OP_STATX,
+    IORING_OP_OPENAT,
+    IORING_OP_SPLICE,
+    IORING_OP_UNLINKAT,
+};
+
+uint64_t pointer(const void* ptr)
+{
+    return reinterpret_cast<uintptr_t>(ptr);
+}
+
+void prepRename(struct io_uring_sqe* sqe, int oldDir, const std::string& oldName,
+                int newDir, const std::string& newName)
+{
+    sqe->opcode = IORING_OP_RENAMEAT;
+    sqe->fd = oldDir;
+    sqe->addr = pointer(oldName.c_str());
+    sqe->len = static_cast<unsigned>(newDir);
+    sqe->addr2 = pointer(newName.c_str());
+}
+
+void prepUnlink(struct io_uring_sqe* sqe, int dir, const std::string& name)
+{
+    sqe->opcode = IORING_OP_UNLINKAT;
+    sqe->fd = dir;
+    sqe->addr = pointer(name.c_str());
+}
+
+void prepOpen(struct io_uring_sqe* sqe, int dir, const std::string& name, int flags, mode_t mode)
+{
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = dir;
+    sqe->addr = pointer(name.c_str());
+    sqe->len = mode;
+    sqe->open_flags = static_cast<unsigned>(flags);
+}
+
+void prepStatx(struct io_uring_sqe* sqe, int dir, const std::string& name, struct statx* buffer)
+{
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd = dir;
+    sqe->addr = pointer(name.c_str());
+    sqe->len = STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_ATIME | STATX_MTIME;
+    sqe->addr2 = pointer(buffer);
+    sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+}
+
+///@brief offset -1 means the current position, which is what a pipe end needs
+void prepSplice(struct io_uring_sqe* sqe, int in, int64_t inOffset, int out, int64_t outOffset, unsigned length)
+{
+    sqe->opcode = IORING_OP_SPLICE;
+    sqe->fd = out;
+    sqe->off = static_cast<uint64_t>(outOffset);
+    sqe->splice_fd_in = in;
+    sqe->splice_off_in = static_cast<uint64_t>(inOffset);
+    sqe->len = length;
+}
+
+///@brief Whether name was renamed from srcDir into dstDir, for a rename the ring gave up on
+bool renamed(int srcDir, int dstDir, const std::string& name)
+{
+    struct stat st;
+    return fstatat(srcDir, name.c_str(), &st, AT_SYMLINK_NOFOLLOW) == -1 && errno == ENOENT &&
+           fstatat(dstDir, name.c_str(), &st, AT_SYMLINK_NOFOLLOW) == 0;
+}
+
+///@brief Whether name in dir is the file open as fd
+bool sameFile(int fd, int dir, const std::string& name)
+{
+    struct stat opened;
+    struct stat named;
+    return fstat(fd, &opened) == 0 && fstatat(dir, name.c_str(), &named, AT_SYMLINK_NOFOLLOW) == 0 &&
+           opened.st_dev == named.st_dev && opened.st_ino == named.st_ino;
+}
+
+///@brief One cross-device file on its way through the copy chain
+struct Copy
+{
+    size_t m_index = 0;
+    struct statx m_stat;
+    int m_in = -1;
+    int m_out = -1;
+    std::string m_tmpName;
+    ///@brief Position of the rename in the chain, the unlink follows it
+    unsigned m_renameOp = 0;
+    ///@brief Requests submitted and not reaped yet
+    unsigned m_pending = 0;
+    bool m_chained = false;
+    ///@brief The copy is in place under its final name
+    bool m_renamed = false;
+    ///@brief The ring failed while requests of the copy were in flight, the kernel may still run them
+    bool m_abandoned = false;
+    ///@brief Reflinked before chaining, the chain only renames and unlinks
+    bool m_cloned = false;
+    uint64_t m_journalId = 0;
+    int m_copyError = 0;
+    int m_renameError = 0;
+    int m_unlinkError = 0;
+    int m_syncError = 0;
+};
+
+/**
+ * @brief Work out what became of the chain of copy from the catalogues once the ring failed with
+ * requests of it in flight. If the copy is in place under its final name the data is complete and
+ * only the unlink of the source may be outstanding; otherwise it is abandoned, not retried.
+ */
+void settle(int srcDir, int dstDir, const std::string& name, Copy& copy, Durability durability)
+{
+    copy.m_pending = 0;
+    if (!copy.m_renamed) {
+        copy.m_renamed = copy.m_copyError == 0 && sameFile(copy.m_out, dstDir, name);
+    }
+    if (!copy.m_renamed) {
+        copy.m_copyError = copy.m_copyError != 0 ? copy.m_copyError : ECANCELED;
+        copy.m_abandoned = true;
+        return;
+    }
+    copy.m_renameError = 0;
+    if (durability == Durability::None && unlinkat(srcDir, name.c_str(), 0) == -1 && errno != ENOENT) {
+        copy.m_unlinkError = errno;
+    }
+}
+
+} // unnamed namespace
+
+UringMover::UringMover(const std::string& source, const std::string& destination, unsigned queueDepth,
+                       const Options& options)
+    : m_mover(source, destination, options)
+    , m_ring(queueDepth)
+{
+    m_accelerated = m_ring.valid() && m_ring.capacity() >= 2;
+    for (auto op : s_requiredOps) {
+        m_accelerated = m_accelerated && m_ring.supports(op);
+    }
+}
+
+UringMover::~UringMover()
+{
+    for (auto fd : m_pipes) {
+        close(fd);
+    }
+}
+
+void UringMover::moveAll(const Report& report, const Select& select)
+{
+    m_mover.scan([this, &report] (const std::vector<Entry>& entries) {
+        for (const auto& result : moveBatch(entries)) {
+            report(result);
+        }
+    }, select);
+}
+
+std::vector<Result> UringMover::moveBatch(const std::vector<Entry>& entries)
+{
+    ///@brief Compression is bound by the CPU, not by system calls the ring could batch
+    if (!valid() || !m_accelerated || m_mover.options().m_compression != Compression::None) {
+        return m_mover.moveBatch(entries);
+    }
+    std::vector<Result> results(entries.size());
+    std::vector<size_t> crossDevice;
+    std::vector<Deferred> deferred(entries.size());
+    renameAll(entries, results, crossDevice, deferred);
+    if (!crossDevice.empty()) {
+        copyAll(entries, results, crossDevice, deferred);
+    }
+    if (m_mover.options().m_durability == Durability::None) {
+        return results;
+    }
+    std::vector<Result> committed;
+    committed.reserve(results.size());
+    auto collect = [&committed] (const Result& result) {
+        committed.push_back(result);
+    };
+    for (size_t i = 0; i < results.size(); ++i) {
+        if (!deferred[i].m_pending) {
+            committed.push_back(results[i]);
+            continue;
+        }
+        m_mover.defer(results[i], deferred[i].m_journalId, deferred[i].m_unlinkSource);
+        if (m_mover.due()) {
+            m_mover.commit(collect);
+        }
+    }
+    m_mover.commit(collect);
+    return committed;
+}
+
+bool UringMover::reap(std::vector<struct io_uring_cqe>& completions)
+{
+    completions.clear();
+    int ret = m_ring.submit(1);
+    if (ret < 0 && ret != -EAGAIN && ret != -EBUSY) {
+        m_accelerated = false;
+        return false;
+    }
+    struct io_uring_cqe cqe;
+    while (m_ring.peek(cqe)) {
+        completions.push_back(cqe);
+    }
+    return true;
+}
+
+bool UringMover::addPipe()
+{
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == -1) {
+        return false;
+    }
+    fcntl(fds[1], F_SETPIPE_SZ, s_pipeSize);
+    auto size = static_cast<size_t>(fcntl(fds[1], F_GETPIPE_SZ));
+    ///@brief A chunk never exceeds the smallest pipe, a splice into it would come back short
+    if (m_chunkSize != 0 && size < m_chunkSize) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    m_chunkSize = m_chunkSize == 0 ? size : m_chunkSize;
+    m_pipes.push_back(fds[0]);
+    m_pipes.push_back(fds[1]);
+    return true;
+}
+
+void UringMover::replacePipe(size_t at)
+{
+    close(m_pipes[at]);
+    close(m_pipes[at + 1]);
+    m_pipes[at] = m_pipes[m_pipes.size() - 2];
+    m_pipes[at + 1] = m_pipes.back();
+    m_pipes.resize(m_pipes.size() - 2);
+    if (addPipe()) {
+        std::swap(m_pipes[at], m_pipes[m_pipes.size() - 2]);
+        std::swap(m_pipes[at + 1], m_pipes.back());
+    }
+}
+
+void UringMover::renameAll(const std::vector<Entry>& entries, std::vector<Result>& results,
+                           std::vector<size_t>& crossDevice, std::vector<Deferred>& deferred)
+{
+    std::vector<struct io_uring_cqe> completions;
+    std::vector<bool> submitted(entries.size(), false);
+    size_t next = 0;
+    size_t inFlight = 0;
+    while (next < entries.size() || inFlight > 0) {
+        while (next < entries.size() && inFlight < m_ring.capacity()) {
+            const auto& name = entries[next].m_name;
+            results[next].m_name = name;
+            results[next].m_error = m_mover.makeParent(name);
+            if (results[next].m_error != 0) {
+                ++next;
+                continue;
+            }
+            auto sqe = m_ring.getSqe();
+            if (sqe == nullptr) {
+                break;
+            }
+            if (m_mover.throttle() != nullptr) {
+                m_mover.throttle()->operations(1);
+            }
+            prepRename(sqe, m_mover.sourceFd(), name, m_mover.destinationFd(), name);
+            submitted[next] = true;
+            sqe->user_data = next++;
+            ++inFlight;
+        }
+        if (inFlight == 0) {
+            continue;
+        }
+        if (!reap(completions)) {
+            ///@brief A rename in flight may still happen, the catalogues tell whether it did; a retry could not
+            for (size_t i = 0; i < next; ++i) {
+                if (!submitted[i]) {
+                    continue;
+                }
+                if (renamed(m_mover.sourceFd(), m_mover.destinationFd(), entries[i].m_name)) {
+                    results[i].m_status = Status::Renamed;
+                    deferred[i].m_pending = true;
+                } else {
+                    results[i].m_error = ECANCELED;
+                }
+            }
+            ///@brief Whatever was not submitted yet takes the plain path
+            for (; next < entries.size(); ++next) {
+                results[next] = m_mover.moveOne(entries[next]);
+            }
+            return;
+        }
+        for (const auto& cqe : completions) {
+            --inFlight;
+            submitted[cqe.user_data] = false;
+            auto& result = results[cqe.user_data];
+            if (cqe.res == 0) {
+                result.m_status = Status::Renamed;
+                deferred[cqe.user_data].m_pending = true;
+            } else if (cqe.res == -EXDEV) {
+                crossDevice.push_back(cqe.user_data);
+            } else {
+                result.m_error = -cqe.res;
+            }
+        }
+    }
+}
+
+void UringMover::copyAll(const std::vector<Entry>& entries, std::vector<Result>& results,
+                         const std::vector<size_t>& crossDevice, std::vector<Deferred>& deferred)
+{
+    auto fallback = [this, &entries, &results] (size_t index) {
+        auto& result = results[index];
+        result.m_error = m_mover.copyAcross(entries[index], result.m_strategy);
+        result.m_status = result.m_error == 0 ? Status::Copied :
+            result.m_error == EISDIR ? Status::Skipped : Status::Failed;
+    };
+
+    while (m_pipes.size() < 2 * s_maxChains && addPipe()) {
+    }
+    ///@brief Splice chains never show the bytes to user space, verified copies take the plain path
+    if (m_pipes.empty() || !m_accelerated || m_mover.options().m_verify != Verify::None) {
+        for (auto index : crossDevice) {
+            fallback(index);
+        }
+        return;
+    }
+
+    std::vector<Copy> copies(crossDevice.size());
+    for (size_t i = 0; i < copies.size(); ++i) {
+        copies[i].m_index = crossDevice[i];
+        copies[i].m_tmpName = Mover::temporaryName(entries[crossDevice[i]].m_name);
+        ///@brief The directory already told the type, no need to stat what can not be copied
+        auto type = entries[crossDevice[i]].m_type;
+        if (type == DT_DIR) {
+            copies[i].m_copyError = EISDIR;
+        } else if (type != DT_UNKNOWN && type != DT_REG) {
+            copies[i].m_copyError = EINVAL;
+        }
+    }
+    std::vector<struct io_uring_cqe> completions;
+    ///@brief Linked chains, a file which does not fit into the ring is copied with plain calls
+    auto chainLength = [this] (const Copy& copy) -> uint64_t {
+        auto size = copy.m_cloned ? 0 : copy.m_stat.stx_size;
+        auto threshold = m_mover.options().m_parallelThreshold;
+        if (threshold != 0 && size >= threshold) {
+            return UINT64_MAX; // left to the parallel range copy
+        }
+        return 2 * ((size + m_chunkSize - 1) / m_chunkSize) + 2;
+    };
+    auto journal = m_mover.journal();
+    auto durability = m_mover.options().m_durability;
+
+    ///@brief Stat then open every file, two independent requests per file
+    for (int stage = 0; stage < 2; ++stage) {
+        ///@brief One sync makes the intents of every chain durable before any temporary is created
+        if (stage == 1 && journal != nullptr) {
+            for (auto& copy : copies) {
+                if (copy.m_copyError == 0 && chainLength(copy) <= m_ring.capacity()) {
+                    const auto& stx = copy.m_stat;
+                    copy.m_journalId = journal->begin(m_mover.source(), m_mover.destination(),
+                                                      entries[copy.m_index].m_name, stx.stx_size,
+                                                      stx.stx_mtime.tv_sec * 1000000000ll + stx.stx_mtime.tv_nsec);
+                }
+            }
+            ///@brief A copy whose intent is not durable does not start
+            int err = journal->commit();
+            for (auto& copy : copies) {
+                if (err != 0 && copy.m_journalId != 0) {
+                    journal->finish(copy.m_journalId);
+                    copy.m_journalId = 0;
+                    copy.m_copyError = err;
+                }
+            }
+        }
+        size_t next = 0;
+        size_t inFlight = 0;
+        while (next < copies.size() || inFlight > 0) {
+            while (next < copies.size() && inFlight + 2 <= m_ring.capacity() && m_ring.space() >= 2) {
+                auto index = next++;
+                auto& copy = copies[index];
+                ///@brief A file too large for a chain is left to the plain calls, which journal it themselves
+                if (copy.m_copyError != 0 || (stage == 1 && chainLength(copy) > m_ring.capacity())) {
+                    continue;
+                }
+                const auto& name = entries[copy.m_index].m_name;
+                if (stage == 0) {
+                    auto sqe = m_ring.getSqe();
+                    prepStatx(sqe, m_mover.sourceFd(), name, &copy.m_stat);
+                    sqe->user_data = index << 1;
+                    ++copy.m_pending;
+                    ++inFlight;
+                } else {
+                    auto sqe = m_ring.getSqe();
+                    prepOpen(sqe, m_mover.sourceFd(), name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC, 0);
+                    sqe->user_data = index << 1;
+                    sqe = m_ring.getSqe();
+                    prepOpen(sqe, m_mover.destinationFd(), copy.m_tmpName,
+                             O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, copy.m_stat.stx_mode & 07777);
+                    sqe->user_data = (index << 1) | 1;
+                    copy.m_pending += 2;
+                    inFlight += 2;
+                }
+            }
+            if (inFlight == 0) {
+                continue;
+            }
+            if (!reap(completions)) {
+                ///@brief An open still in flight may create the temporary later, such a copy is not retried
+                for (auto& copy : copies) {
+                    if (copy.m_pending != 0) {
+                        copy.m_copyError = ECANCELED;
+                        copy.m_abandoned = true;
+                        copy.m_pending = 0;
+                    }
+                }
+                break;
+            }
+            for (const auto& cqe : completions) {
+                --inFlight;
+                auto& copy = copies[cqe.user_data >> 1];
+                --copy.m_pending;
+                if (cqe.res < 0) {
+                    copy.m_copyError = -cqe.res;
+                } else if (stage == 1) {
+                    (cqe.user_data & 1 ? copy.m_out : copy.m_in) = cqe.res;
+                } else if (S_ISDIR(copy.m_stat.stx_mode)) {
+                    copy.m_copyError = EISDIR;
+                } else if (!S_ISREG(copy.m_stat.stx_mode)) {
+                    copy.m_copyError = EINVAL;
+                }
+            }
+        }
+        if (!m_accelerated) {
+            break;
+        }
+    }
+
+    ///@brief A reflink beats any copy, try it with one ioctl before chaining
+    for (auto& copy : copies) {
+        if (copy.m_copyError == 0 && copy.m_in != -1 && copy.m_out != -1) {
+            copy.m_cloned = reflink(copy.m_in, copy.m_out);
+        }
+    }
+    size_t next = 0;
+    while (m_accelerated && !m_pipes.empty() && next < copies.size()) {
+        std::vector<Copy*> group;
+        while (next < copies.size() && group.size() < m_pipes.size() / 2) {
+            auto& copy = copies[next];
+            if (copy.m_copyError != 0 || copy.m_in == -1 || copy.m_out == -1 ||
+                    chainLength(copy) > m_ring.capacity()) {
+                ++next;
+                continue;
+            }
+            if (chainLength(copy) > m_ring.space()) {
+                break;
+            }
+            if (m_mover.traffic() != nullptr) {
+                m_mover.traffic()->begin(copy.m_stat.stx_size);
+            }
+            ///@brief A chain moves its bytes without coming back, pay for them up front
+            if (m_mover.throttle() != nullptr && !copy.m_cloned) {
+                m_mover.throttle()->bytes(copy.m_stat.stx_size);
+            }
+            int pipeIn = m_pipes[2 * group.size()];
+            int pipeOut = m_pipes[2 * group.size() + 1];
+            auto chain = static_cast<uint64_t>(group.size()) << 32;
+            unsigned op = 0;
+            for (uint64_t offset = 0; !copy.m_cloned && offset < copy.m_stat.stx_size; offset += m_chunkSize) {
+                auto length = static_cast<unsigned>(std::min<uint64_t>(m_chunkSize, copy.m_stat.stx_size - offset));
+                auto sqe = m_ring.getSqe();
+                prepSplice(sqe, copy.m_in, static_cast<int64_t>(offset), pipeOut, -1, length);
+                sqe->flags |= IOSQE_IO_LINK;
+                sqe->user_data = chain | op++;
+                sqe = m_ring.getSqe();
+                prepSplice(sqe, pipeIn, -1, copy.m_out, static_cast<int64_t>(offset), length);
+                sqe->flags |= IOSQE_IO_LINK;
+                sqe->user_data = chain | op++;
+            }
+            copy.m_renameOp = op;
+            ///@brief Durability::File renames only once the data is synced, the chain ends with the splices
+            if (durability != Durability::File) {
+                auto sqe = m_ring.getSqe();
+                prepRename(sqe, m_mover.destinationFd(), copy.m_tmpName, m_mover.destinationFd(),
+                           entries[copy.m_index].m_name);
+                sqe->user_data = chain | op++;
+                ///@brief With durability set the unlink waits for the sync of the group
+                if (durability == Durability::None) {
+                    sqe->flags |= IOSQE_IO_LINK;
+                    sqe = m_ring.getSqe();
+                    prepUnlink(sqe, m_mover.sourceFd(), entries[copy.m_index].m_name);
+                    sqe->user_data = chain | op++;
+                }
+            }
+            copy.m_pending = op;
+            copy.m_chained = true;
+            group.push_back(&copy);
+            ++next;
+        }
+        ///@brief A reflinked copy synced per file has no request in its chain at all
+        size_t pending = std::count_if(group.begin(), group.end(), [] (const Copy* copy) {
+            return copy->m_pending != 0;
+        });
+        while (pending > 0 && reap(completions)) {
+            for (const auto& cqe : completions) {
+                auto& copy = *group[cqe.user_data >> 32];
+                auto op = static_cast<unsigned>(cqe.user_data & 0xffffffff);
+                int error = cqe.res < 0 ? -cqe.res : 0;
+                if (op < copy.m_renameOp) {
+                    ///@brief A short splice breaks the link as well
+                    if (error == 0 && static_cast<uint64_t>(cqe.res) < std::min<uint64_t>(m_chunkSize,
+                            copy.m_stat.stx_size - (op / 2) * m_chunkSize)) {
+                        error = EIO;
+                    }
+                    if (copy.m_copyError == 0) {
+                        copy.m_copyError = error;
+                    }
+                } else if (op == copy.m_renameOp) {
+                    copy.m_renameError = error;
+                    copy.m_renamed = error == 0;
+                } else {
+                    copy.m_unlinkError = error;
+                }
+                if (--copy.m_pending == 0) {
+                    --pending;
+                }
+            }
+        }
+        if (pending > 0) {
+            ///@brief The ring failed under our feet, settle the chains still in flight by what reached the catalogues
+            for (auto copy : group) {
+                if (copy->m_pending != 0) {
+                    settle(m_mover.sourceFd(), m_mover.destinationFd(), entries[copy->m_index].m_name, *copy,
+                           durability);
+                }
+            }
+        }
+        ///@brief A broken chain may leave bytes in its pipe, or the kernel may still splice into it: never reuse it
+        for (size_t slot = group.size(); slot-- > 0;) {
+            if (!group[slot]->m_cloned && (group[slot]->m_copyError != 0 || group[slot]->m_abandoned)) {
+                replacePipe(2 * slot);
+            }
+        }
+        for (auto copy : group) {
+            if (copy->m_copyError == 0 && copy->m_renameError == 0) {
+                struct timespec times[2] = {};
+                times[0].tv_sec = copy->m_stat.stx_atime.tv_sec;
+                times[0].tv_nsec = copy->m_stat.stx_atime.tv_nsec;
+                times[1].tv_sec = copy->m_stat.stx_mtime.tv_sec;
+                times[1].tv_nsec = copy->m_stat.stx_mtime.tv_nsec;
+                futimens(copy->m_out, times);
+            }
+            ///@brief Like the plain path the copy is renamed into place only once its data is on disk
+            if (durability == Durability::File && copy->m_copyError == 0 && !copy->m_renamed) {
+                if (fdatasync(copy->m_out) == -1) {
+                    copy->m_syncError = errno;
+                } else if (renameat(m_mover.destinationFd(), copy->m_tmpName.c_str(), m_mover.destinationFd(),
+                                    entries[copy->m_index].m_name.c_str()) == -1) {
+                    copy->m_renameError = errno;
+                } else {
+                    copy->m_renamed = true;
+                }
+            }
+        }
+        if (m_mover.traffic() != nullptr) {
+            for (auto copy : group) {
+                m_mover.traffic()->end(copy->m_stat.stx_size, copy->m_renamed);
+            }
+        }
+    }
+
+    for (auto& copy : copies) {
+        if (copy.m_in != -1) {
+            close(copy.m_in);
+        }
+        if (copy.m_out != -1) {
+            close(copy.m_out);
+        }
+        bool landed = copy.m_chained && copy.m_renamed;
+        if (copy.m_out != -1 && !landed) {
+            unlinkat(m_mover.destinationFd(), copy.m_tmpName.c_str(), 0);
+        }
+        auto& result = results[copy.m_index];
+        if (landed && durability != Durability::None) {
+            result.m_status = Status::Copied;
+            result.m_strategy = copy.m_cloned ? Strategy::Reflink : Strategy::Splice;
+            auto& pending = deferred[copy.m_index];
+            pending.m_pending = true;
+            pending.m_unlinkSource = true;
+            pending.m_journalId = copy.m_journalId;
+            continue;
+        }
+        if (journal != nullptr && copy.m_journalId != 0) {
+            journal->finish(copy.m_journalId);
+        }
+        if (landed) {
+            result.m_status = copy.m_unlinkError == 0 ? Status::Copied : Status::Failed;
+            result.m_error = copy.m_unlinkError;
+            result.m_strategy = copy.m_cloned ? Strategy::Reflink : Strategy::Splice;
+        } else if (copy.m_abandoned || copy.m_syncError != 0) {
+            ///@brief Not retried: the kernel may still run what the ring was given, or the disk failed the sync
+            result.m_status = Status::Failed;
+            result.m_error = copy.m_syncError != 0 ? copy.m_syncError : ECANCELED;
+        } else if (copy.m_chained || copy.m_copyError == 0) {
+            ///@brief Chain broke, too large for the ring or the ring gave up: retry with plain calls
+            fallback(copy.m_index);
+        } else {
+            result.m_status = copy.m_copyError == EISDIR ? Status::Skipped : Status::Failed;
+            result.m_error = copy.m_copyError;
+        }
+    }
+}
+
+} // namespace transfer
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "mover.h"
+#include "ring.h"
+
+namespace transfer {
+
+/**
+ * @class  UringMover
+ * @file   uringmover.h
+ * @brief  Mover which keeps up to queueDepth operations in flight through io_uring.
+ *         Renames are submitted in batches. Cross-device files are stat'ed and
+ *         opened in batches, reflinked when the file systems allow it and
+ *         otherwise copied with one linked chain per file: splice through a
+ *         pipe, rename into place, unlink the source.
+ *         A broken link only cancels the rest of its own chain, so the source
+ *         is never unlinked unless the copy landed. With durability set the
+ *         unlink waits for the sync of the group; Durability::File ends the
+ *         chain after the splices and renames the copy only once its data is
+ *         synced. Should the ring fail, requests in flight are settled by what
+ *         reached the catalogues, never retried. Whenever io_uring is not
+ *         available, or copies are verified, the plain system call Mover does the work.
+ */
+class UringMover
+{
+public:
+    UringMover(const std::string& source, const std::string& destination, unsigned queueDepth,
+               const Options& options = Options());
+    ~UringMover();
+
+    bool valid() const noexcept
+    {
+        return m_mover.valid();
+    }
+
+    int error() const noexcept
+    {
+        return m_mover.error();
+    }
+
+    int sourceFd() const noexcept
+    {
+        return m_mover.sourceFd();
+    }
+
+    ///@brief false if every operation falls back to plain system calls
+    bool accelerated() const noexcept
+    {
+        return m_accelerated;
+    }
+
+    ///@brief Move every visible entry of the source catalogue select keeps, one batch per directory chunk
+    void moveAll(const Report& report, const Select& select = Select());
+
+    ///@brief Read the source catalogue chunk by chunk, see Mover::scan()
+    void scan(const std::function<void(const std::vector<Entry>&)>& consume, const Select& select = Select())
+    {
+        m_mover.scan(consume, select);
+    }
+
+    ///@brief Move the given entries of the source catalogue
+    std::vector<Result> moveBatch(const std::vector<Entry>& entries);
+
+    ///@brief Log copies to journal, the intents of a batch of chains are committed before it is submitted
+    void setJournal(Journal* journal) noexcept
+    {
+        m_mover.setJournal(journal);
+    }
+
+    ///@brief Record verified copies, see Mover::setManifest()
+    void setManifest(Manifest* manifest) noexcept
+    {
+        m_mover.setManifest(manifest);
+    }
+
+    ///@brief Create destination subdirectories on demand, see Mover::setDirectories()
+    void setDirectories(Directories* directories) noexcept
+    {
+        m_mover.setDirectories(directories);
+    }
+
+    Directories* directories() const noexcept
+    {
+        return m_mover.directories();
+    }
+
+    ///@brief Pace entries and copied bytes, a splice chain is paid for before it is submitted
+    void setThrottle(Throttle* throttle) noexcept
+    {
+        m_mover.setThrottle(throttle);
+    }
+
+    ///@brief Count copies in flight, a splice chain from its submission until it is reaped
+    void setTraffic(Traffic* traffic) noexcept
+    {
+        m_mover.setTraffic(traffic);
+    }
+
+    void setPool(ThreadPool* pool) noexcept
+    {
+        m_mover.setPool(pool);
+    }
+
+private:
+    ///@brief A move which waits for the sync group, with durability set only
+    struct Deferred
+    {
+        bool m_pending = false;
+        bool m_unlinkSource = false;
+        uint64_t m_journalId = 0;
+    };
+
+    ///@brief Rename every entry, the indices which crossed a device end up in crossDevice
+    void renameAll(const std::vector<Entry>& entries, std::vector<Result>& results,
+                   std::vector<size_t>& crossDevice, std::vector<Deferred>& deferred);
+    void copyAll(const std::vector<Entry>& entries, std::vector<Result>& results,
+                 const std::vector<size_t>& crossDevice, std::vector<Deferred>& deferred);
+    ///@brief Submit what is queued and reap at least one completion
+    bool reap(std::vector<struct io_uring_cqe>& completions);
+    ///@brief Open one more pipe for a chain, false if none can be had
+    bool addPipe();
+    ///@brief Swap the pipe at index at for a fresh one, drops it if no pipe can be opened
+    void replacePipe(size_t at);
+
+private:
+    Mover m_mover;
+    Ring m_ring;
+    bool m_accelerated = false;
+    ///@brief Pipes the splice chains run through, one per chain in flight
+    std::vector<int> m_pipes;
+    size_t m_chunkSize = 0;
+};
+
+} // namespace transfer
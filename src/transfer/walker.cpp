@@ -0,0 +1,156 @@
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <algorithm>
+
+#include "mover.h"
+#include "walker.h"
+
+namespace transfer {
+
+Walker::Walker(const std::string& root, unsigned workers, bool includeHidden)
+    : m_includeHidden(includeHidden)
+    , m_queued(0)
+    , m_pending(0)
+    , m_error(0)
+{
+    for (unsigned i = 0; i < std::max(workers, 1u); ++i) {
+        m_queues.emplace_back(new Queue);
+    }
+    m_rootFd = open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (m_rootFd == -1) {
+        m_error = errno;
+        return;
+    }
+    push(0, std::string());
+}
+
+Walker::~Walker()
+{
+    if (m_rootFd != -1) {
+        close(m_rootFd);
+    }
+}
+
+void Walker::run(unsigned worker, const Visit& visit)
+{
+    if (!valid() || worker >= m_queues.size()) {
+        return;
+    }
+    std::string directory;
+    while (true) {
+        if (take(worker, directory)) {
+            read(worker, directory, visit);
+            done();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_idleMutex);
+        if (m_pending.load() == 0) {
+            return;
+        }
+        ///@brief Nothing to steal while the others are still reading, wait for them to find more
+        m_wake.wait(lock, [this] () {
+            return m_queued.load() != 0 || m_pending.load() == 0;
+        });
+    }
+}
+
+void Walker::push(unsigned worker, std::string directory)
+{
+    ++m_pending;
+    {
+        auto& queue = *m_queues[worker];
+        std::lock_guard<std::mutex> lock(queue.m_mutex);
+        queue.m_directories.push_back(std::move(directory));
+    }
+    ++m_queued;
+    std::lock_guard<std::mutex> lock(m_idleMutex);
+    m_wake.notify_one();
+}
+
+bool Walker::take(unsigned worker, std::string& directory)
+{
+    {
+        auto& queue = *m_queues[worker];
+        std::lock_guard<std::mutex> lock(queue.m_mutex);
+        if (!queue.m_directories.empty()) {
+            directory = std::move(queue.m_directories.back());
+            queue.m_directories.pop_back();
+            --m_queued;
+            return true;
+        }
+    }
+    for (size_t i = 1; i < m_queues.size() && m_queued.load() != 0; ++i) {
+        auto& queue = *m_queues[(worker + i) % m_queues.size()];
+        std::lock_guard<std::mutex> lock(queue.m_mutex);
+        if (!queue.m_directories.empty()) {
+            directory = std::move(queue.m_directories.front());
+            queue.m_directories.pop_front();
+            --m_queued;
+            return true;
+        }
+    }
+    return false;
+}
+
+void Walker::read(unsigned worker, const std::string& directory, const Visit& visit)
+{
+    int fd = m_rootFd;
+    if (!directory.empty()) {
+        fd = openat(m_rootFd, directory.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (fd == -1) {
+            ///@brief Removed or replaced since it was listed, nothing left to move
+            if (errno != ENOENT && errno != ENOTDIR) {
+                int expected = 0;
+                m_error.compare_exchange_strong(expected, errno);
+            }
+            return;
+        }
+    }
+    const std::string prefix = directory.empty() ? std::string() : directory + "/";
+    Scanner scanner(fd);
+    std::vector<Entry> entries;
+    std::vector<Entry> files;
+    while (scanner.next(entries, m_includeHidden)) {
+        files.clear();
+        for (auto& entry : entries) {
+            if (m_includeHidden && Mover::isTemporary(entry.m_name)) {
+                continue;
+            }
+            if (entry.m_type == DT_UNKNOWN) {
+                struct stat st;
+                if (fstatat(fd, entry.m_name.c_str(), &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode)) {
+                    entry.m_type = DT_DIR;
+                }
+            }
+            if (entry.m_type == DT_DIR) {
+                push(worker, prefix + entry.m_name);
+                continue;
+            }
+            entry.m_name.insert(0, prefix);
+            files.push_back(std::move(entry));
+        }
+        if (!files.empty()) {
+            visit(files);
+        }
+    }
+    if (scanner.error() != 0) {
+        int expected = 0;
+        m_error.compare_exchange_strong(expected, scanner.error());
+    }
+    if (fd != m_rootFd) {
+        close(fd);
+    }
+}
+
+void Walker::done()
+{
+    if (--m_pending != 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_idleMutex);
+    m_wake.notify_all();
+}
+
+} // namespace transfer
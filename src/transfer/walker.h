@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "scanner.h"
+
+namespace transfer {
+
+/**
+ * @class  Walker
+ * @file   walker.h
+ * @brief  Work-stealing traversal of a catalogue tree. Every worker keeps a
+ *         deque of directories still to be read: it pushes the subdirectories
+ *         it finds onto its own deque and pops the most recent one, staying
+ *         deep in its own subtree, while an idle worker steals the oldest
+ *         entry of a busy worker's deque, the one closest to the root and so
+ *         likely the largest piece of work. Symbolic links are not followed.
+ *         The caller provides the threads, each runs run() with its own index.
+ */
+class Walker
+{
+public:
+    ///@brief Receives the non-directories of one chunk of a directory, named relative to the root
+    using Visit = std::function<void(std::vector<Entry>& files)>;
+
+    Walker(const std::string& root, unsigned workers, bool includeHidden);
+    ~Walker();
+
+    Walker(const Walker&) = delete;
+    Walker& operator=(const Walker&) = delete;
+
+    bool valid() const noexcept
+    {
+        return m_rootFd != -1;
+    }
+
+    ///@brief errno of the first directory which could not be read, 0 if the whole tree was
+    int error() const noexcept
+    {
+        return m_error.load();
+    }
+
+    ///@brief Descriptor of the root the names handed to Visit are relative to
+    int rootFd() const noexcept
+    {
+        return m_rootFd;
+    }
+
+    unsigned workers() const noexcept
+    {
+        return static_cast<unsigned>(m_queues.size());
+    }
+
+    ///@brief Walk as worker until the whole tree is read, concurrently with the other workers
+    void run(unsigned worker, const Visit& visit);
+
+private:
+    struct Queue
+    {
+        std::mutex m_mutex;
+        std::deque<std::string> m_directories;
+    };
+
+    void push(unsigned worker, std::string directory);
+    ///@brief Pop from the back of the worker's own deque or steal from the front of another
+    bool take(unsigned worker, std::string& directory);
+    void read(unsigned worker, const std::string& directory, const Visit& visit);
+    ///@brief One directory less to wait for, wakes every idle worker when it was the last one
+    void done();
+
+private:
+    int m_rootFd = -1;
+    bool m_includeHidden;
+    std::vector<std::unique_ptr<Queue> > m_queues;
+    ///@brief Directories queued, and queued or being read
+    std::atomic<size_t> m_queued;
+    std::atomic<size_t> m_pending;
+    std::atomic<int> m_error;
+    std::mutex m_idleMutex;
+    std::condition_variable m_wake;
+};
+
+} // namespace transfer
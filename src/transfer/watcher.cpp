@@ -0,0 +1,82 @@
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+
+#include "watcher.h"
+#include "mover.h"
+
+namespace transfer {
+
+namespace {
+
+const size_t s_eventBufferSize = 64 * 1024;
+
+} // unnamed namespace
+
+Watcher::Watcher(const std::string& path, bool includeHidden)
+    : m_includeHidden(includeHidden)
+    , m_buffer(s_eventBufferSize)
+{
+    m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_fd == -1) {
+        m_error = errno;
+        return;
+    }
+    m_watch = inotify_add_watch(m_fd, path.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR);
+    if (m_watch == -1) {
+        m_error = errno;
+    }
+}
+
+Watcher::~Watcher()
+{
+    if (m_fd != -1) {
+        close(m_fd);
+    }
+}
+
+bool Watcher::collect(Batch& batch)
+{
+    if (!drain(batch)) {
+        return false;
+    }
+    auto& entries = batch.m_entries;
+    std::stable_sort(entries.begin(), entries.end(), [] (const Entry& lhs, const Entry& rhs) {
+        return lhs.m_name < rhs.m_name;
+    });
+    entries.erase(std::unique(entries.begin(), entries.end(), [] (const Entry& lhs, const Entry& rhs) {
+        return lhs.m_name == rhs.m_name;
+    }), entries.end());
+    return true;
+}
+
+bool Watcher::drain(Batch& batch)
+{
+    bool gotEvents = false;
+    while (true) {
+        auto length = read(m_fd, m_buffer.data(), m_buffer.size());
+        if (length <= 0) {
+            return gotEvents;
+        }
+        gotEvents = true;
+        for (char* ptr = m_buffer.data(); ptr < m_buffer.data() + length; ) {
+            auto event = reinterpret_cast<const struct inotify_event*>(ptr);
+            ptr += sizeof(struct inotify_event) + event->len;
+            if (event->mask & (IN_Q_OVERFLOW | IN_IGNORED)) {
+                batch.m_overflow = true;
+                continue;
+            }
+            if (event->len == 0 || (event->name[0] == '.' && (!m_includeHidden || Mover::isTemporary(event->name)))) {
+                continue;
+            }
+            batch.m_entries.emplace_back();
+            batch.m_entries.back().m_name = event->name;
+            ///@brief Only regular files are closed after writing
+            batch.m_entries.back().m_type = (event->mask & IN_ISDIR) ? DT_DIR :
+                (event->mask & IN_CLOSE_WRITE) ? DT_REG : DT_UNKNOWN;
+        }
+    }
+}
+
+} // namespace transfer
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "scanner.h"
+
+namespace transfer {
+
+///@brief Entries reported complete by the kernel during one micro-batch
+struct Batch
+{
+    std::vector<Entry> m_entries;
+    ///@brief The kernel dropped events, the catalogue has to be rescanned
+    bool m_overflow = false;
+
+    void clear() noexcept
+    {
+        m_entries.clear();
+        m_overflow = false;
+    }
+};
+
+/**
+ * @class  Watcher
+ * @file   watcher.h
+ * @brief  inotify based notification about files finished in a catalogue.
+ *         A file is reported once its writer closed it (IN_CLOSE_WRITE) or
+ *         once it was moved into the catalogue (IN_MOVED_TO).
+ */
+class Watcher
+{
+public:
+    Watcher(const std::string& path, bool includeHidden);
+    ~Watcher();
+
+    Watcher(const Watcher&) = delete;
+    Watcher& operator=(const Watcher&) = delete;
+
+    bool valid() const noexcept
+    {
+        return m_watch != -1;
+    }
+
+    int error() const noexcept
+    {
+        return m_error;
+    }
+
+    ///@brief Descriptor which becomes readable when events are pending
+    int fd() const noexcept
+    {
+        return m_fd;
+    }
+
+    /**
+     * @brief Append the pending events to batch without blocking, an entry
+     * reported more than once is only kept once
+     * @return false if no event was pending
+     */
+    bool collect(Batch& batch);
+
+public:
+    ///@brief Upper bound of a micro-batch so a busy producer can not starve the mover
+    static const size_t s_maxBatchSize = 4096;
+
+private:
+    ///@brief Drain the pending events, returns false if nothing was read
+    bool drain(Batch& batch);
+
+private:
+    int m_fd = -1;
+    int m_watch = -1;
+    int m_error = 0;
+    bool m_includeHidden = false;
+    std::vector<char> m_buffer;
+};
+
+} // namespace transfer
@@ -31,10 +31,10 @@ public:
             }
             if (pathAndQueryStringEnd != std::string::npos) {
                 if (queryStart != std::string::npos) {
-                    path = line.substr(methodEnd + 1, pathAndQueryStringEnd - methodEnd - 2);
+                    path = line.substr(methodEnd + 1, queryStart - methodEnd - 2);
                     queryString = line.substr(queryStart, pathAndQueryStringEnd - queryStart);
                 } else {
-                    path = line.substr(methodEnd + 1, pathAndQueryStringEnd= methodEnd - 1);
+                    path = line.substr(methodEnd + 1, pathAndQueryStringEnd - methodEnd - 1);
                 }
 
                 size_t protocolEnd;